@@ -7,6 +7,7 @@
 @interface AggregatorReblogDeliverer : ReblogDeliverer
 {
 	NSMutableData * data_;
+	NSURLResponse * response_;
 }
 
 /**
@@ -8,6 +8,9 @@
 #import "AggregatorReblogDeliverer.h"
 #import "TumblrfulConstants.h"
 #import "NSString+Tumblrful.h"
+#import "MetadataCache.h"
+#import "ReblogKeyResolver.h"
+#import "XMLPathScanner.h"
 #import "DebugLog.h"
 #import <WebKit/WebKit.h>
 #import <objc/objc-runtime.h>
@@ -15,6 +18,16 @@
 static NSString * TUMBLR_DOMAIN = @".tumblr.com";
 static NSString * TUMBLR_DATA_URI = @"htpp://data.tumblr.com/";
 
+/// MetadataCache でのサービス名
+static NSString * CACHE_SERVICE = @"tumblr-read";
+
+/// read API の応答から拾う値
+static NSString * PATH_REBLOG_KEY = @"/tumblr/posts/post@reblog-key";
+
+@interface AggregatorReblogDeliverer ()
+- (void)reblogWithReadData:(NSData *)data;
+@end
+
 @implementation AggregatorReblogDeliverer
 
 + (NSString *)sitePostfix
@@ -30,6 +43,7 @@ static NSString * TUMBLR_DATA_URI = @"htpp://data.tumblr.com/";
 - (void)dealloc
 {
 	[data_ release], data_ = nil;
+	[response_ release], response_ = nil;
 
 	[super dealloc];
 }
@@ -51,10 +65,28 @@ static NSString * TUMBLR_DATA_URI = @"htpp://data.tumblr.com/";
 		}
 		self.postID = postID;
 
+		// ページ全体をまとめて引いた reblog-key があれば read API を待たない
+		NSString * reblogKey = [[ReblogKeyResolver sharedInstance] reblogKeyForPostID:postID];
+		if (reblogKey != nil) {
+			D(@"resolved in batch: pid=%@, rk=%@", postID, reblogKey);
+			self.reblogKey = reblogKey;
+			[super action:nil];
+			[self autorelease];
+			return;
+		}
+
+		// 前に引いたものが期限内なら通信しない
+		MetadataCache * cache = [MetadataCache sharedCache];
+		NSData * cached = [cache dataForService:CACHE_SERVICE identifier:postID];
+		if (cached != nil) {
+			[self reblogWithReadData:cached];
+			return;
+		}
+
 		// make Tumblr read API URL
 		NSString * endpoint = [NSString stringWithFormat:@"%@://%@/api/read?id=%@", [u scheme], [u host], postID];
 		D(@"API endpoint=%@", endpoint);
-		NSURLRequest * request = [NSURLRequest requestWithURL:[NSURL URLWithString:endpoint]];
+		NSURLRequest * request = [cache requestWithURL:[NSURL URLWithString:endpoint] timeoutInterval:60.0 service:CACHE_SERVICE identifier:postID];
 
 		NSURLConnection * connection;
 		connection = [NSURLConnection connectionWithRequest:request delegate:self];	// autoreleased
@@ -79,7 +111,8 @@ static NSString * TUMBLR_DATA_URI = @"htpp://data.tumblr.com/";
 		D(@"ResponseHeader:%@", [[httpResponse allHeaderFields] description]);
 	}
 
-	data_ = [[NSMutableData data] retain];
+	[response_ release], response_ = [response retain];
+	[data_ release], data_ = [[NSMutableData data] retain];
 }
 
 - (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
@@ -91,25 +124,17 @@ static NSString * TUMBLR_DATA_URI = @"htpp://data.tumblr.com/";
 - (void)connectionDidFinishLoading:(NSURLConnection *)connection
 {
 #pragma unused (connection)
-	// parse read API XML
-	NSError * error = nil;
-	NSXMLDocument * xmlDoc = [[[NSXMLDocument alloc] initWithData:data_ options:NSXMLDocumentTidyXML error:&error] autorelease];
-	error = nil;
-	NSXMLElement * post = [[xmlDoc nodesForXPath:@"/tumblr/posts/post" error:&error] lastObject];
-	if (error != nil) {
-		[NSException raise:TUMBLRFUL_EXCEPTION_NAME format:@"Unrecognize Tumblr read XML. %@", [error description]];
+	NSInteger const status = [response_ isKindOfClass:[NSHTTPURLResponse class]] ? [(NSHTTPURLResponse *)response_ statusCode] : 200;
+	if (status != 200 && status != 304) {
+		// エラーページを read API の応答として読まない
+		NSString * message = [NSString stringWithFormat:@"Could not read Tumblr post. HTTP status %d", status];
+		[self failedWithError:[NSError errorWithDomain:TUMBLRFUL_ERROR_DOMAIN code:status userInfo:[NSDictionary dictionaryWithObject:message forKey:NSLocalizedDescriptionKey]]];
+		[self autorelease];
+		return;
 	}
-	NSXMLNode * attribute = [post attributeForName:@"reblog-key"];
-	D(@"%@ - %@", [attribute description], [attribute stringValue]);
 
-	// set properties
-	self.reblogKey = [attribute stringValue];
-	D(@"pid=%@, rk=%@", self.postID, self.reblogKey);
-
-	// call base class's method
-	[super action:nil];
-
-	[self autorelease];
+	// 304 ならば覚えていたものが返る
+	[self reblogWithReadData:[[MetadataCache sharedCache] dataWithResponse:response_ data:data_ service:CACHE_SERVICE identifier:self.postID]];
 }
 
 - (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
@@ -122,4 +147,42 @@ static NSString * TUMBLR_DATA_URI = @"htpp://data.tumblr.com/";
 	[self autorelease];
 }
 
+#pragma mark -
+#pragma mark Private Methods
+
+/**
+ * read API の応答から reblog-key を取り出して Reblog する. 成功しても失敗しても自分を autorelease する
+ *	@param[in] data	read API の応答
+ */
+- (void)reblogWithReadData:(NSData *)data
+{
+	// parse read API XML. reblog-key が見つかったらそこで読むのをやめる
+	D_ELAPSE_BEGIN(tumblrReadScan);
+	NSError * error = nil;
+	NSDictionary * values = [XMLPathScanner valuesForPaths:[NSArray arrayWithObject:PATH_REBLOG_KEY] inData:data error:&error];
+	D_ELAPSE_END(tumblrReadScan);
+	if (values == nil) {
+		// XML でない応答(エラーページなど)は覚えておかない. delegate から例外を投げずに失敗を知らせる
+		D0([error description]);
+		[[MetadataCache sharedCache] removeDataForService:CACHE_SERVICE identifier:self.postID];
+		NSString * message = [NSString stringWithFormat:@"Unrecognize Tumblr read XML. %@", [error localizedDescription]];
+		[self failedWithError:[NSError errorWithDomain:TUMBLRFUL_ERROR_DOMAIN code:-1 userInfo:[NSDictionary dictionaryWithObject:message forKey:NSLocalizedDescriptionKey]]];
+		[self autorelease];
+		return;
+	}
+
+	// set properties
+	self.reblogKey = [values objectForKey:PATH_REBLOG_KEY];
+	D(@"pid=%@, rk=%@", self.postID, self.reblogKey);
+	if (self.reblogKey == nil) {
+		// 中身の無い応答は覚えておかない
+		[[MetadataCache sharedCache] removeDataForService:CACHE_SERVICE identifier:self.postID];
+	}
+
+	// call base class's method
+	[super action:nil];
+
+	[self autorelease];
+}
+
 @end
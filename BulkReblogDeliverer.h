@@ -0,0 +1,27 @@
+/**
+ * @file BulkReblogDeliverer.h
+ * @brief BulkReblogDeliverer class declaration
+ */
+#import "DelivererBase.h"
+
+/**
+ * ページ上の複数のポストをまとめて Reblog する Deliverer
+ *	ダッシュボードのように Reblog できるポストが2つ以上あるページでだけ作られる.
+ *	メニューで件数を選ぶと ReblogPipeline に流す.
+ */
+@interface BulkReblogDeliverer : DelivererBase
+{
+	NSArray * tokens_;	///< ReblogDeliverer の形式のトークン. ページ上の順
+}
+
+/// ページ上のトークン
+@property (nonatomic, readonly) NSArray * tokens;
+
+/**
+ * Initialize object
+ *	@param[in] document 現在表示しているビューの DOMHTMLDocumentオブジェクト
+ *	@param[in] targetElement 選択していた要素の情報
+ *	@param[in] tokens "pid" と "rk" を持つ辞書の配列
+ */
+- (id)initWithDocument:(DOMHTMLDocument *)document target:(NSDictionary *)targetElement tokens:(NSArray *)tokens;
+@end
@@ -0,0 +1,97 @@
+/**
+ * @file BulkReblogDeliverer.m
+ * @brief BulkReblogDeliverer class implementation
+ */
+#import "BulkReblogDeliverer.h"
+#import "ReblogDeliverer.h"
+#import "ReblogPipeline.h"
+#import "DelivererRules.h"
+#import "DebugLog.h"
+
+static NSString * TYPE = @"Reblog";
+
+/// メニューで選べる件数. ページ上の数より少ないものだけ出し、最後に "All" を付ける
+static NSUInteger const COUNTS[] = { 5, 10, 20, 50 };
+
+@implementation BulkReblogDeliverer
+
+@synthesize tokens = tokens_;
+
++ (id<Deliverer>)create:(DOMHTMLDocument *)document element:(NSDictionary *)clickedElement
+{
+	NSArray * tokens = [ReblogDeliverer reblogTokensFromDocument:document];
+	if ([tokens count] < 2) return nil;
+
+	BulkReblogDeliverer * deliverer = [[BulkReblogDeliverer alloc] initWithDocument:document target:clickedElement tokens:tokens];
+	if (deliverer == nil) {
+		D(@"Could not alloc+init Bulk%@Deliverer.", TYPE);
+	}
+	return deliverer;
+}
+
+- (id)initWithDocument:(DOMHTMLDocument *)document target:(NSDictionary *)targetElement tokens:(NSArray *)tokens
+{
+	if ((self = [super initWithDocument:document target:targetElement]) != nil) {
+		tokens_ = [tokens copy];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[tokens_ release], tokens_ = nil;
+	[super dealloc];
+}
+
+- (NSString *)postType
+{
+	return [TYPE lowercaseString];
+}
+
+- (NSString *)titleForMenuItem
+{
+	return [NSString stringWithFormat:@"%@ Posts on This Page", TYPE];
+}
+
+/// 件数を選ぶサブメニュー付きの項目を作る. 件数は tag に持たせる
+- (NSMenuItem *)createMenuItem
+{
+	NSMenu * subMenu = [[[NSMenu alloc] initWithTitle:[self titleForMenuItem]] autorelease];
+	NSUInteger const count = [tokens_ count];
+	for (NSUInteger i = 0; i < sizeof(COUNTS) / sizeof(COUNTS[0]) && COUNTS[i] < count; ++i) {
+		NSString * title = [NSString stringWithFormat:@"Latest %u", COUNTS[i]];
+		NSMenuItem * item = [[[NSMenuItem alloc] initWithTitle:title action:@selector(action:) keyEquivalent:@""] autorelease];
+		[item setTarget:self];
+		[item setTag:(NSInteger)COUNTS[i]];
+		[subMenu addItem:item];
+	}
+	NSMenuItem * all = [[[NSMenuItem alloc] initWithTitle:[NSString stringWithFormat:@"All (%u)", count] action:@selector(action:) keyEquivalent:@""] autorelease];
+	[all setTarget:self];
+	[all setTag:(NSInteger)count];
+	[subMenu addItem:all];
+
+	NSMenuItem * menuItem = [[[NSMenuItem alloc] initWithTitle:[DelivererRules menuItemTitleWith:[self titleForMenuItem]] action:nil keyEquivalent:@""] autorelease];
+	[menuItem setSubmenu:subMenu];
+	return menuItem;
+}
+
+- (NSArray *)createMenuItems
+{
+	return [NSArray arrayWithObject:[self createMenuItem]];
+}
+
+- (void)action:(id)sender
+{
+	@try {
+		NSUInteger const count = MIN((NSUInteger)[sender tag], [tokens_ count]);
+		D(@"bulk reblog: %u of %u", count, [tokens_ count]);
+
+		ReblogPipeline * pipeline = [[[ReblogPipeline alloc] initWithTokens:[tokens_ subarrayWithRange:NSMakeRange(0, count)]] autorelease];
+		[pipeline start];
+	}
+	@catch (NSException * e) {
+		D0([e description]);
+		[self failedWithException:e];
+	}
+}
+@end
@@ -4,14 +4,14 @@
  * @author Masayuki YAMAYA
  * @date 2008-03-28
  */
-// /System/Library/Frameworks/Foundation.framework/Headers/NSXMLDocument.h
-// /System/Library/Frameworks/Foundation.framework/Headers/NSXMLNode.h
 #import "DeliciousPost.h"
+#import "HTTPSession.h"
 #import "NSDataBase64.h"
 #import "UserSettings.h"
 #import "NSString+Tumblrful.h"
+#import "FormEncoder.h"
+#import "XMLPathScanner.h"
 #import "DebugLog.h"
-#import <Foundation/NSXMLDocument.h>
 
 static NSString * API_ADD_ENDPOINT = @"https://api.del.icio.us/v1/posts/add?";
 
@@ -79,8 +79,8 @@ static NSString * API_ADD_ENDPOINT = @"https://api.del.icio.us/v1/posts/add?";
 	NSURLRequest * request = [self createRequest:params]; // request は connection に指定した時点で reatin upする
 	D(@"request:%@", [request description]);
 
-	NSURLConnection * connection = [NSURLConnection connectionWithRequest:request delegate:self];
-	if (connection == nil) {
+	id task = [[HTTPSession sharedSession] startRequest:request delegate:self];	// 同じホストへの接続を使い回す
+	if (task == nil) {
 		[self callback:@selector(failedWithError:) withObject:nil];
 		[data_ release], data_ = nil;
 	}
@@ -123,18 +123,15 @@ static NSString * API_ADD_ENDPOINT = @"https://api.del.icio.us/v1/posts/add?";
 
 	@try {
 		if (callback_ != nil) {
+			// <result code="done" /> の code だけを読む
 			NSError * error = nil;
-			NSXMLDocument * xmlDoc = [[[NSXMLDocument alloc] initWithData:data_ options:NSXMLDocumentTidyHTML error:&error] autorelease];
-			if (error != nil) {
+			NSDictionary * values = [XMLPathScanner valuesForPaths:[NSArray arrayWithObject:@"@code"] inData:data_ error:&error];
+			if (values == nil) {
 				[self callback:@selector(failedWithError:) withObject:error];
 				return;
 			}
 
-			NSString * resultCode = nil;
-			NSXMLNode * node = [[xmlDoc rootElement] attributeForName:@"code"];
-			if (node != nil) {
-				resultCode = [node stringValue];
-			}
+			NSString * resultCode = [values objectForKey:@"@code"];
 			D(@"resultCode:%@", resultCode);
 
 			[self callback:@selector(successed:) withObject:resultCode];
@@ -154,13 +151,9 @@ static NSString * API_ADD_ENDPOINT = @"https://api.del.icio.us/v1/posts/add?";
 - (NSURLRequest *)createRequest:(NSDictionary *)params
 {
 	@try {
-		NSMutableString * ps = [NSMutableString string];
-		NSEnumerator * enumerator = [params keyEnumerator];
-		for (NSString * key; (key = [enumerator nextObject]) != nil; ) {
-			D(@"%@=%@", key, [params objectForKey:key]);
-			[ps appendFormat:@"&%@=%@", key, [[params objectForKey:key] stringByURLEncoding:NSUTF8StringEncoding]];
-		}
-		NSURL * url = [NSURL URLWithString:[NSString stringWithFormat:@"%@?%@", API_ADD_ENDPOINT, ps]];
+		NSString * ps = [FormEncoder stringWithParams:params];
+		D0(ps);
+		NSURL * url = [NSURL URLWithString:[API_ADD_ENDPOINT stringByAppendingString:ps]];
 
 		// create the POST request
 		NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:url cachePolicy:NSURLRequestReloadIgnoringCacheData timeoutInterval:TIMEOUT];
@@ -8,6 +8,7 @@
  */
 #import "DeliciousPostAdaptor.h"
 #import "DeliciousPost.h"
+#import "PostQueue.h"
 #import "NSString+Tumblrful.h"
 #import "DebugLog.h"
 
@@ -53,18 +54,15 @@
 			description = [description stringByPaddingToLength:(MAX_DESCRIPTION - 3) withString:@"." startingAtIndex:0];
 		}
 
-		// delicious へポストするオブジェクトを生成する
-		DeliciousPost * delicious = [[DeliciousPost alloc] initWithCallback:callback_];
-
-		// リクエストパラメータを構築する
-		NSMutableDictionary * params = [delicious createMinimumRequestParams];
+		// リクエストパラメータを構築する. shared は送信する時に DeliciousPost が足す
+		NSMutableDictionary * params = [NSMutableDictionary dictionary];
 		[params setValue:anchor.URL forKey:@"url"];
 		[params setValue:anchor.title forKey:@"description"];
 		[params setValue:description forKey:@"extended"];
 		D(@"params: %@", [params description]);
 
-		// ポストする
-		[delicious postWith:params];
+		// 送信待ち行列に入れる. delicious へのポストは PostQueue が行う
+		[[PostQueue sharedQueue] enqueuePostClass:[DeliciousPost class] params:params options:nil callback:callback_];
 	}
 	@catch (NSException * e) {
 		D0([e description]);
@@ -80,13 +78,13 @@
 - (void)postPhoto:(NSString *)source caption:(NSString *)caption throughURL:(NSString *)throughURL image:(NSImage *)image
 {
 #pragma unused (source, throughURL, image)
-	[self postLink:[Anchor anchorWithHTML:caption] description:[caption stripHTMLTags:nil]];
+	[self postLink:[self.payload anchorWithHTML:caption] description:[self.payload strippedHTML:caption]];
 }
 
 - (void)postVideo:(NSString *)embed caption:(NSString*)caption
 {
 #pragma unused (embed, caption)
-	[self postLink:[Anchor anchorWithHTML:caption] description:[caption stripHTMLTags:nil]];
+	[self postLink:[self.payload anchorWithHTML:caption] description:[self.payload strippedHTML:caption]];
 }
 
 - (void)postEntry:(NSDictionary *)params
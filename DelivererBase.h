@@ -7,6 +7,7 @@
 #import "Deliverer.h"
 #import "DelivererContext.h"
 #import "PostCallback.h"
+#import "PostGroup.h"
 
 #define MENUITEM_TAG_NEED_EDIT	0x8000
 #define MENUITEM_TAG_MASK		0x00FF
@@ -14,7 +15,7 @@
 /**
  * DelivererBase abstract class
  */
-@interface DelivererBase : NSObject<Deliverer, PostCallback>
+@interface DelivererBase : NSObject<Deliverer, PostCallback, PostGroupDelegate>
 {
 	DelivererContext * context_;
 	NSUInteger filterMask_;
@@ -26,6 +27,14 @@
 
 @property (nonatomic, assign) BOOL editEnabled;
 
+/**
+ * URL of document
+ *	parses [document URL] only once while the same URL is shown. (main thread only)
+ *	@param[in] document Currently displayed object DOMHTMLDocument
+ *	@return NSURL object
+ */
++ (NSURL *)URLOfDocument:(DOMHTMLDocument *)document;
+
 /**
  * Initialize object
  *	@param[in] context DelivererContext object
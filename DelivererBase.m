@@ -13,6 +13,7 @@
 #import "Anchor.h"
 #import "PostAdaptorCollection.h"
 #import "PostAdaptor.h"
+#import "PayloadCache.h"
 #import "GrowlSupport.h"
 #import "PostEditWindowController.h"
 #import "NSString+Tumblrful.h"
@@ -24,6 +25,9 @@
 - (void)actionInternal:(id)sender;
 - (void)invoke:(NSInvocation *)invocation withType:(PostType)type;
 - (void)invoke:(NSInvocation *)invocation withType:(PostType)type withImage:(NSImage *)image;
+- (PostGroup *)createPostGroup;
+- (PayloadCache *)createPayload;
+- (id<PostCallback>)callbackForAdaptorClass:(Class)adaptorClass inGroup:(PostGroup *)group;
 @end
 
 @implementation DelivererBase
@@ -38,6 +42,22 @@
 	return nil;
 }
 
++ (NSURL *)URLOfDocument:(DOMHTMLDocument *)document
+{
+	// メニューを作る間に各 Deliverer が同じ URL を何度もパースしないよう、直前の結果を覚えておく
+	static NSString * lastString = nil;
+	static NSURL * lastURL = nil;
+
+	NSString * string = [document URL];
+	if (string == nil) return nil;
+
+	if (lastString == nil || ![lastString isEqualToString:string]) {
+		[lastString release], lastString = [string copy];
+		[lastURL release], lastURL = [[NSURL alloc] initWithString:[string stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+	}
+	return [[lastURL retain] autorelease];
+}
+
 - (id)initWithDocument:(DOMHTMLDocument *)document target:(NSDictionary *)targetElement
 {
 	// targetにマッチするコンテキストを探す
@@ -121,6 +141,30 @@
 	}
 }
 
+/**
+ * 選択された全サービスの結果を1つにまとめるグループを作る
+ *	編集シートを出す時はサービスごとにシートを閉じるタイミングが違うので、まとめない(nil を返す)
+ */
+- (PostGroup *)createPostGroup
+{
+	if (needEdit_) return nil;
+	return [[[PostGroup alloc] initWithDelegate:self] autorelease];
+}
+
+/**
+ * 1回のポスト操作で選択された全アダプタが共有する派生データのキャッシュを作る
+ */
+- (PayloadCache *)createPayload
+{
+	return [[[PayloadCache alloc] init] autorelease];
+}
+
+- (id<PostCallback>)callbackForAdaptorClass:(Class)adaptorClass inGroup:(PostGroup *)group
+{
+	if (group == nil) return self;
+	return [group memberForAdaptorClass:adaptorClass];
+}
+
 - (NSInvocation *)typedInvocation:(SEL)selector withAdaptor:(PostAdaptor *)adaptor
 {
 	NSMethodSignature * signature = [adaptor.class instanceMethodSignatureForSelector:selector];
@@ -137,12 +181,15 @@
 {
 	@try {
 		Anchor * anchor = [Anchor anchorWithURL:url title:title];
+		PayloadCache * payload = [self createPayload];
+		PostGroup * group = [self createPostGroup];
 		NSUInteger i = 0;
 		NSEnumerator * enumerator = [PostAdaptorCollection enumerator];
 		Class adaptorClass;
 		while ((adaptorClass = [enumerator nextObject]) != nil) {
 			if ((1 << i) & filterMask_) { // do filter
-				PostAdaptor * adaptor = [[[adaptorClass alloc] initWithCallback:self] autorelease];
+				PostAdaptor * adaptor = [[[adaptorClass alloc] initWithCallback:[self callbackForAdaptorClass:adaptorClass inGroup:group]] autorelease];
+				adaptor.payload = payload;
 				NSInvocation * invocation = [self typedInvocation:@selector(postLink:description:) withAdaptor:adaptor];
 				[invocation setArgument:&anchor atIndex:2];
 				[invocation setArgument:&EmptyString atIndex:3];
@@ -151,6 +198,7 @@
 			}
 			i++;
 		}
+		[group seal];
 	}
 	@catch (NSException * e) {
 		D0([e description]);
@@ -164,12 +212,15 @@
 		if (source == nil || [source length] == 0)
 			source = context_.anchorToDocument;
 
+		PayloadCache * payload = [self createPayload];
+		PostGroup * group = [self createPostGroup];
 		NSUInteger i = 0;
 		NSEnumerator * enumerator = [PostAdaptorCollection enumerator];
 		Class adaptorClass;
 		while ((adaptorClass = [enumerator nextObject]) != nil) {
 			if ((1 << i) & filterMask_) {	// フィルタリング
-				PostAdaptor * adaptor = [[[adaptorClass alloc] initWithCallback:self] autorelease];
+				PostAdaptor * adaptor = [[[adaptorClass alloc] initWithCallback:[self callbackForAdaptorClass:adaptorClass inGroup:group]] autorelease];
+				adaptor.payload = payload;
 				NSInvocation * invocation = [self typedInvocation:@selector(postQuote:source:) withAdaptor:adaptor];
 				[invocation setArgument:&quote atIndex:2];
 				[invocation setArgument:&source atIndex:3];
@@ -178,6 +229,7 @@
 			}
 			i++;
 		}
+		[group seal];
 	}
 	@catch (NSException * e) {
 		D0([e description]);
@@ -192,12 +244,15 @@
 	D(@"url:%@", [url description]);
 	D(@"image:%@", [image description]);
 
+	PayloadCache * payload = [self createPayload];
+	PostGroup * group = [self createPostGroup];
 	NSUInteger i = 0;
 	NSEnumerator * enumerator = [PostAdaptorCollection enumerator];
 	Class adaptorClass;
 	while ((adaptorClass = [enumerator nextObject]) != nil) {
 		if ((1 << i) & filterMask_) {	// do filter
-			PostAdaptor * adaptor = [[[adaptorClass alloc] initWithCallback:self] autorelease];
+			PostAdaptor * adaptor = [[[adaptorClass alloc] initWithCallback:[self callbackForAdaptorClass:adaptorClass inGroup:group]] autorelease];
+			adaptor.payload = payload;
 			NSInvocation * invocation = [self typedInvocation:@selector(postPhoto:caption:throughURL:image:) withAdaptor:adaptor];
 			[invocation setArgument:&source atIndex:2];
 			[invocation setArgument:&caption atIndex:3];
@@ -208,16 +263,20 @@
 		}
 		i++;
 	}
+	[group seal];
 }
 
 - (void)postVideo:(NSString *)embed caption:(NSString *)caption
 {
+	PayloadCache * payload = [self createPayload];
+	PostGroup * group = [self createPostGroup];
 	NSUInteger i = 0;
 	NSEnumerator * enumerator = [PostAdaptorCollection enumerator];
 	Class adaptorClass;
 	while ((adaptorClass = [enumerator nextObject]) != nil) {
 		if ((1 << i) & filterMask_) {	// do filter
-			PostAdaptor * adaptor = [[[adaptorClass alloc] initWithCallback:self] autorelease];
+			PostAdaptor * adaptor = [[[adaptorClass alloc] initWithCallback:[self callbackForAdaptorClass:adaptorClass inGroup:group]] autorelease];
+			adaptor.payload = payload;
 			NSInvocation * invocation = [self typedInvocation:@selector(postVideo:caption:) withAdaptor:adaptor];
 			[invocation setArgument:&embed atIndex:2];
 			[invocation setArgument:&caption atIndex:3];
@@ -226,16 +285,20 @@
 		}
 		i++;
 	}
+	[group seal];
 }
 
 - (void)postEntry:(NSDictionary *)params
 {
+	PayloadCache * payload = [self createPayload];
+	PostGroup * group = [self createPostGroup];
 	NSUInteger i = 0;
 	NSEnumerator * enumerator = [PostAdaptorCollection enumerator];
 	Class adaptorClass;
 	while ((adaptorClass = [enumerator nextObject]) != nil) {
 		if ((1 << i) & filterMask_) {	// do filter
-			PostAdaptor * adaptor = [[adaptorClass alloc] initWithCallback:self];
+			PostAdaptor * adaptor = [[adaptorClass alloc] initWithCallback:[self callbackForAdaptorClass:adaptorClass inGroup:group]];
+			adaptor.payload = payload;
 			NSInvocation * invocation = [adaptor invocationWithPostType:ReblogPostType];
 			[invocation setArgument:&params atIndex:2];
 			[invocation retainArguments];
@@ -243,6 +306,7 @@
 		}
 		i++;
 	}
+	[group seal];
 }
 
 - (void)successed:(NSString *)response
@@ -279,6 +343,39 @@
 	[self notify:[DelivererRules errorMessageWith:[exception description]]];
 }
 
+/**
+ * ポストを PostQueue が預かって送り直す時のコールバック. 最終的な結果は後で successed: などに届く
+ */
+- (void)deferredWithError:(NSError *)error
+{
+	NSString * reason = error != nil ? [error localizedDescription] : @"";
+	[self notify:[NSString stringWithFormat:@"%@\n--- queued, will retry %@", Stringnize(context_.documentTitle), reason]];
+}
+
+/**
+ * 全サービスの結果が揃った時のコールバック
+ *	サービスが1つなら従来どおり successed: などに渡し、複数ならサービスごとの結果を1つの通知にまとめる
+ */
+- (void)postGroupCompleted:(PostGroup *)group
+{
+	NSArray * results = group.results;
+	if ([results count] == 1) {
+		PostGroupResult * result = [results objectAtIndex:0];
+		if (result.deferred)										[self deferredWithError:result.outcome];
+		else if (result.succeeded)									[self successed:result.outcome];
+		else if ([result.outcome isKindOfClass:[NSException class]])	[self failedWithException:result.outcome];
+		else															[self failedWithError:result.outcome];
+		return;
+	}
+
+	NSMutableString * message = [NSMutableString stringWithString:Stringnize(context_.documentTitle)];
+	NSEnumerator * enumerator = [results objectEnumerator];
+	for (PostGroupResult * result; (result = [enumerator nextObject]) != nil; ) {
+		[message appendFormat:@"\n%@", [result summary]];
+	}
+	[self notify:message];
+}
+
 /**
  * 汎用メッセージ処理
  */
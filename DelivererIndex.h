@@ -0,0 +1,52 @@
+/**
+ * @file DelivererIndex.h
+ * @brief DelivererIndex class declaration
+ */
+#import <Foundation/Foundation.h>
+
+@class DOMHTMLDocument;
+
+/// 右クリックされた要素の種類. Deliverer がどの種類の要素で動くかを表す
+enum {
+	DelivererElementAny			= 0,		///< 要素を問わない
+	DelivererElementImage		= 1 << 0,	///< 画像(WebElementImageURLKey か WebElementImageKey がある)
+	DelivererElementNode		= 1 << 1,	///< DOM ノード(WebElementDOMNodeKey がある)
+	DelivererElementSelection	= 1 << 2,	///< 選択範囲の上
+	DelivererElementNoSelection	= 1 << 3,	///< 選択範囲の外
+};
+typedef NSUInteger DelivererElementKind;
+
+/**
+ * Deliverer クラスをホスト名と要素の種類で引く索引
+ *	右クリックのたびに全 Deliverer の +create:element: を呼ぶと、それぞれが document の URL を
+ *	パースし直してホスト名を1つずつ比べることになる.
+ *	ホスト名の末尾(ラベル単位)の trie と要素の種類で候補を絞り、当てはまるクラスだけを登録順に返す.
+ *	最終的な判定はこれまでどおり各クラスの +create:element: が行う.
+ */
+@interface DelivererIndex : NSObject
+{
+	NSMutableArray * entries_;	///< 登録順のエントリ
+	id root_;					///< ホスト名の trie の根
+}
+
+/**
+ * Deliverer クラスを登録する. 登録した順が候補を返す順になる
+ *	@param[in] delivererClass	Deliverer プロトコルを実装したクラス
+ *	@param[in] hostSuffixes	動くホスト名(ラベル単位の末尾一致). nil ならホストを問わない
+ *	@param[in] kinds	動く要素の種類(DelivererElementKind の OR). すべてを満たす時だけ候補にする
+ */
+- (void)addClass:(Class)delivererClass hostSuffixes:(NSArray *)hostSuffixes kinds:(DelivererElementKind)kinds;
+
+/**
+ * 登録したすべてのクラス(登録順)
+ */
+- (NSArray *)allClasses;
+
+/**
+ * document と右クリックされた要素から、当てはまりうる Deliverer クラスを登録順に返す
+ *	@param[in] document	現在表示しているビューの DOMHTMLDocument
+ *	@param[in] clickedElement	選択していた要素の情報
+ *	@return Deliverer クラスの配列
+ */
+- (NSArray *)candidatesForDocument:(DOMHTMLDocument *)document element:(NSDictionary *)clickedElement;
+@end
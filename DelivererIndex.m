@@ -0,0 +1,197 @@
+/**
+ * @file DelivererIndex.m
+ * @brief DelivererIndex class implementation
+ */
+#import "DelivererIndex.h"
+#import "DelivererBase.h"
+#import "DebugLog.h"
+#import <WebKit/WebKit.h>
+
+#pragma mark -
+/**
+ * 登録した Deliverer クラス1つ分
+ */
+@interface DelivererIndexEntry : NSObject
+{
+	Class delivererClass_;
+	DelivererElementKind kinds_;
+}
+@property (nonatomic, readonly) Class delivererClass;
+@property (nonatomic, readonly) DelivererElementKind kinds;
+- (id)initWithClass:(Class)delivererClass kinds:(DelivererElementKind)kinds;
+@end
+
+@implementation DelivererIndexEntry
+
+@synthesize delivererClass = delivererClass_;
+@synthesize kinds = kinds_;
+
+- (id)initWithClass:(Class)delivererClass kinds:(DelivererElementKind)kinds
+{
+	if ((self = [super init]) != nil) {
+		delivererClass_ = delivererClass;
+		kinds_ = kinds;
+	}
+	return self;
+}
+@end
+
+#pragma mark -
+/**
+ * ホスト名の trie の節. ホスト名を後ろのラベルからたどる("www.flickr.com" なら com -> flickr -> www)
+ */
+@interface DelivererIndexNode : NSObject
+{
+	NSMutableDictionary * children_;	///< ラベル -> DelivererIndexNode
+	NSMutableIndexSet * entries_;		///< ここまでのラベルで終わるホストに登録されたエントリの番号
+}
+@property (nonatomic, readonly) NSIndexSet * entries;
+- (DelivererIndexNode *)childForLabel:(NSString *)label create:(BOOL)create;
+- (void)addEntryAtIndex:(NSUInteger)index;
+@end
+
+@implementation DelivererIndexNode
+
+@synthesize entries = entries_;
+
+- (id)init
+{
+	if ((self = [super init]) != nil) {
+		children_ = [[NSMutableDictionary alloc] init];
+		entries_ = [[NSMutableIndexSet alloc] init];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[children_ release], children_ = nil;
+	[entries_ release], entries_ = nil;
+
+	[super dealloc];
+}
+
+- (DelivererIndexNode *)childForLabel:(NSString *)label create:(BOOL)create
+{
+	DelivererIndexNode * child = [children_ objectForKey:label];
+	if (child == nil && create) {
+		child = [[[DelivererIndexNode alloc] init] autorelease];
+		[children_ setObject:child forKey:label];
+	}
+	return child;
+}
+
+- (void)addEntryAtIndex:(NSUInteger)index
+{
+	[entries_ addIndex:index];
+}
+@end
+
+#pragma mark -
+@interface DelivererIndex ()
+- (DelivererElementKind)kindsOfElement:(NSDictionary *)clickedElement;
+@end
+
+@implementation DelivererIndex
+
+- (id)init
+{
+	if ((self = [super init]) != nil) {
+		entries_ = [[NSMutableArray alloc] init];
+		root_ = [[DelivererIndexNode alloc] init];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[entries_ release], entries_ = nil;
+	[root_ release], root_ = nil;
+
+	[super dealloc];
+}
+
+- (void)addClass:(Class)delivererClass hostSuffixes:(NSArray *)hostSuffixes kinds:(DelivererElementKind)kinds
+{
+	NSUInteger const index = [entries_ count];
+	DelivererIndexEntry * entry = [[DelivererIndexEntry alloc] initWithClass:delivererClass kinds:kinds];
+	[entries_ addObject:entry];
+	[entry release];
+
+	if (hostSuffixes == nil) {
+		// ホストを問わないものは根に置く. 根はどのホストでも必ず通る
+		[root_ addEntryAtIndex:index];
+		return;
+	}
+
+	for (NSString * suffix in hostSuffixes) {
+		DelivererIndexNode * node = root_;
+		NSArray * labels = [[suffix lowercaseString] componentsSeparatedByString:@"."];
+		for (NSString * label in [labels reverseObjectEnumerator]) {
+			if ([label length] == 0) continue;
+			node = [node childForLabel:label create:YES];
+		}
+		[node addEntryAtIndex:index];
+	}
+}
+
+- (NSArray *)allClasses
+{
+	NSMutableArray * classes = [NSMutableArray arrayWithCapacity:[entries_ count]];
+	for (DelivererIndexEntry * entry in entries_) {
+		[classes addObject:entry.delivererClass];
+	}
+	return classes;
+}
+
+- (NSArray *)candidatesForDocument:(DOMHTMLDocument *)document element:(NSDictionary *)clickedElement
+{
+	// ホスト名をたどって、通った節に登録されたエントリを集める
+	NSMutableIndexSet * matched = [[[root_ entries] mutableCopy] autorelease];
+	NSString * host = [[[DelivererBase URLOfDocument:document] host] lowercaseString];
+	if (host != nil) {
+		DelivererIndexNode * node = root_;
+		NSArray * labels = [host componentsSeparatedByString:@"."];
+		for (NSString * label in [labels reverseObjectEnumerator]) {
+			node = [node childForLabel:label create:NO];
+			if (node == nil) break;
+			[matched addIndexes:[node entries]];
+		}
+	}
+
+	DelivererElementKind const kinds = [self kindsOfElement:clickedElement];
+	NSMutableArray * candidates = [NSMutableArray arrayWithCapacity:[matched count]];
+	for (NSUInteger i = [matched firstIndex]; i != NSNotFound; i = [matched indexGreaterThanIndex:i]) {
+		DelivererIndexEntry * entry = [entries_ objectAtIndex:i];
+		if ((entry.kinds & kinds) == entry.kinds) {
+			[candidates addObject:entry.delivererClass];
+		}
+	}
+	D(@"host:%@ kinds:0x%x candidates:%u/%u", host, kinds, [candidates count], [entries_ count]);
+	return candidates;
+}
+
+#pragma mark -
+#pragma mark Private Methods
+
+- (DelivererElementKind)kindsOfElement:(NSDictionary *)clickedElement
+{
+	DelivererElementKind kinds = DelivererElementAny;
+
+	if ([clickedElement objectForKey:WebElementImageURLKey] != nil || [clickedElement objectForKey:WebElementImageKey] != nil) {
+		kinds |= DelivererElementImage;
+	}
+	if ([clickedElement objectForKey:WebElementDOMNodeKey] != nil) {
+		kinds |= DelivererElementNode;
+	}
+
+	id selected = [clickedElement objectForKey:WebElementIsSelectedKey];
+	if (selected != nil && CFBooleanGetValue((CFBooleanRef)selected)) {
+		kinds |= DelivererElementSelection;
+	}
+	else {
+		kinds |= DelivererElementNoSelection;
+	}
+	return kinds;
+}
+@end
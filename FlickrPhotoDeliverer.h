@@ -6,5 +6,20 @@
  */
 #import "PhotoDeliverer.h"
 
+/**
+ * Flickr の写真を、photos.getInfo から作った caption 付きでポストする
+ *	getInfo は非同期に引き、main thread を止めない. 期限(UserSettings の "flickrCaptionDeadline" 秒,
+ *	無ければ 3秒)までに caption ができなければ、PhotoDeliverer と同じ caption でポストする.
+ *	期限に 0 を指定すると、caption ができるまで(UI は止めずに)待つ.
+ *	getInfo の応答は MetadataCache に覚えておく.
+ */
 @interface FlickrPhotoDeliverer : PhotoDeliverer
+{
+	NSString * photoID_;
+	id task_;						///< HTTPSession のタスク
+	NSURLResponse * response_;
+	NSMutableData * responseData_;
+	NSDate * startDate_;
+	BOOL lookingUp_;
+}
 @end
@@ -7,15 +7,34 @@
 #import "FlickrPhotoDeliverer.h"
 #import "DelivererRules.h"
 #import "Anchor.h"
+#import "HTTPSession.h"
+#import "MetadataCache.h"
+#import "XMLPathScanner.h"
+#import "UserSettings.h"
 #import "DebugLog.h"
 
 #define TIMEOUT	(30)
+#define DEFAULT_CAPTION_DEADLINE	(3.0)
+
+/// MetadataCache でのサービス名
+static NSString * CACHE_SERVICE = @"flickr";
+
+/// getInfo の応答から拾う値
+static NSString * PATH_URL = @"//photo/urls/url";
+static NSString * PATH_TITLE = @"//photo/title";
+static NSString * PATH_DESCRIPTION = @"//photo/description";
+static NSString * PATH_USERNAME = @"//photo/owner@username";
 
 #pragma mark -
 @interface FlickrPhotoDeliverer ()
 - (NSString *)photoIDWithURL:(NSURL *)URL;
-- (NSXMLDocument *)photoInfoXMLWithPhotoID:(NSString *)photoID;
-- (NSString *)captionWithXML:(NSXMLDocument *)xmlDoc withPhotoID:(NSString *)photoID;
+- (NSTimeInterval)captionDeadline;
+- (void)startLookupWithPhotoID:(NSString *)photoID;
+- (void)lookupDeadlineExpired;
+- (void)parseInfoData:(NSData *)data;
+- (void)didParseInfoValues:(id)result;
+- (void)finishLookupWithCaption:(NSString *)caption;
+- (NSString *)captionWithValues:(NSDictionary *)values withPhotoID:(NSString *)photoID;
 - (void)failedWith:(NSString *)photoID message:(NSString *)message;
 - (void)failedWith:(NSString *)photoID error:(NSError *)error;
 - (void)failedWith:(NSString *)photoID exception:(NSException *)exception;
@@ -33,7 +52,7 @@
 	}
 
 	// check URL's host
-	NSURL * url = [NSURL URLWithString:[[document URL] stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+	NSURL * url = [DelivererBase URLOfDocument:document];
 	if (![[url host] hasSuffix:@"flickr.com"]) {
 		return nil;
 	}
@@ -60,37 +79,40 @@
 	return [NSString stringWithFormat:@"%@ - Flickr", [super titleForMenuItem]];
 }
 
-- (NSDictionary *)photoContents
+- (void)dealloc
 {
-	// 画像の URL
-	NSURL * sourceURL = [clickedElement_ objectForKey:WebElementImageURLKey];
-	NSString * source = [sourceURL absoluteString];
+	[photoID_ release], photoID_ = nil;
+	[task_ release], task_ = nil;
+	[response_ release], response_ = nil;
+	[responseData_ release], responseData_ = nil;
+	[startDate_ release], startDate_ = nil;
 
-	// Flickr Photo ID を得る
-	NSString * photoID = [self photoIDWithURL:sourceURL];
-	if (photoID == nil) {
-		// エラーメッセージは photoIDWithURL メソッド内部で出力しているのでここでは不要
-		return nil;
-	}
+	[super dealloc];
+}
 
-	// caption を作る
-	NSString * caption = [self captionWithXML:[self photoInfoXMLWithPhotoID:photoID] withPhotoID:photoID];
-	if (caption == nil) {
-		/*
-		 * ここでの nil リターンは Flickr から画像のメタ情報が取り出せなかった事
-		 * を意味する。よってSuperの Photoと同じ形式で caption を作る。
-		 * エラーメッセージは photoInfoXMLWithPhotoID メソッド内部で出力しているのでここでは
-		 * 不要。
-		 */
-		 caption = context_.anchorToDocument;
+- (void)action:(id)sender
+{
+#pragma unused (sender)
+	@try {
+		if (lookingUp_) {
+			D(@"already looking up: %@", photoID_);
+			return;
+		}
+
+		// Flickr Photo ID を得る
+		NSString * photoID = [self photoIDWithURL:[clickedElement_ objectForKey:WebElementImageURLKey]];
+		if (photoID == nil) {
+			// エラーメッセージは photoIDWithURL メソッド内部で出力しているのでここでは不要
+			return;
+		}
+
+		// caption は getInfo の応答を待ってから作る. ポストは finishLookupWithCaption: で行う
+		[self startLookupWithPhotoID:photoID];
 	}
-	NSString * selection = [self selectedStringWithBlockquote];
-	if (selection != nil && [selection length] > 0) {
-		caption = [caption stringByAppendingFormat:@"\r%@", selection];
+	@catch (NSException * e) {
+		D0([e description]);
+		[self failedWithException:e];
 	}
-	D(@"caption: %@", caption);
-
-	return [NSDictionary dictionaryWithObjectsAndKeys:source, @"source", caption, @"caption", context_.documentURL, @"throughURL", nil];
 }
 
 - (NSString *)photoIDWithURL:(NSURL *)URL
@@ -138,7 +160,23 @@
 	return nil;
 }
 
-- (NSXMLDocument *)photoInfoXMLWithPhotoID:(NSString *)photoID
+/**
+ * caption を待つ期限(秒). 0 なら期限なし
+ */
+- (NSTimeInterval)captionDeadline
+{
+	NSString * deadline = [[UserSettings sharedInstance] stringForKey:@"flickrCaptionDeadline"];
+	if (deadline == nil || [deadline length] < 1) {
+		return DEFAULT_CAPTION_DEADLINE;
+	}
+	return MAX([deadline doubleValue], 0.0);
+}
+
+/**
+ * photos.getInfo を非同期に引き始める
+ *	@param[in] photoID	Flickr Photo ID
+ */
+- (void)startLookupWithPhotoID:(NSString *)photoID
 {
 	static NSString * FLICKR_API_URL_GET_INFO = @"http://api.flickr.com/services/rest/?method=flickr.photos.getInfo";
 	static NSString * FLICKR_APY_KEY = @"e67c6978a3f4c079f5cd61ac3e9111ae";
@@ -146,72 +184,225 @@
 	NSString * apiURL = [NSString stringWithFormat:@"%@&api_key=%@&photo_id=%@", FLICKR_API_URL_GET_INFO, FLICKR_APY_KEY, photoID];
 	D(@"getInfoURI=%@", apiURL);
 
-	NSURLRequest * request = [NSURLRequest requestWithURL:[NSURL URLWithString:apiURL] cachePolicy:NSURLRequestUseProtocolCachePolicy timeoutInterval:TIMEOUT];
-	NSURLResponse * response = nil;
-	NSError * error = nil;
-	NSData * data = [NSURLConnection sendSynchronousRequest:request returningResponse:&response error:&error];
-	if (data == nil || [data length] < 1) {
-		[self failedWith:photoID error:error];
-		return nil;
+	[self retain];	// finishLookupWithCaption: まで生かしておく
+	lookingUp_ = YES;
+	[photoID_ release], photoID_ = [photoID retain];
+	[startDate_ release], startDate_ = [[NSDate alloc] init];
+	[responseData_ release], responseData_ = [[NSMutableData alloc] init];
+
+	// 前に引いたものが期限内なら通信しない
+	MetadataCache * cache = [MetadataCache sharedCache];
+	NSData * cached = [cache dataForService:CACHE_SERVICE identifier:photoID];
+	if (cached != nil) {
+		[NSThread detachNewThreadSelector:@selector(parseInfoData:) toTarget:self withObject:cached];
+		return;
 	}
 
-	error = nil;
-	NSXMLDocument * xmlDoc = [[NSXMLDocument alloc] initWithData:data options:NSXMLDocumentTidyXML error:&error];
-	if (xmlDoc == nil) {
-		[self failedWith:photoID error:error];
+	NSURLRequest * request = [cache requestWithURL:[NSURL URLWithString:apiURL] timeoutInterval:TIMEOUT service:CACHE_SERVICE identifier:photoID];
+	task_ = [[[HTTPSession sharedSession] startRequest:request delegate:self] retain];
+	if (task_ == nil) {
+		[self failedWith:photoID message:@"Could not create getInfo request."];
+		[self finishLookupWithCaption:nil];
+		return;
+	}
+
+	NSTimeInterval const deadline = [self captionDeadline];
+	if (deadline > 0.0) {
+		[self performSelector:@selector(lookupDeadlineExpired) withObject:nil afterDelay:deadline];
 	}
-	return xmlDoc;
 }
 
-- (NSString *)captionWithXML:(NSXMLDocument *)xmlDoc withPhotoID:(NSString*)photoID
+/**
+ * 期限までに caption ができなかったので、いつもの caption でポストする
+ */
+- (void)lookupDeadlineExpired
 {
-	NSMutableString * caption = [NSMutableString string];
+	D(@"getInfo deadline expired: %@", photoID_);
+	[self finishLookupWithCaption:nil];
+}
+
+#pragma mark -
+#pragma mark NSURLConnection delegate
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+#pragma unused (connection)
+	[response_ release], response_ = [response retain];
+	[responseData_ setLength:0];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+#pragma unused (connection)
+	[responseData_ appendData:data];
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection
+{
+#pragma unused (connection)
+	[task_ release], task_ = nil;
+
+	// 304 ならば覚えていたものが返る
+	NSData * data = [[MetadataCache sharedCache] dataWithResponse:response_ data:responseData_ service:CACHE_SERVICE identifier:photoID_];
+	if ([data length] < 1) {
+		[self failedWith:photoID_ message:@"Empty response from getInfo."];
+		[self finishLookupWithCaption:nil];
+		return;
+	}
+
+	// XMLPathScanner で読む. キャッシュから読む時と同じく main thread の外で行い、結果は main thread に戻す
+	[NSThread detachNewThreadSelector:@selector(parseInfoData:) toTarget:self withObject:[[data copy] autorelease]];
+}
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+#pragma unused (connection)
+	[task_ release], task_ = nil;
 
+	[self failedWith:photoID_ error:error];
+	[self finishLookupWithCaption:nil];
+}
+
+#pragma mark -
+
+/**
+ * getInfo の応答から caption に使う値を拾う(別スレッドで動く)
+ *	結果は値の辞書, NSError または NSException のいずれかとして main thread に渡す
+ *	@param[in] data	応答の本体
+ */
+- (void)parseInfoData:(NSData *)data
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+
+	id result = nil;
 	@try {
+		D_ELAPSE_BEGIN(flickrGetInfoScan);
 		NSError * error = nil;
-		NSArray * nodes = [xmlDoc nodesForXPath:@"//photo/urls/url" error:&error];
-		if (nodes == nil || [nodes count] < 1) {
-			[self failedWith:photoID error:error];
+		NSArray * paths = [NSArray arrayWithObjects:PATH_URL, PATH_TITLE, PATH_DESCRIPTION, PATH_USERNAME, nil];
+		NSDictionary * values = [XMLPathScanner valuesForPaths:paths inData:data error:&error];
+		result = (values != nil) ? (id)values : (id)error;
+		D_ELAPSE_END(flickrGetInfoScan);
+	}
+	@catch (NSException * e) {
+		result = e;
+	}
+	[self performSelectorOnMainThread:@selector(didParseInfoValues:) withObject:result waitUntilDone:NO];
+
+	[pool release];
+}
+
+/**
+ * 解析が終わった(main thread)
+ *	@param[in] result	parseInfoData: の結果
+ */
+- (void)didParseInfoValues:(id)result
+{
+	if (!lookingUp_) {
+		return;	// 期限切れでポスト済み
+	}
+
+	NSString * caption = nil;
+	if ([result isKindOfClass:[NSDictionary class]]) {
+		caption = [self captionWithValues:(NSDictionary *)result withPhotoID:photoID_];
+		if (caption == nil) {
+			// エラーの応答(stat="fail" など)は覚えておかない
+			[[MetadataCache sharedCache] removeDataForService:CACHE_SERVICE identifier:photoID_];
+		}
+	}
+	else if ([result isKindOfClass:[NSException class]]) {
+		[self failedWith:photoID_ exception:(NSException *)result];
+	}
+	else {
+		[self failedWith:photoID_ error:(NSError *)result];
+	}
+	[self finishLookupWithCaption:caption];
+}
+
+/**
+ * caption を決めてポストする. 2回目以降の呼び出しは無視する
+ *	@param[in] caption	getInfo から作った caption. nil ならば PhotoDeliverer と同じ caption を使う
+ */
+- (void)finishLookupWithCaption:(NSString *)caption
+{
+	if (!lookingUp_) {
+		return;
+	}
+	lookingUp_ = NO;
+
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(lookupDeadlineExpired) object:nil];
+	if (task_ != nil) {
+		[[HTTPSession sharedSession] cancelTask:task_];
+		[task_ release], task_ = nil;
+	}
+	Log(@"Flickr getInfo %@ in %.3fs - PhotoID:%@", (caption != nil ? @"done" : @"fallback"), -[startDate_ timeIntervalSinceNow], photoID_);
+
+	@try {
+		// caption が無ければ Super の Photo と同じ形式のもの(セレクション込み)を使う
+		NSDictionary * contents = [self photoContents];
+		if (caption == nil) {
+			caption = [contents objectForKey:@"caption"];
+		}
+		else {
+			NSString * selection = [self selectedStringWithBlockquote];
+			if (selection != nil && [selection length] > 0) {
+				caption = [caption stringByAppendingFormat:@"\r%@", selection];
+			}
+		}
+		D(@"caption: %@", caption);
+
+		[super postPhoto:[contents objectForKey:@"source"]
+				 caption:caption
+				 through:[contents objectForKey:@"throughURL"]
+				   image:[clickedElement_ objectForKey:WebElementImageKey]];
+	}
+	@catch (NSException * e) {
+		D0([e description]);
+		[self failedWithException:e];
+	}
+
+	[photoID_ release], photoID_ = nil;
+	[response_ release], response_ = nil;
+	[responseData_ release], responseData_ = nil;
+	[startDate_ release], startDate_ = nil;
+	[self autorelease];	// startLookupWithPhotoID: の retain と対
+}
+
+- (NSString *)captionWithValues:(NSDictionary *)values withPhotoID:(NSString*)photoID
+{
+	NSMutableString * caption = [NSMutableString string];
+
+	@try {
+		NSString * s = [values objectForKey:PATH_URL];
+		if (s == nil) {
+			[self failedWith:photoID message:@"No //photo/urls/url in getInfo response."];
 			return nil;
 		}
 
 		// urlsの先頭の URL を得る
-		NSURL * url = [NSURL URLWithString:[[nodes objectAtIndex:0] objectValue]];
+		NSURL * url = [NSURL URLWithString:s];
 		if (url == nil) {
 			[self failedWith:photoID message:@"Invalid URL from //photo/urls/url."];
 			return nil;
 		}
 
 		// aタグを作り caption に追加
-		NSString * s = nil;
-		nodes = [xmlDoc nodesForXPath:@"//photo/title" error:nil];
-		if ([nodes count] > 0) {
-			s = [Anchor htmlWithURL:[url absoluteString] title:[[nodes objectAtIndex:0] stringValue]];
-			[caption appendString:s];
+		s = [values objectForKey:PATH_TITLE];
+		if (s != nil) {
+			[caption appendString:[Anchor htmlWithURL:[url absoluteString] title:s]];
 		}
 
 		// description があれば blockquote して caption に追加
-		nodes = [xmlDoc nodesForXPath:@"//photo/description" error:nil];
-		if ([nodes count] > 0) {
-			s = [[nodes objectAtIndex:0] stringValue];
-			if (s != nil && [s length] > 0) {
-				[caption appendFormat:@"<blockquote>%@</blockquote>", s];
-			}
+		s = [values objectForKey:PATH_DESCRIPTION];
+		if (s != nil && [s length] > 0) {
+			[caption appendFormat:@"<blockquote>%@</blockquote>", s];
 		}
 
 		// username があれば(あるはず) ユーザーページへの aタグを作って caption に追加
-		nodes = [xmlDoc nodesForXPath:@"//photo/owner" error:nil];
-		if ([nodes count] > 0) {
-			NSXMLNode * node = [[nodes objectAtIndex:0] attributeForName:@"username"];
-			if (node != nil) {
-				NSString * username = [node stringValue];
-				if (username != nil) {
-					D(@"anchor=%@", [[url path] stringByDeletingLastPathComponent]);
-					NSString * userURL = [NSString stringWithFormat:@"%@://%@%@", [url scheme], [url host], [[url path] stringByDeletingLastPathComponent]];
-					s = [Anchor htmlWithURL:userURL title:username];
-					[caption appendFormat:@" (via %@)", s];
-				}
-			}
+		NSString * username = [values objectForKey:PATH_USERNAME];
+		if (username != nil) {
+			D(@"anchor=%@", [[url path] stringByDeletingLastPathComponent]);
+			NSString * userURL = [NSString stringWithFormat:@"%@://%@%@", [url scheme], [url host], [[url path] stringByDeletingLastPathComponent]];
+			[caption appendFormat:@" (via %@)", [Anchor htmlWithURL:userURL title:username]];
 		}
 	}
 	@catch (NSException * e) {
@@ -0,0 +1,27 @@
+/**
+ * @file FormEncoder.h
+ * @brief FormEncoder class declaration
+ */
+#import <Foundation/Foundation.h>
+
+/**
+ * application/x-www-form-urlencoded のエンコーダ
+ *	key と value を UTF-8 で URLエンコードしながら1つの NSMutableData に直接書き込む.
+ *	key は昇順に並べるので、同じパラメータからは常に同じバイト列ができる.
+ */
+@interface FormEncoder : NSObject
+
+/**
+ * パラメータをエンコードする
+ *	@param[in] params	パラメータ. value は NSString, NSURL(absoluteString) またはそれ以外(description)
+ *	@return "key=value&key=value" のバイト列
+ */
++ (NSData *)dataWithParams:(NSDictionary *)params;
+
+/**
+ * パラメータをエンコードして文字列で返す(URLのクエリ用)
+ *	@param[in] params	パラメータ
+ *	@return "key=value&key=value" の文字列
+ */
++ (NSString *)stringWithParams:(NSDictionary *)params;
+@end
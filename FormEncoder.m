@@ -0,0 +1,57 @@
+/**
+ * @file FormEncoder.m
+ * @brief FormEncoder class implementation
+ */
+#import "FormEncoder.h"
+#import "NSString+Tumblrful.h"
+
+@implementation FormEncoder
+
++ (NSData *)dataWithParams:(NSDictionary *)params
+{
+	NSArray * keys = [[params allKeys] sortedArrayUsingSelector:@selector(compare:)];
+	NSUInteger const count = [keys count];
+	if (count == 0) return [NSData data];
+
+	// key と value の UTF-8 表現. 最初にまとめて変換して、エンコード後の長さを確定させる
+	// UTF8String + strlen だと途中の NUL で切れてしまうので NSData で長さごと持つ
+	NSMutableArray * strings = [NSMutableArray arrayWithCapacity:count * 2];
+	NSUInteger total = count - 1;	// '&' の分
+	for (NSUInteger i = 0; i < count; ++i) {
+		NSString * key = [keys objectAtIndex:i];
+		id any = [params objectForKey:key];
+		NSString * value;
+		if ([any isKindOfClass:[NSString class]])		value = any;
+		else if ([any isKindOfClass:[NSURL class]])		value = [(NSURL *)any absoluteString];
+		else											value = [any description];
+
+		NSData * keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+		NSData * valueData = [value dataUsingEncoding:NSUTF8StringEncoding];
+		if (keyData == nil || valueData == nil) return nil;
+		[strings addObject:keyData];
+		[strings addObject:valueData];
+		total += URLEncodedLength((const unsigned char *)[keyData bytes], [keyData length]);
+		total += URLEncodedLength((const unsigned char *)[valueData bytes], [valueData length]);
+		total += 1;	// '=' の分
+	}
+
+	NSMutableData * data = [NSMutableData dataWithLength:total];
+	char * dst = (char *)[data mutableBytes];
+	for (NSUInteger i = 0; i < count; ++i) {
+		NSData * keyData = [strings objectAtIndex:i * 2];
+		NSData * valueData = [strings objectAtIndex:i * 2 + 1];
+		if (i > 0) *dst++ = '&';
+		dst += URLEncodeBytes((const unsigned char *)[keyData bytes], [keyData length], dst);
+		*dst++ = '=';
+		dst += URLEncodeBytes((const unsigned char *)[valueData bytes], [valueData length], dst);
+	}
+	return data;
+}
+
++ (NSString *)stringWithParams:(NSDictionary *)params
+{
+	NSData * data = [self dataWithParams:params];
+	if (data == nil) return nil;
+	return [[[NSString alloc] initWithData:data encoding:NSASCIIStringEncoding] autorelease];
+}
+@end
@@ -10,4 +10,7 @@
 
 + (void)notifyWithTitle:(NSString *)title description:(NSString *)description;
 
+/// 同じ identifier の通知は Growl 上で1つにまとめられる(進捗の更新用)
++ (void)notifyWithTitle:(NSString *)title description:(NSString *)description identifier:(NSString *)identifier;
+
 @end
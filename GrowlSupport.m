@@ -13,6 +13,13 @@ static NSString* NOTIFY_NAME = @"NotifyPostToTumblr";
 	[GrowlApplicationBridge notifyWithTitle:title description:description notificationName:NOTIFY_NAME iconData:nil priority:0 isSticky:NO clickContext:nil];
 }
 
++ (void)notifyWithTitle:(NSString *)title description:(NSString *)description identifier:(NSString *)identifier
+{
+	[GrowlSupport sharedInstance];
+
+	[GrowlApplicationBridge notifyWithTitle:title description:description notificationName:NOTIFY_NAME iconData:nil priority:0 isSticky:NO clickContext:nil identifier:identifier];
+}
+
 + (GrowlSupport *)sharedInstance
 {
 	static GrowlSupport * instance = nil;
@@ -0,0 +1,17 @@
+/**
+ * @file HTMLEntities.h
+ * @brief HTML5 named character reference lookup
+ */
+
+/// エンティティ名の最大長('&' と ';' を除く)
+#define HTML_ENTITY_NAME_MAX	31
+
+/**
+ * 名前付き文字参照を引く
+ *	完全ハッシュで一発で位置を決めて、名前を照合するだけ.
+ *	@param[in] name	'&' と ';' を除いたエンティティ名
+ *	@param[in] length	name の長さ
+ *	@param[out] out	展開後の文字(最大2文字)
+ *	@return out に書き込んだ文字数. 未知の名前なら 0
+ */
+NSUInteger HTMLEntityLookup(const unichar * name, NSUInteger length, unichar out[2]);
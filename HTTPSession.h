@@ -0,0 +1,41 @@
+/**
+ * @file HTTPSession.h
+ * @brief HTTPSession class declaration
+ */
+#import <Foundation/Foundation.h>
+
+/**
+ * ポスト用の HTTP リクエストをホストごとに束ねる
+ *	同じホストへ同時に流すリクエストを maxConnectionsPerHost 本までに抑え、溢れた分は順に待たせる.
+ *	ソケットは NSURLConnection(CFNetwork) が持つ持続接続がそのまま使われるので、
+ *	連続したポストや複数サービスへの同時ポストでも、開いたままの接続に後続のリクエストが乗る.
+ *
+ *	デリゲートには NSURLConnection のデリゲートメソッドがそのまま届く.
+ *	NSURLConnection と同じく、終わるまでデリゲートを保持する.
+ */
+@interface HTTPSession : NSObject
+{
+	NSMutableDictionary * active_;	///< host -> 送信中の数(NSNumber)
+	NSMutableDictionary * waiting_;	///< host -> 待っているタスクの配列
+	NSUInteger maxConnectionsPerHost_;
+}
+
+/// ホストごとの同時接続数の上限. 初期値は UserSettings の "httpMaxConnectionsPerHost"(無ければ 2)
+@property (nonatomic, assign) NSUInteger maxConnectionsPerHost;
+
++ (HTTPSession *)sharedSession;
+
+/**
+ * リクエストを送る. 上限に達していれば空くまで待ってから送る
+ *	@param[in] request	リクエスト
+ *	@param[in] delegate	NSURLConnection のデリゲート
+ *	@return タスク(cancelTask: に渡す). request が nil なら nil
+ */
+- (id)startRequest:(NSURLRequest *)request delegate:(id)delegate;
+
+/**
+ * 送信をやめる. デリゲートには何も届かない
+ *	@param[in] task	startRequest:delegate: が返したもの
+ */
+- (void)cancelTask:(id)task;
+@end
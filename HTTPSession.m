@@ -0,0 +1,283 @@
+/**
+ * @file HTTPSession.m
+ * @brief HTTPSession class implementation
+ */
+#import "HTTPSession.h"
+#import "UserSettings.h"
+#import "DebugLog.h"
+
+static NSUInteger DEFAULT_MAX_CONNECTIONS_PER_HOST = 2;
+
+@class HTTPSessionTask;
+
+@interface HTTPSession ()
++ (NSString *)hostKeyForURL:(NSURL *)url;
+- (void)enqueueTask:(HTTPSessionTask *)task;
+- (void)startWaitingTasksForHost:(NSString *)host;
+- (void)taskDidFinish:(HTTPSessionTask *)task;
+@end
+
+#pragma mark -
+/**
+ * リクエスト1つ分. NSURLConnection のデリゲートになり、呼び出しを本来のデリゲートへ渡す
+ */
+@interface HTTPSessionTask : NSObject
+{
+	HTTPSession * session_;	///< singleton なので assign
+	NSURLRequest * request_;
+	id delegate_;
+	NSString * host_;
+	NSURLConnection * connection_;
+	NSDate * queuedDate_;
+	BOOL started_;
+	BOOL finished_;
+}
+@property (nonatomic, readonly) NSString * host;
+@property (nonatomic, readonly) BOOL started;
+- (id)initWithSession:(HTTPSession *)session request:(NSURLRequest *)request delegate:(id)delegate host:(NSString *)host;
+- (void)start;
+- (void)cancel;
+@end
+
+@implementation HTTPSessionTask
+
+@synthesize host = host_;
+@synthesize started = started_;
+
+- (id)initWithSession:(HTTPSession *)session request:(NSURLRequest *)request delegate:(id)delegate host:(NSString *)host
+{
+	if ((self = [super init]) != nil) {
+		session_ = session;
+		request_ = [request retain];
+		delegate_ = [delegate retain];
+		host_ = [host copy];
+		queuedDate_ = [[NSDate alloc] init];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[request_ release], request_ = nil;
+	[delegate_ release], delegate_ = nil;
+	[host_ release], host_ = nil;
+	[connection_ release], connection_ = nil;
+	[queuedDate_ release], queuedDate_ = nil;
+	[super dealloc];
+}
+
+- (void)start
+{
+	D(@"%@ waited %.3f sec", host_, -[queuedDate_ timeIntervalSinceNow]);
+	started_ = YES;
+	connection_ = [[NSURLConnection alloc] initWithRequest:request_ delegate:self];
+	if (connection_ == nil) {
+		NSError * error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorUnknown userInfo:nil];
+		[self connection:nil didFailWithError:error];
+	}
+}
+
+- (void)cancel
+{
+	if (finished_) return;
+	finished_ = YES;
+	[connection_ cancel];
+	[[self retain] autorelease];
+	[session_ taskDidFinish:self];
+	[delegate_ release], delegate_ = nil;
+}
+
+/// 本来のデリゲートが実装していない任意のメソッドには応答しない. NSURLConnection の既定の動作に任せる
+- (BOOL)respondsToSelector:(SEL)selector
+{
+	if (selector == @selector(connection:didReceiveAuthenticationChallenge:)
+		|| selector == @selector(connection:canAuthenticateAgainstProtectionSpace:)
+		|| selector == @selector(connection:didCancelAuthenticationChallenge:)
+		|| selector == @selector(connection:willSendRequest:redirectResponse:)
+		|| selector == @selector(connection:needNewBodyStream:)
+		|| selector == @selector(connection:willCacheResponse:)
+		|| selector == @selector(connection:didSendBodyData:totalBytesWritten:totalBytesExpectedToWrite:)
+		|| selector == @selector(connectionShouldUseCredentialStorage:)) {
+		return [delegate_ respondsToSelector:selector];
+	}
+	return [super respondsToSelector:selector];
+}
+
+#pragma mark -
+#pragma mark NSURLConnection Delegate Methods
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+	if ([delegate_ respondsToSelector:_cmd]) [delegate_ connection:connection didReceiveResponse:response];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+	if ([delegate_ respondsToSelector:_cmd]) [delegate_ connection:connection didReceiveData:data];
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection
+{
+	if (finished_) return;
+	finished_ = YES;
+	[[self retain] autorelease];
+	[session_ taskDidFinish:self];
+	if ([delegate_ respondsToSelector:_cmd]) [delegate_ connectionDidFinishLoading:connection];
+	[delegate_ release], delegate_ = nil;
+}
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+	if (finished_) return;
+	finished_ = YES;
+	[[self retain] autorelease];
+	[session_ taskDidFinish:self];
+	if ([delegate_ respondsToSelector:_cmd]) [delegate_ connection:connection didFailWithError:error];
+	[delegate_ release], delegate_ = nil;
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge
+{
+	[delegate_ connection:connection didReceiveAuthenticationChallenge:challenge];
+}
+
+- (BOOL)connection:(NSURLConnection *)connection canAuthenticateAgainstProtectionSpace:(NSURLProtectionSpace *)protectionSpace
+{
+	return [delegate_ connection:connection canAuthenticateAgainstProtectionSpace:protectionSpace];
+}
+
+- (void)connection:(NSURLConnection *)connection didCancelAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge
+{
+	[delegate_ connection:connection didCancelAuthenticationChallenge:challenge];
+}
+
+- (NSURLRequest *)connection:(NSURLConnection *)connection willSendRequest:(NSURLRequest *)request redirectResponse:(NSURLResponse *)response
+{
+	return [delegate_ connection:connection willSendRequest:request redirectResponse:response];
+}
+
+- (NSInputStream *)connection:(NSURLConnection *)connection needNewBodyStream:(NSURLRequest *)request
+{
+	return [delegate_ connection:connection needNewBodyStream:request];
+}
+
+- (NSCachedURLResponse *)connection:(NSURLConnection *)connection willCacheResponse:(NSCachedURLResponse *)cachedResponse
+{
+	return [delegate_ connection:connection willCacheResponse:cachedResponse];
+}
+
+- (void)connection:(NSURLConnection *)connection didSendBodyData:(NSInteger)bytesWritten totalBytesWritten:(NSInteger)totalBytesWritten totalBytesExpectedToWrite:(NSInteger)totalBytesExpectedToWrite
+{
+	[delegate_ connection:connection didSendBodyData:bytesWritten totalBytesWritten:totalBytesWritten totalBytesExpectedToWrite:totalBytesExpectedToWrite];
+}
+
+- (BOOL)connectionShouldUseCredentialStorage:(NSURLConnection *)connection
+{
+	return [delegate_ connectionShouldUseCredentialStorage:connection];
+}
+@end
+
+#pragma mark -
+@implementation HTTPSession
+
+@synthesize maxConnectionsPerHost = maxConnectionsPerHost_;
+
++ (HTTPSession *)sharedSession
+{
+	static HTTPSession * instance = nil;
+	if (instance == nil) {
+		instance = [[HTTPSession alloc] init];
+	}
+	return instance;
+}
+
+/// scheme と host と port の組. 同じ組なら同じ持続接続を使える
++ (NSString *)hostKeyForURL:(NSURL *)url
+{
+	NSString * scheme = [[url scheme] lowercaseString];
+	NSNumber * port = [url port];
+	if (port == nil) port = [NSNumber numberWithInt:([scheme isEqualToString:@"https"] ? 443 : 80)];
+	return [NSString stringWithFormat:@"%@://%@:%@", scheme, [[url host] lowercaseString], port];
+}
+
+- (id)init
+{
+	if ((self = [super init]) != nil) {
+		active_ = [[NSMutableDictionary alloc] init];
+		waiting_ = [[NSMutableDictionary alloc] init];
+
+		NSInteger const max = [[[UserSettings sharedInstance] stringForKey:@"httpMaxConnectionsPerHost"] integerValue];
+		maxConnectionsPerHost_ = max > 0 ? (NSUInteger)max : DEFAULT_MAX_CONNECTIONS_PER_HOST;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[active_ release], active_ = nil;
+	[waiting_ release], waiting_ = nil;
+	[super dealloc];
+}
+
+- (id)startRequest:(NSURLRequest *)request delegate:(id)delegate
+{
+	if (request == nil) return nil;
+
+	NSString * host = [HTTPSession hostKeyForURL:[request URL]];
+	HTTPSessionTask * task = [[[HTTPSessionTask alloc] initWithSession:self request:request delegate:delegate host:host] autorelease];
+	[self enqueueTask:task];
+	return task;
+}
+
+- (void)cancelTask:(id)task
+{
+	if (![task isKindOfClass:[HTTPSessionTask class]]) return;
+
+	HTTPSessionTask * sessionTask = (HTTPSessionTask *)task;
+	if (![sessionTask started]) {
+		[[sessionTask retain] autorelease];
+		[[waiting_ objectForKey:[sessionTask host]] removeObject:sessionTask];
+	}
+	[sessionTask cancel];
+}
+
+#pragma mark -
+#pragma mark Private Methods
+
+- (void)enqueueTask:(HTTPSessionTask *)task
+{
+	NSMutableArray * waiting = [waiting_ objectForKey:[task host]];
+	if (waiting == nil) {
+		waiting = [NSMutableArray array];
+		[waiting_ setObject:waiting forKey:[task host]];
+	}
+	[waiting addObject:task];
+	[self startWaitingTasksForHost:[task host]];
+}
+
+- (void)startWaitingTasksForHost:(NSString *)host
+{
+	NSMutableArray * waiting = [[[waiting_ objectForKey:host] retain] autorelease];
+	NSUInteger active = [[active_ objectForKey:host] unsignedIntegerValue];
+	while (active < maxConnectionsPerHost_ && [waiting count] > 0) {
+		HTTPSessionTask * task = [[[waiting objectAtIndex:0] retain] autorelease];
+		[waiting removeObjectAtIndex:0];
+		[active_ setObject:[NSNumber numberWithUnsignedInteger:++active] forKey:host];
+		[task start];	// 失敗すると taskDidFinish: が呼ばれて active_ が戻る
+		active = [[active_ objectForKey:host] unsignedIntegerValue];
+	}
+	if ([waiting count] == 0) [waiting_ removeObjectForKey:host];
+}
+
+- (void)taskDidFinish:(HTTPSessionTask *)task
+{
+	if (![task started]) return;	// 待っている間に cancel された
+
+	NSString * host = [task host];
+	NSUInteger const active = [[active_ objectForKey:host] unsignedIntegerValue];
+	if (active <= 1) [active_ removeObjectForKey:host];
+	else [active_ setObject:[NSNumber numberWithUnsignedInteger:active - 1] forKey:host];
+
+	[self startWaitingTasksForHost:host];
+}
+@end
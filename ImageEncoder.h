@@ -0,0 +1,51 @@
+/**
+ * @file ImageEncoder.h
+ * @brief ImageEncoder class declaration
+ */
+#import <Cocoa/Cocoa.h>
+
+/**
+ * Photo ポスト用の画像エンコーダ
+ *	画像の内容を見て PNG か JPEG かを選び、品質と最大辺長のポリシーを適用する.
+ *	ポリシーは UserSettings の "photoJPEGQuality"(0.0〜1.0. 既定は 1.0) と
+ *	"photoMaxDimension"(ピクセル. 0 なら縮小しない) で設定する.
+ */
+@interface ImageEncoder : NSObject
+{
+	float quality_;
+	NSUInteger maxDimension_;
+}
+
+/// JPEG の圧縮品質
+@property (nonatomic, assign) float quality;
+
+/// 長辺の最大ピクセル数. 0 なら縮小しない
+@property (nonatomic, assign) NSUInteger maxDimension;
+
+/**
+ * UserSettings のポリシーでエンコーダを作る. メインスレッドで呼ぶこと
+ *	@return ImageEncoder object
+ */
++ (ImageEncoder *)encoderWithUserSettings;
+
+/**
+ * NSImage からビットマップを取り出す. TIFF を経由しない. メインスレッドで呼ぶこと
+ *	@param[in] image	画像
+ *	@return NSBitmapImageRep object
+ */
++ (NSBitmapImageRep *)bitmapImageRepForImage:(NSImage *)image;
+
+/**
+ * エンコード済みデータの MIME タイプを返す
+ *	@param[in] data	画像データ
+ *	@return "image/png" か "image/jpeg"
+ */
++ (NSString *)contentTypeForData:(NSData *)data;
+
+/**
+ * ビットマップをエンコードする. どのスレッドから呼んでもよい
+ *	@param[in] imageRep	ビットマップ
+ *	@return エンコードしたデータ
+ */
+- (NSData *)encodeBitmapImageRep:(NSBitmapImageRep *)imageRep;
+@end
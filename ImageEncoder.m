@@ -0,0 +1,195 @@
+/**
+ * @file ImageEncoder.m
+ * @brief ImageEncoder class implementation
+ */
+#import "ImageEncoder.h"
+#import "UserSettings.h"
+#import "DebugLog.h"
+
+/// 以前と同じ最高品質. 下げるかどうかは "photoJPEGQuality" で決める
+static float DEFAULT_QUALITY = 1.0f;
+
+/// 色数を数える時のサンプル数(一辺)
+#define SAMPLE_GRID		64
+/// 色数を数えるハッシュ表のサイズ(2の冪)
+#define COLOR_TABLE_SIZE	8192
+
+@interface ImageEncoder ()
+- (NSBitmapImageRep *)scaledBitmapImageRep:(NSBitmapImageRep *)imageRep;
++ (BOOL)prefersPNG:(NSBitmapImageRep *)imageRep;
+@end
+
+@implementation ImageEncoder
+
+@synthesize quality = quality_;
+@synthesize maxDimension = maxDimension_;
+
++ (ImageEncoder *)encoderWithUserSettings
+{
+	ImageEncoder * encoder = [[[ImageEncoder alloc] init] autorelease];
+
+	UserSettings * settings = [UserSettings sharedInstance];
+	NSString * quality = [settings stringForKey:@"photoJPEGQuality"];
+	NSString * maxDimension = [settings stringForKey:@"photoMaxDimension"];
+	if (quality != nil) encoder.quality = MAX(0.0f, MIN(1.0f, [quality floatValue]));
+	if (maxDimension != nil) encoder.maxDimension = (NSUInteger)MAX(0, [maxDimension integerValue]);
+
+	return encoder;
+}
+
++ (NSBitmapImageRep *)bitmapImageRepForImage:(NSImage *)image
+{
+	NSEnumerator * enumerator = [[image representations] objectEnumerator];
+	for (NSImageRep * rep; (rep = [enumerator nextObject]) != nil; ) {
+		if ([rep isKindOfClass:[NSBitmapImageRep class]]) return (NSBitmapImageRep *)rep;
+	}
+
+	// ビットマップを持っていなければ CGImage に描画してもらう
+	CGImageRef cgImage = [image CGImageForProposedRect:NULL context:nil hints:nil];
+	if (cgImage == NULL) return nil;
+	return [[[NSBitmapImageRep alloc] initWithCGImage:cgImage] autorelease];
+}
+
++ (NSString *)contentTypeForData:(NSData *)data
+{
+	static const unsigned char PNG_SIGNATURE[] = { 0x89, 'P', 'N', 'G' };
+	if ([data length] >= sizeof(PNG_SIGNATURE) && memcmp([data bytes], PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) == 0) {
+		return @"image/png";
+	}
+	return @"image/jpeg";
+}
+
+- (id)init
+{
+	if ((self = [super init]) != nil) {
+		quality_ = DEFAULT_QUALITY;
+		maxDimension_ = 0;
+	}
+	return self;
+}
+
+- (NSData *)encodeBitmapImageRep:(NSBitmapImageRep *)imageRep
+{
+	if (imageRep == nil) return nil;
+
+	NSTimeInterval const start = [NSDate timeIntervalSinceReferenceDate];
+
+	NSBitmapImageRep * rep = [self scaledBitmapImageRep:imageRep];
+	BOOL const png = [ImageEncoder prefersPNG:rep];
+
+	NSData * data;
+	if (png) {
+		data = [rep representationUsingType:NSPNGFileType properties:nil];
+	}
+	else {
+		NSDictionary * properties = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithFloat:quality_], NSImageCompressionFactor, nil];
+		data = [rep representationUsingType:NSJPEGFileType properties:properties];
+	}
+
+	// 無圧縮のビットマップの大きさと並べて残しておく
+	unsigned long long const raw = (unsigned long long)[imageRep bytesPerRow] * (unsigned long long)[imageRep pixelsHigh];
+	unsigned long long const encoded = [data length];
+	Log(@"photo encoded: %@ %ldx%ld -> %ldx%ld, %llu bytes (raw bitmap %llu bytes), %.3f sec",
+		png ? @"PNG" : @"JPEG",
+		(long)[imageRep pixelsWide], (long)[imageRep pixelsHigh], (long)[rep pixelsWide], (long)[rep pixelsHigh],
+		encoded, raw,
+		[NSDate timeIntervalSinceReferenceDate] - start);
+#ifdef DEBUG
+	// 以前のエンコーダ(原寸のまま JPEG 品質 1.0)と比べてどれだけ減ったか. もう1度エンコードするのでデバッグ時だけ
+	NSDictionary * baselineProperties = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithFloat:1.0f], NSImageCompressionFactor, nil];
+	unsigned long long const baseline = [[imageRep representationUsingType:NSJPEGFileType properties:baselineProperties] length];
+	D(@"photo encoded: %lld bytes saved against JPEG q=1.0 (%llu bytes)", (long long)baseline - (long long)encoded, baseline);
+#endif
+
+	return data;
+}
+
+/**
+ * 長辺が maxDimension を超えていれば縮小する
+ */
+- (NSBitmapImageRep *)scaledBitmapImageRep:(NSBitmapImageRep *)imageRep
+{
+	NSInteger const width = [imageRep pixelsWide];
+	NSInteger const height = [imageRep pixelsHigh];
+	NSInteger const longer = MAX(width, height);
+	if (maxDimension_ == 0 || longer <= (NSInteger)maxDimension_) return imageRep;
+
+	CGFloat const scale = (CGFloat)maxDimension_ / (CGFloat)longer;
+	NSInteger const w = MAX(1, (NSInteger)(width * scale + 0.5));
+	NSInteger const h = MAX(1, (NSInteger)(height * scale + 0.5));
+
+	NSBitmapImageRep * scaled = [[[NSBitmapImageRep alloc]
+			initWithBitmapDataPlanes:NULL pixelsWide:w pixelsHigh:h
+			bitsPerSample:8 samplesPerPixel:4 hasAlpha:YES isPlanar:NO
+			colorSpaceName:NSCalibratedRGBColorSpace bytesPerRow:0 bitsPerPixel:0] autorelease];
+	if (scaled == nil) return imageRep;
+
+	// グラフィックスコンテキストはスレッドごとなので、バックグラウンドで描画してよい
+	NSGraphicsContext * context = [NSGraphicsContext graphicsContextWithBitmapImageRep:scaled];
+	[NSGraphicsContext saveGraphicsState];
+	[NSGraphicsContext setCurrentContext:context];
+	[context setImageInterpolation:NSImageInterpolationHigh];
+	[imageRep drawInRect:NSMakeRect(0, 0, w, h)];
+	[NSGraphicsContext restoreGraphicsState];
+
+	return scaled;
+}
+
+/**
+ * PNG にすべき画像かどうか
+ *	半透明のピクセルがあるか、色数が少ない(UI のスクリーンショットのような)画像なら PNG にする.
+ *	全ピクセルを見ると重いので格子状にサンプリングする.
+ */
++ (BOOL)prefersPNG:(NSBitmapImageRep *)imageRep
+{
+	NSInteger const width = [imageRep pixelsWide];
+	NSInteger const height = [imageRep pixelsHigh];
+	NSInteger const samples = [imageRep samplesPerPixel];
+	NSInteger const bits = [imageRep bitsPerSample];
+	BOOL const hasAlpha = [imageRep hasAlpha];
+	NSUInteger const alphaMax = bits >= 16 ? 0xFFFF : (1U << bits) - 1;
+	BOOL const alphaFirst = ([imageRep bitmapFormat] & NSAlphaFirstBitmapFormat) != 0;
+	if (width <= 0 || height <= 0 || samples > 5) return NO;
+
+	// getPixel:atX:y: は整数でサンプルを返すので、浮動小数点のビットマップでは判定できない. JPEG にしておく
+	if (([imageRep bitmapFormat] & NSFloatingPointSamplesBitmapFormat) != 0) return NO;
+
+	uint32_t * table = (uint32_t *)calloc(COLOR_TABLE_SIZE, sizeof(uint32_t));
+	if (table == NULL) return NO;
+
+	// 一辺 SAMPLE_GRID 点以下にするので、サンプル数はハッシュ表の半分に収まる
+	NSInteger const stepX = (width + SAMPLE_GRID - 1) / SAMPLE_GRID;
+	NSInteger const stepY = (height + SAMPLE_GRID - 1) / SAMPLE_GRID;
+	NSUInteger sampled = 0;
+	NSUInteger distinct = 0;
+	BOOL translucent = NO;
+
+	for (NSInteger y = 0; y < height && !translucent; y += stepY) {
+		for (NSInteger x = 0; x < width; x += stepX) {
+			NSUInteger pixel[5] = { 0, 0, 0, 0, 0 };
+			[imageRep getPixel:pixel atX:x y:y];
+			++sampled;
+
+			if (hasAlpha && pixel[alphaFirst ? 0 : samples - 1] < alphaMax) {
+				translucent = YES;
+				break;
+			}
+
+			// 色をまとめて1つの値にして、開番地法のハッシュ表で数える. 0 は空きの印なので 1 を足す
+			uint32_t color = 1;
+			for (NSInteger i = 0; i < samples; ++i) color = color * 31 + (uint32_t)pixel[i];
+			if (color == 0) color = 1;
+			uint32_t slot = (color * 2654435761U) & (COLOR_TABLE_SIZE - 1);
+			while (table[slot] != 0 && table[slot] != color) slot = (slot + 1) & (COLOR_TABLE_SIZE - 1);
+			if (table[slot] == 0) {
+				table[slot] = color;
+				++distinct;
+			}
+		}
+	}
+	free(table);
+
+	D(@"sampled=%lu distinct=%lu translucent=%d", (unsigned long)sampled, (unsigned long)distinct, translucent);
+	return translucent || distinct * 8 <= sampled;
+}
+@end
@@ -42,14 +42,9 @@ static NSString * INSTAPAPER_PATH2 = @"/go";
 		NSURL * url = [NSURL URLWithString:[self.document URL]];
 		D(@"host=%@ path=%2 query=%2", [url host], [url path], [url query]);
 		NSString * query = [url query];
-		NSDictionary * queries = [query dictionaryWithKVPConnector:@"=" withSeparator:@"&"];;
-		for (NSString * key in queries) {
-			if ([key isEqualToString:@"u"]) {
-				URL_ = [[queries objectForKey:@"u"] stringByURLDecoding:NSUTF8StringEncoding];
-				D(@"normalized URL=%@", URL_);
-				break;
-			}
-		}
+		NSDictionary * queries = [query dictionaryWithKVPConnector:@"=" withSeparator:@"&"];
+		URL_ = [queries objectForKey:@"u"];
+		D(@"normalized URL=%@", URL_);
 		// なんだよ、URLパラメータにしたりしなかったり、わけわからん
 		if (URL_ == nil) {
 			static NSString * const kExpression = @"//div[@class='bar top']/a/@href";
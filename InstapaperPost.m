@@ -2,7 +2,9 @@
  * @file InstapaperPost.m
  */
 #import "InstapaperPost.h"
+#import "HTTPSession.h"
 #import "NSString+Tumblrful.h"
+#import "FormEncoder.h"
 #import "UserSettings.h"
 #import "DebugLog.h"
 
@@ -73,8 +75,8 @@ static NSString * API_ADD_ENDPOINT = @"https://www.instapaper.com/api/add";
 	NSURLRequest * request = [self createRequest:params]; // request は connection に指定した時点で reatin upする
 	D(@"request:%@", [request description]);
 
-	NSURLConnection * connection = [NSURLConnection connectionWithRequest:request delegate:self];
-	if (connection == nil) {
+	id task = [[HTTPSession sharedSession] startRequest:request delegate:self];	// 同じホストへの接続を使い回す
+	if (task == nil) {
 		[self callbackOnMainThread:@selector(failedWithError:) withObject:nil];
 		[data_ release], data_ = nil;
 	}
@@ -147,12 +149,8 @@ static NSString * API_ADD_ENDPOINT = @"https://www.instapaper.com/api/add";
 {
 	@try {
 		// create URL with parameters
-		NSMutableString * ps = [NSMutableString string];
-		NSEnumerator * enumerator = [params keyEnumerator];
-		for (NSString * key; (key = [enumerator nextObject]) != nil; ) {
-			D(@"%@=%@", key, [params objectForKey:key]);
-			[ps appendFormat:@"&%@=%@", key, [[params objectForKey:key] stringByURLEncoding:NSUTF8StringEncoding]];
-		}
+		NSString * ps = [FormEncoder stringWithParams:params];
+		D0(ps);
 		NSURL * url = [NSURL URLWithString:[NSString stringWithFormat:@"%@?%@", API_ADD_ENDPOINT, ps]];
 
 		// create the POST request
@@ -3,6 +3,7 @@
  */
 #import "InstapaperPostAdaptor.h"
 #import "InstapaperPost.h"
+#import "PostQueue.h"
 #import "NSString+Tumblrful.h"
 #import "DebugLog.h"
 
@@ -40,17 +41,14 @@
 	if (![InstapaperPost enabled]) return;
 
 	@try {
-		// Instapaperへポストするオブジェクトを生成する
-		InstapaperPost * instapaper = [[InstapaperPost alloc] initWithCallback:callback_];
-
-		// リクエストパラメータを構築する
-		NSMutableDictionary * params = [instapaper createMinimumRequestParams];
+		// リクエストパラメータを構築する. username と password は送信する時に InstapaperPost が足す
+		NSMutableDictionary * params = [NSMutableDictionary dictionary];
 		[params setObject:anchor.URL forKey:@"url"];
 		if (description != nil) [params setObject:description forKey:@"selection"];	// no HTML
 		D0([params description]);
 
-		// ポストする
-		[instapaper postWith:params];
+		// 送信待ち行列に入れる. Instapaperへのポストは PostQueue が行う
+		[[PostQueue sharedQueue] enqueuePostClass:[InstapaperPost class] params:params options:nil callback:callback_];
 	}
 	@catch (NSException * e) {
 		D0([e description]);
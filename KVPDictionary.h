@@ -0,0 +1,46 @@
+/**
+ * @file KVPDictionary.h
+ * @brief KVPDictionary class declaration
+ */
+#import <Foundation/Foundation.h>
+
+/**
+ * "key=value&key=value" 形式の文字列を表す辞書
+ *	元の文字列を一度だけ走査して key と value の範囲だけを覚えておき、
+ *	value は要求された時に初めて URL デコードする.
+ *	同じ key が複数あれば objectForKey: は最初のものを返す.
+ */
+@interface KVPDictionary : NSDictionary
+{
+	NSString * source_;
+	NSMutableData * pairs_;		///< KVPRange の配列
+	NSMutableArray * values_;	///< デコード済みの value. 未デコードは NSNull
+	NSArray * keys_;			///< 重複を除いた key. keyEnumerator で初めて作る
+}
+
+/**
+ * 文字列を解析する
+ *	@param[in] string	解析する文字列
+ *	@param[in] connector	key と value の区切り. value 中の2つ目以降はそのまま value に含める
+ *	@param[in] separator	組の区切り
+ *	@return KVPDictionary object
+ */
+- (id)initWithString:(NSString *)string connector:(NSString *)connector separator:(NSString *)separator;
+
+/**
+ * 出現順の key と value の組の数
+ *	@return 組の数(重複した key も数える)
+ */
+- (NSUInteger)pairCount;
+
+- (NSString *)keyAtIndex:(NSUInteger)index;
+
+- (NSString *)valueAtIndex:(NSUInteger)index;
+
+/**
+ * key に対応するすべての value を出現順に返す
+ *	@param[in] key	key
+ *	@return NSArray object
+ */
+- (NSArray *)objectsForKey:(NSString *)key;
+@end
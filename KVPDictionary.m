@@ -0,0 +1,149 @@
+/**
+ * @file KVPDictionary.m
+ * @brief KVPDictionary class implementation
+ */
+#import "KVPDictionary.h"
+#import "NSString+Tumblrful.h"
+
+typedef struct {
+	NSRange key;
+	NSRange value;
+} KVPRange;
+
+@interface KVPDictionary ()
+- (const KVPRange *)pairs;
+- (BOOL)keyAtIndex:(NSUInteger)index isEqualToString:(NSString *)key;
+@end
+
+@implementation KVPDictionary
+
+- (id)initWithString:(NSString *)string connector:(NSString *)connector separator:(NSString *)separator
+{
+	if ((self = [super init]) != nil) {
+		source_ = [string copy];
+		pairs_ = [[NSMutableData alloc] init];
+
+		NSUInteger const length = [source_ length];
+		NSUInteger location = 0;
+		while (location < length) {
+			NSRange rest = NSMakeRange(location, length - location);
+			NSRange found = [source_ rangeOfString:separator options:NSLiteralSearch range:rest];
+			NSUInteger const end = found.location != NSNotFound ? found.location : length;
+
+			// 組の中の最初の connector で key と value に分ける
+			NSRange pair = NSMakeRange(location, end - location);
+			NSRange connect = [source_ rangeOfString:connector options:NSLiteralSearch range:pair];
+			if (connect.location != NSNotFound && connect.location > location) {
+				KVPRange r;
+				r.key = NSMakeRange(location, connect.location - location);
+				r.value = NSMakeRange(NSMaxRange(connect), end - NSMaxRange(connect));
+				[pairs_ appendBytes:&r length:sizeof(r)];
+			}
+
+			location = found.location != NSNotFound ? NSMaxRange(found) : length;
+		}
+
+		NSUInteger const count = [self pairCount];
+		values_ = [[NSMutableArray alloc] initWithCapacity:count];
+		for (NSUInteger i = 0; i < count; ++i) {
+			[values_ addObject:[NSNull null]];
+		}
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[source_ release], source_ = nil;
+	[pairs_ release], pairs_ = nil;
+	[values_ release], values_ = nil;
+	[keys_ release], keys_ = nil;
+	[super dealloc];
+}
+
+- (const KVPRange *)pairs
+{
+	return (const KVPRange *)[pairs_ bytes];
+}
+
+- (NSUInteger)pairCount
+{
+	return [pairs_ length] / sizeof(KVPRange);
+}
+
+- (NSString *)keyAtIndex:(NSUInteger)index
+{
+	return [source_ substringWithRange:[self pairs][index].key];
+}
+
+- (BOOL)keyAtIndex:(NSUInteger)index isEqualToString:(NSString *)key
+{
+	NSRange const r = [self pairs][index].key;
+	return r.length == [key length] && [source_ compare:key options:NSLiteralSearch range:r] == NSOrderedSame;
+}
+
+- (NSString *)valueAtIndex:(NSUInteger)index
+{
+	id value = [values_ objectAtIndex:index];
+	if (value == [NSNull null]) {
+		NSString * raw = [source_ substringWithRange:[self pairs][index].value];
+		value = [raw stringByURLDecoding:NSUTF8StringEncoding];
+		if (value == nil) value = raw; // UTF-8 として解釈できなければそのまま
+		[values_ replaceObjectAtIndex:index withObject:value];
+	}
+	return value;
+}
+
+- (NSArray *)objectsForKey:(NSString *)key
+{
+	NSMutableArray * objects = [NSMutableArray array];
+	NSUInteger const count = [self pairCount];
+	for (NSUInteger i = 0; i < count; ++i) {
+		if ([self keyAtIndex:i isEqualToString:key]) {
+			[objects addObject:[self valueAtIndex:i]];
+		}
+	}
+	return objects;
+}
+
+#pragma mark -
+#pragma mark NSDictionary Primitive Methods
+
+- (NSUInteger)count
+{
+	return [[self allKeys] count];
+}
+
+- (id)objectForKey:(id)key
+{
+	if (![key isKindOfClass:[NSString class]]) return nil;
+
+	// クエリ文字列の組はせいぜい数十なので、走査した方が辞書を作るより安い
+	NSUInteger const count = [self pairCount];
+	for (NSUInteger i = 0; i < count; ++i) {
+		if ([self keyAtIndex:i isEqualToString:key]) {
+			return [self valueAtIndex:i];
+		}
+	}
+	return nil;
+}
+
+- (NSArray *)allKeys
+{
+	if (keys_ == nil) {
+		NSUInteger const count = [self pairCount];
+		NSMutableArray * keys = [NSMutableArray arrayWithCapacity:count];
+		for (NSUInteger i = 0; i < count; ++i) {
+			NSString * key = [self keyAtIndex:i];
+			if (![keys containsObject:key]) [keys addObject:key];
+		}
+		keys_ = [keys copy];
+	}
+	return keys_;
+}
+
+- (NSEnumerator *)keyEnumerator
+{
+	return [[self allKeys] objectEnumerator];
+}
+@end
@@ -0,0 +1,100 @@
+/**
+ * @file MetadataCache.h
+ * @brief MetadataCache class declaration
+ */
+#import <Foundation/Foundation.h>
+
+/**
+ * API から引いたメタ情報(Flickr photos.getInfo, Vimeo videos.getInfo, Tumblr read API)の応答を覚えておくキャッシュ
+ *	(service, identifier) ごとに応答の本体と ETag / Last-Modified を持つ.
+ *	メモリ上の LRU と ~/Library/Caches/Tumblrful/Metadata のファイルの2段で、
+ *	メモリに無ければファイルから読み戻す. ファイルの書き込みと削除は専用のスレッドで行う.
+ *
+ *	timeToLive 以内のものはそのまま使い、過ぎたものは条件付きリクエストで確かめる(304 なら使い回す).
+ *	main thread からだけ使うこと.
+ */
+@interface MetadataCache : NSObject
+{
+	NSString * directory_;
+	NSOperationQueue * ioQueue_;
+	NSMutableDictionary * entries_;
+	NSMutableArray * order_;	///< 古い順のキー. 末尾が最近使ったもの
+	NSUInteger capacity_;
+	NSUInteger memoryLimit_;
+	NSUInteger memoryUsage_;
+	unsigned long long diskLimit_;
+	NSTimeInterval timeToLive_;
+	NSUInteger memoryHits_;
+	NSUInteger diskHits_;
+	NSUInteger revalidations_;
+	NSUInteger misses_;
+	NSUInteger evictions_;
+}
+
+/// メモリに置くエントリの最大数
+@property (nonatomic, assign) NSUInteger capacity;
+
+/// メモリに置く応答の合計バイト数の上限
+@property (nonatomic, assign) NSUInteger memoryLimit;
+
+/// ファイルの合計バイト数の上限. 超えたら古いものから消す
+@property (nonatomic, assign) unsigned long long diskLimit;
+
+/// 確かめずに使う期間(秒)
+@property (nonatomic, assign) NSTimeInterval timeToLive;
+
+/// メモリでのヒット数
+@property (nonatomic, readonly) NSUInteger memoryHits;
+
+/// ファイルからのヒット数
+@property (nonatomic, readonly) NSUInteger diskHits;
+
+/// 条件付きリクエストに 304 が返って使い回した数
+@property (nonatomic, readonly) NSUInteger revalidations;
+
+/// ミス数(期限切れを含む)
+@property (nonatomic, readonly) NSUInteger misses;
+
+/// メモリから追い出した数
+@property (nonatomic, readonly) NSUInteger evictions;
+
+/// ネットワークから取り直さずに済んだ割合(0.0 - 1.0)
+@property (nonatomic, readonly) double hitRate;
+
++ (MetadataCache *)sharedCache;
+
+/**
+ * 期限内の応答を引く
+ *	@param[in] service	サービス名(@"flickr" など)
+ *	@param[in] identifier	サービス内の ID
+ *	@return 応答の本体. 無いか期限切れなら nil
+ */
+- (NSData *)dataForService:(NSString *)service identifier:(NSString *)identifier;
+
+/**
+ * リクエストを作る. 期限切れのエントリがあれば If-None-Match / If-Modified-Since を付ける
+ *	@param[in] URL	URL
+ *	@param[in] timeoutInterval	タイムアウト(秒)
+ *	@param[in] service	サービス名
+ *	@param[in] identifier	サービス内の ID
+ *	@return リクエスト
+ */
+- (NSURLRequest *)requestWithURL:(NSURL *)URL timeoutInterval:(NSTimeInterval)timeoutInterval service:(NSString *)service identifier:(NSString *)identifier;
+
+/**
+ * 応答を受け取る. 200 なら覚え、304 なら覚えていたものを返す
+ *	@param[in] response	応答
+ *	@param[in] data	応答の本体
+ *	@param[in] service	サービス名
+ *	@param[in] identifier	サービス内の ID
+ *	@return 使うべき本体. 304 なのに覚えていなければ data をそのまま返す
+ */
+- (NSData *)dataWithResponse:(NSURLResponse *)response data:(NSData *)data service:(NSString *)service identifier:(NSString *)identifier;
+
+/**
+ * 忘れる(応答の中身がエラーだった時など)
+ *	@param[in] service	サービス名
+ *	@param[in] identifier	サービス内の ID
+ */
+- (void)removeDataForService:(NSString *)service identifier:(NSString *)identifier;
+@end
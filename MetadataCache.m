@@ -0,0 +1,341 @@
+/**
+ * @file MetadataCache.m
+ * @brief MetadataCache class implementation
+ */
+#import "MetadataCache.h"
+#import "DebugLog.h"
+
+/// 既定のエントリ数. 1回の共有で引くのは 1件なので、数十件あれば足りる
+static NSUInteger DEFAULT_CAPACITY = 128;
+
+/// 既定のメモリ上限. getInfo の応答はたかだか数KB
+static NSUInteger DEFAULT_MEMORY_LIMIT = 1024 * 1024;
+
+/// 既定のファイル上限
+static unsigned long long DEFAULT_DISK_LIMIT = 8 * 1024 * 1024;
+
+/// 既定の有効期間. タイトルや説明が書き換えられても半日以内には追い付く
+static NSTimeInterval DEFAULT_TIME_TO_LIVE = 6 * 60 * 60;
+
+static NSString * ENTRY_DATA = @"data";
+static NSString * ENTRY_ETAG = @"etag";
+static NSString * ENTRY_LAST_MODIFIED = @"lastModified";
+static NSString * ENTRY_DATE = @"date";
+
+@interface MetadataCache ()
++ (NSString *)keyWithService:(NSString *)service identifier:(NSString *)identifier;
++ (NSString *)headerField:(NSString *)name inResponse:(NSHTTPURLResponse *)response;
+- (NSString *)pathForKey:(NSString *)key;
+- (NSMutableDictionary *)entryForKey:(NSString *)key fromDisk:(BOOL *)fromDisk;
+- (BOOL)isFreshEntry:(NSDictionary *)entry;
+- (void)setEntry:(NSMutableDictionary *)entry forKey:(NSString *)key;
+- (void)removeEntryForKey:(NSString *)key;
+- (void)writeEntry:(NSDictionary *)entry forKey:(NSString *)key;
+- (void)writeFile:(NSArray *)dataAndPath;
+- (void)removeFile:(NSString *)path;
+- (void)trimDisk;
+@end
+
+@implementation MetadataCache
+
+@synthesize capacity = capacity_;
+@synthesize memoryLimit = memoryLimit_;
+@synthesize diskLimit = diskLimit_;
+@synthesize timeToLive = timeToLive_;
+@synthesize memoryHits = memoryHits_;
+@synthesize diskHits = diskHits_;
+@synthesize revalidations = revalidations_;
+@synthesize misses = misses_;
+@synthesize evictions = evictions_;
+
++ (MetadataCache *)sharedCache
+{
+	static MetadataCache * instance = nil;
+	if (instance == nil) {
+		instance = [[MetadataCache alloc] init];
+	}
+	return instance;
+}
+
++ (NSString *)keyWithService:(NSString *)service identifier:(NSString *)identifier
+{
+	// ファイル名にもするので区切りになる文字は避ける
+	NSString * safe = [[identifier stringByReplacingOccurrencesOfString:@"/" withString:@"_"] stringByReplacingOccurrencesOfString:@":" withString:@"_"];
+	return [NSString stringWithFormat:@"%@-%@", service, safe];
+}
+
++ (NSString *)headerField:(NSString *)name inResponse:(NSHTTPURLResponse *)response
+{
+	NSDictionary * fields = [response allHeaderFields];
+	for (NSString * key in fields) {
+		if ([key caseInsensitiveCompare:name] == NSOrderedSame) {
+			return [fields objectForKey:key];
+		}
+	}
+	return nil;
+}
+
+- (id)init
+{
+	if ((self = [super init]) != nil) {
+		NSArray * paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+		directory_ = [[[[paths objectAtIndex:0] stringByAppendingPathComponent:@"Tumblrful"] stringByAppendingPathComponent:@"Metadata"] retain];
+		[[NSFileManager defaultManager] createDirectoryAtPath:directory_ withIntermediateDirectories:YES attributes:nil error:nil];
+
+		ioQueue_ = [[NSOperationQueue alloc] init];
+		[ioQueue_ setMaxConcurrentOperationCount:1];
+
+		entries_ = [[NSMutableDictionary alloc] init];
+		order_ = [[NSMutableArray alloc] init];
+		capacity_ = DEFAULT_CAPACITY;
+		memoryLimit_ = DEFAULT_MEMORY_LIMIT;
+		diskLimit_ = DEFAULT_DISK_LIMIT;
+		timeToLive_ = DEFAULT_TIME_TO_LIVE;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[ioQueue_ waitUntilAllOperationsAreFinished];
+	[ioQueue_ release], ioQueue_ = nil;
+	[directory_ release], directory_ = nil;
+	[entries_ release], entries_ = nil;
+	[order_ release], order_ = nil;
+
+	[super dealloc];
+}
+
+- (double)hitRate
+{
+	NSUInteger const hits = memoryHits_ + diskHits_ + revalidations_;
+	NSUInteger const lookups = memoryHits_ + diskHits_ + misses_;
+	return lookups > 0 ? (double)hits / (double)lookups : 0.0;
+}
+
+- (NSData *)dataForService:(NSString *)service identifier:(NSString *)identifier
+{
+	if (service == nil || identifier == nil) return nil;
+
+	NSString * key = [MetadataCache keyWithService:service identifier:identifier];
+	BOOL fromDisk = NO;
+	NSMutableDictionary * entry = [self entryForKey:key fromDisk:&fromDisk];
+	if (entry == nil || ![self isFreshEntry:entry]) {
+		++misses_;
+		D(@"miss: %@ (hit rate %.2f)", key, self.hitRate);
+		return nil;
+	}
+
+	if (fromDisk) {
+		++diskHits_;
+	}
+	else {
+		++memoryHits_;
+	}
+	D(@"hit: %@ from %@ (hit rate %.2f)", key, (fromDisk ? @"disk" : @"memory"), self.hitRate);
+	return [entry objectForKey:ENTRY_DATA];
+}
+
+- (NSURLRequest *)requestWithURL:(NSURL *)URL timeoutInterval:(NSTimeInterval)timeoutInterval service:(NSString *)service identifier:(NSString *)identifier
+{
+	NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:URL cachePolicy:NSURLRequestUseProtocolCachePolicy timeoutInterval:timeoutInterval];
+	if (service == nil || identifier == nil) return request;
+
+	NSDictionary * entry = [self entryForKey:[MetadataCache keyWithService:service identifier:identifier] fromDisk:NULL];
+	if (entry != nil) {
+		// 304 をこちらで受け取るために URL ローディングシステムのキャッシュは通さない
+		[request setCachePolicy:NSURLRequestReloadIgnoringLocalCacheData];
+
+		NSString * etag = [entry objectForKey:ENTRY_ETAG];
+		if (etag != nil) {
+			[request setValue:etag forHTTPHeaderField:@"If-None-Match"];
+		}
+		NSString * lastModified = [entry objectForKey:ENTRY_LAST_MODIFIED];
+		if (lastModified != nil) {
+			[request setValue:lastModified forHTTPHeaderField:@"If-Modified-Since"];
+		}
+	}
+	return request;
+}
+
+- (NSData *)dataWithResponse:(NSURLResponse *)response data:(NSData *)data service:(NSString *)service identifier:(NSString *)identifier
+{
+	if (service == nil || identifier == nil || ![response isKindOfClass:[NSHTTPURLResponse class]]) {
+		return data;
+	}
+
+	NSHTTPURLResponse * httpResponse = (NSHTTPURLResponse *)response;
+	NSString * key = [MetadataCache keyWithService:service identifier:identifier];
+	NSInteger const statusCode = [httpResponse statusCode];
+
+	if (statusCode == 304) {
+		NSMutableDictionary * entry = [self entryForKey:key fromDisk:NULL];
+		if (entry == nil) {
+			return data;
+		}
+		++revalidations_;
+		D(@"not modified: %@", key);
+		[entry setObject:[NSDate date] forKey:ENTRY_DATE];
+		[self writeEntry:entry forKey:key];
+		return [entry objectForKey:ENTRY_DATA];
+	}
+
+	if (statusCode == 200 && [data length] > 0) {
+		NSMutableDictionary * entry = [NSMutableDictionary dictionaryWithObjectsAndKeys:[[data copy] autorelease], ENTRY_DATA, [NSDate date], ENTRY_DATE, nil];
+		NSString * etag = [MetadataCache headerField:@"ETag" inResponse:httpResponse];
+		if (etag != nil) {
+			[entry setObject:etag forKey:ENTRY_ETAG];
+		}
+		NSString * lastModified = [MetadataCache headerField:@"Last-Modified" inResponse:httpResponse];
+		if (lastModified != nil) {
+			[entry setObject:lastModified forKey:ENTRY_LAST_MODIFIED];
+		}
+		[self setEntry:entry forKey:key];
+		[self writeEntry:entry forKey:key];
+	}
+	return data;
+}
+
+- (void)removeDataForService:(NSString *)service identifier:(NSString *)identifier
+{
+	if (service == nil || identifier == nil) return;
+
+	NSString * key = [MetadataCache keyWithService:service identifier:identifier];
+	[self removeEntryForKey:key];
+	[ioQueue_ addOperation:[[[NSInvocationOperation alloc] initWithTarget:self selector:@selector(removeFile:) object:[self pathForKey:key]] autorelease]];
+}
+
+#pragma mark -
+#pragma mark Private Methods
+
+- (NSString *)pathForKey:(NSString *)key
+{
+	return [directory_ stringByAppendingPathComponent:[key stringByAppendingPathExtension:@"plist"]];
+}
+
+/**
+ * エントリを引く. メモリに無ければファイルから読み戻してメモリに置く
+ *	@param[in] key	キー
+ *	@param[out] fromDisk	ファイルから読んだか(NULL 可)
+ *	@return エントリ. 期限切れでも返す
+ */
+- (NSMutableDictionary *)entryForKey:(NSString *)key fromDisk:(BOOL *)fromDisk
+{
+	if (fromDisk != NULL) *fromDisk = NO;
+
+	NSMutableDictionary * entry = [entries_ objectForKey:key];
+	if (entry != nil) {
+		// 最近使ったものとして末尾へ
+		[order_ removeObject:key];
+		[order_ addObject:key];
+		return entry;
+	}
+
+	NSData * plist = [NSData dataWithContentsOfFile:[self pathForKey:key]];
+	if (plist == nil) {
+		return nil;
+	}
+	entry = [NSPropertyListSerialization propertyListWithData:plist options:NSPropertyListMutableContainers format:NULL error:NULL];
+	if (![entry isKindOfClass:[NSMutableDictionary class]] || [entry objectForKey:ENTRY_DATA] == nil || [entry objectForKey:ENTRY_DATE] == nil) {
+		D(@"broken entry: %@", key);
+		return nil;
+	}
+
+	[self setEntry:entry forKey:key];
+	if (fromDisk != NULL) *fromDisk = YES;
+	return entry;
+}
+
+- (BOOL)isFreshEntry:(NSDictionary *)entry
+{
+	return -[[entry objectForKey:ENTRY_DATE] timeIntervalSinceNow] < timeToLive_;
+}
+
+- (void)setEntry:(NSMutableDictionary *)entry forKey:(NSString *)key
+{
+	[self removeEntryForKey:key];
+
+	[entries_ setObject:entry forKey:key];
+	[order_ addObject:key];
+	memoryUsage_ += [[entry objectForKey:ENTRY_DATA] length];
+
+	// 数と大きさのどちらかが溢れたら古いものからメモリを空ける. ファイルは残す
+	while ([order_ count] > 1 && ([order_ count] > capacity_ || memoryUsage_ > memoryLimit_)) {
+		NSString * oldest = [order_ objectAtIndex:0];
+		D(@"evict: %@", oldest);
+		[self removeEntryForKey:oldest];
+		++evictions_;
+	}
+}
+
+- (void)removeEntryForKey:(NSString *)key
+{
+	NSDictionary * entry = [entries_ objectForKey:key];
+	if (entry != nil) {
+		memoryUsage_ -= [[entry objectForKey:ENTRY_DATA] length];
+		[order_ removeObject:key];
+		[entries_ removeObjectForKey:key];
+	}
+}
+
+- (void)writeEntry:(NSDictionary *)entry forKey:(NSString *)key
+{
+	NSData * plist = [NSPropertyListSerialization dataWithPropertyList:entry format:NSPropertyListBinaryFormat_v1_0 options:0 error:NULL];
+	if (plist == nil) {
+		D(@"could not serialize: %@", key);
+		return;
+	}
+	NSArray * dataAndPath = [NSArray arrayWithObjects:plist, [self pathForKey:key], nil];
+	[ioQueue_ addOperation:[[[NSInvocationOperation alloc] initWithTarget:self selector:@selector(writeFile:) object:dataAndPath] autorelease]];
+}
+
+#pragma mark -
+#pragma mark Files (ioQueue_)
+
+- (void)writeFile:(NSArray *)dataAndPath
+{
+	NSString * path = [dataAndPath objectAtIndex:1];
+	if (![[dataAndPath objectAtIndex:0] writeToFile:path atomically:YES]) {
+		Log(@"MetadataCache: could not write %@", path);
+		return;
+	}
+	[self trimDisk];
+}
+
+- (void)removeFile:(NSString *)path
+{
+	[[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+/**
+ * ファイルの合計が diskLimit を超えていたら、更新日時の古いものから消す
+ */
+- (void)trimDisk
+{
+	NSFileManager * manager = [NSFileManager defaultManager];
+	NSArray * names = [manager contentsOfDirectoryAtPath:directory_ error:nil];
+
+	unsigned long long total = 0;
+	NSMutableArray * files = [NSMutableArray arrayWithCapacity:[names count]];
+	for (NSString * name in names) {
+		NSString * path = [directory_ stringByAppendingPathComponent:name];
+		NSDictionary * attributes = [manager attributesOfItemAtPath:path error:nil];
+		if (attributes == nil) continue;
+		total += [attributes fileSize];
+		[files addObject:[NSDictionary dictionaryWithObjectsAndKeys:path, @"path", [attributes fileModificationDate], @"date", [NSNumber numberWithUnsignedLongLong:[attributes fileSize]], @"size", nil]];
+	}
+	if (total <= diskLimit_) {
+		return;
+	}
+
+	NSSortDescriptor * byDate = [[[NSSortDescriptor alloc] initWithKey:@"date" ascending:YES] autorelease];
+	[files sortUsingDescriptors:[NSArray arrayWithObject:byDate]];
+	for (NSDictionary * file in files) {
+		if (total <= diskLimit_) break;
+		if ([manager removeItemAtPath:[file objectForKey:@"path"] error:nil]) {
+			total -= [[file objectForKey:@"size"] unsignedLongLongValue];
+		}
+	}
+	D(@"trimmed disk cache to %llu bytes", total);
+}
+@end
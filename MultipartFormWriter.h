@@ -0,0 +1,68 @@
+/**
+ * @file MultipartFormWriter.h
+ * @brief MultipartFormWriter class declaration
+ */
+#import <Foundation/Foundation.h>
+
+/**
+ * multipart/form-data の本文を一時ファイルに書き出していくライター
+ *	パートを追加するたびにファイルへ書き出すので、メモリに持つのは1パート分だけ.
+ *	本文は setHTTPBodyStream: でファイルから読みながら送る.
+ *	一時ファイルはこのオブジェクトの解放時に削除するので、送信が終わるまで保持しておくこと.
+ */
+@interface MultipartFormWriter : NSObject
+{
+	NSString * boundary_;
+	NSString * path_;
+	NSFileHandle * file_;
+	unsigned long long contentLength_;
+	BOOL finished_;
+	BOOL failed_;		///< 書き込みに失敗した(ディスクが一杯など)
+}
+
+/// 本文の長さ(finish 後に確定する)
+@property (nonatomic, readonly) unsigned long long contentLength;
+
+/**
+ * 一時ファイルを作成して初期化する
+ *	@param[in] boundary	パートの境界文字列
+ *	@return MultipartFormWriter object. 一時ファイルが作れなければ nil
+ */
+- (id)initWithBoundary:(NSString *)boundary;
+
+/**
+ * テキストのパートを追加する
+ *	@param[in] value	値. NSString 以外は description を使う
+ *	@param[in] name	フィールド名
+ *	@return 書き込めたら YES. 一度失敗したら以降はすべて NO
+ */
+- (BOOL)appendValue:(id)value forName:(NSString *)name;
+
+/**
+ * バイナリのパートを追加する
+ *	@param[in] data	内容
+ *	@param[in] name	フィールド名
+ *	@param[in] contentType	MIMEタイプ
+ *	@return 書き込めたら YES. 一度失敗したら以降はすべて NO
+ */
+- (BOOL)appendData:(NSData *)data forName:(NSString *)name contentType:(NSString *)contentType;
+
+/**
+ * 終端の境界を書き込んでファイルを閉じる
+ *	@return 本文をすべて書き込めたら YES
+ */
+- (BOOL)finish;
+
+/**
+ * 本文を読むストリームを作る. 呼ぶたびに先頭から読む新しいストリームを返す
+ *	@return NSInputStream object. 本文を書き込めていなければ nil
+ */
+- (NSInputStream *)inputStream;
+
+/**
+ * request に本文のストリームと Content-Type, Content-Length を設定する
+ *	@param[in] request	POST するリクエスト
+ *	@return 設定できたら YES. 本文を書き込めていなければ NO で、request は変更しない
+ */
+- (BOOL)applyToRequest:(NSMutableURLRequest *)request;
+@end
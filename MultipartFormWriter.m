@@ -0,0 +1,122 @@
+/**
+ * @file MultipartFormWriter.m
+ * @brief MultipartFormWriter class implementation
+ */
+#import "MultipartFormWriter.h"
+#import "DebugLog.h"
+#include <errno.h>
+#include <stdlib.h>
+
+@interface MultipartFormWriter ()
+- (BOOL)writeString:(NSString *)string;
+- (BOOL)writeData:(NSData *)data;
+@end
+
+@implementation MultipartFormWriter
+
+@synthesize contentLength = contentLength_;
+
+- (id)initWithBoundary:(NSString *)boundary
+{
+	if ((self = [super init]) != nil) {
+		boundary_ = [boundary copy];
+
+		NSString * template = [NSTemporaryDirectory() stringByAppendingPathComponent:@"Tumblrful.multipart.XXXXXX"];
+		char * buffer = strdup([template fileSystemRepresentation]);
+		int const fd = buffer != NULL ? mkstemp(buffer) : -1;
+		if (fd < 0) {
+			D(@"failed to create temporary file. errno=%d", errno);
+			free(buffer);
+			[self release];
+			return nil;
+		}
+		path_ = [[[NSFileManager defaultManager] stringWithFileSystemRepresentation:buffer length:strlen(buffer)] retain];
+		free(buffer);
+
+		file_ = [[NSFileHandle alloc] initWithFileDescriptor:fd closeOnDealloc:YES];
+		contentLength_ = 0;
+		finished_ = NO;
+		failed_ = NO;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[file_ release], file_ = nil;
+	if (path_ != nil) {
+		[[NSFileManager defaultManager] removeItemAtPath:path_ error:nil];
+	}
+	[path_ release], path_ = nil;
+	[boundary_ release], boundary_ = nil;
+	[super dealloc];
+}
+
+- (BOOL)writeData:(NSData *)data
+{
+	if (failed_) return NO;
+
+	// NSFileHandle は ENOSPC や EIO で例外を投げるので、ここで止めて呼び出し側には NO で返す
+	@try {
+		[file_ writeData:data];
+	}
+	@catch (NSException * e) {
+		Log(@"failed to write multipart body: %@", [e reason]);
+		failed_ = YES;
+		return NO;
+	}
+	contentLength_ += [data length];
+	return YES;
+}
+
+- (BOOL)writeString:(NSString *)string
+{
+	return [self writeData:[string dataUsingEncoding:NSUTF8StringEncoding]];
+}
+
+- (BOOL)appendValue:(id)value forName:(NSString *)name
+{
+	NSString * text = [value isKindOfClass:[NSString class]] ? value : [value description];
+	return [self writeString:[NSString stringWithFormat:@"--%@\r\nContent-Disposition: form-data; name=\"%@\"\r\n\r\n%@\r\n", boundary_, name, text]];
+}
+
+- (BOOL)appendData:(NSData *)data forName:(NSString *)name contentType:(NSString *)contentType
+{
+	return [self writeString:[NSString stringWithFormat:@"--%@\r\nContent-Disposition: form-data; name=\"%@\"\r\nContent-Type: %@\r\n\r\n", boundary_, name, contentType]]
+		&& [self writeData:data]
+		&& [self writeString:@"\r\n"];
+}
+
+- (BOOL)finish
+{
+	if (finished_) return !failed_;
+
+	if ([self writeString:[NSString stringWithFormat:@"--%@--\r\n", boundary_]]) {
+		@try {
+			[file_ synchronizeFile];
+		}
+		@catch (NSException * e) {
+			Log(@"failed to flush multipart body: %@", [e reason]);
+			failed_ = YES;
+		}
+	}
+	[file_ closeFile];
+	finished_ = YES;
+	return !failed_;
+}
+
+- (NSInputStream *)inputStream
+{
+	if (![self finish]) return nil;
+	return [NSInputStream inputStreamWithFileAtPath:path_];
+}
+
+- (BOOL)applyToRequest:(NSMutableURLRequest *)request
+{
+	if (![self finish]) return NO;
+	[request setValue:[NSString stringWithFormat:@"multipart/form-data; boundary=%@", boundary_] forHTTPHeaderField:@"Content-Type"];
+	[request setValue:[NSString stringWithFormat:@"%llu", contentLength_] forHTTPHeaderField:@"Content-Length"];
+	[request setHTTPBodyStream:[self inputStream]];
+	return YES;
+}
+@end
@@ -7,6 +7,24 @@ extern NSString * EmptyString;
 
 #define Stringnize(s)	((s) != nil ? (s) : @"")
 
+/**
+ * Length of URL encoded bytes
+ *	@param[in] bytes	bytes to encode
+ *	@param[in] length	length of bytes
+ *	@return encoded length
+ */
+NSUInteger URLEncodedLength(const unsigned char * bytes, NSUInteger length);
+
+/**
+ * URL encode bytes
+ *	escapes every byte except ALPHA, DIGIT, "-", ".", "_" and "~".
+ *	@param[in] bytes	bytes to encode
+ *	@param[in] length	length of bytes
+ *	@param[out] out	output buffer. must hold URLEncodedLength() bytes
+ *	@return written length
+ */
+NSUInteger URLEncodeBytes(const unsigned char * bytes, NSUInteger length, char * out);
+
 @interface NSString (Tumblrful)
 /**
  * Trim whitespace both-side
@@ -16,6 +34,7 @@ extern NSString * EmptyString;
 
 /**
  * Encode URL
+ *	escapes every byte except ALPHA, DIGIT, "-", ".", "_" and "~".
  *	@param[in] encoding encoding
  *	@return NSString object
  */
@@ -23,6 +42,7 @@ extern NSString * EmptyString;
 
 /**
  * Decode URL
+ *	decodes every %XX escape in one pass. returns self if the string has no '%'.
  *	@param[in] encoding encoding
  *	@return NSString object
  */
@@ -30,18 +50,33 @@ extern NSString * EmptyString;
 
 /**
  * strip HTML tags
- *	@param [in] excludes	exclude tags
+ *	one pass over the string. unterminated tags are left as is.
+ *	@param [in] excludes	exclude tags (case-insensitive)
  *	@example
  *	NSArray * excludes = [NSArray arrayWithObjects: @"table", @"tr", @"td", nil];
  *	NSString * striped = [html stripHTMLTags:excludes];
  */
 - (NSString *)stripHTMLTags:(NSArray *)excludes;
 
+/**
+ * parse "key=value&key=value" style string
+ *	scans once and URL-decodes each value lazily on first access.
+ *	values may contain the connector. see KVPDictionary for repeated keys.
+ *	@param[in] connector	key/value connector
+ *	@param[in] separator	pair separator
+ *	@return KVPDictionary object
+ */
 - (NSDictionary *)dictionaryWithKVPConnector:(NSString *)connector withSeparator:(NSString *)separator;
 
 + (NSString *)stringWithKVPDictionary:(NSDictionary *)dictionary withConnector:(NSString *)connector withSeparator:(NSString *)separator withEncoding:(NSStringEncoding)encoding;
 
 - (BOOL)isCaseInsensitiveEqualToString:(NSString *)s;
 
+/**
+ * Unescape HTML character references
+ *	decodes named (HTML5) and numeric references in one forward pass.
+ *	unknown references are left as is. returns self if the string has no '&'.
+ *	@return NSString object
+ */
 - (NSString *)stringByUnescapingFromHTML;
 @end
@@ -3,6 +3,8 @@
  * @brief NSString additions
  */
 #import "NSString+Tumblrful.m"
+#import "HTMLEntities.h"
+#import "KVPDictionary.h"
 
 NSString * EmptyString = @"";
 
@@ -16,125 +18,177 @@ NSString * EmptyString = @"";
 	return s;
 }
 
+/**
+ * URLエンコード時のバイト分類テーブル.
+ *	1 のバイト(RFC 3986 の unreserved: ALPHA / DIGIT / "-" / "." / "_" / "~")はそのまま出力し、
+ *	0 のバイトは "%XX" に置き換える。
+ *	stringByAddingPercentEscapesUsingEncoding: の後に予約文字を置換していた従来の出力と同じになる。
+ */
+static const unsigned char URL_UNRESERVED[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 0x00
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 0x10
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0,	// 0x20  - .
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,	// 0x30  0-9
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	// 0x40  A-O
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,	// 0x50  P-Z _
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	// 0x60  a-o
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0,	// 0x70  p-z ~
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 0x80
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 0xF0
+};
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+NSUInteger URLEncodedLength(const unsigned char * bytes, NSUInteger length)
+{
+	NSUInteger encoded = length;
+	for (NSUInteger i = 0; i < length; ++i) {
+		if (!URL_UNRESERVED[bytes[i]]) encoded += 2;
+	}
+	return encoded;
+}
+
+NSUInteger URLEncodeBytes(const unsigned char * bytes, NSUInteger length, char * out)
+{
+	char * dst = out;
+	for (NSUInteger i = 0; i < length; ++i) {
+		unsigned char const c = bytes[i];
+		if (URL_UNRESERVED[c]) {
+			*dst++ = (char)c;
+		}
+		else {
+			*dst++ = '%';
+			*dst++ = HEX_DIGITS[c >> 4];
+			*dst++ = HEX_DIGITS[c & 0x0F];
+		}
+	}
+	return (NSUInteger)(dst - out);
+}
+
 - (NSString *)stringByURLEncoding:(NSStringEncoding)encoding
 {
-	NSArray * escapes = [NSArray arrayWithObjects:@";", @"/", @"?", @":", @"@", @"&", @"=", @"+", @"$", @",", @"[", @"]", @"#", @"!", @"'", @"(", @")", @"*", nil];
-	NSArray * replaces = [NSArray arrayWithObjects:@"%3B", @"%2F", @"%3F",@"%3A", @"%40", @"%26", @"%3D", @"%2B", @"%24", @"%2C", @"%5B", @"%5D", @"%23", @"%21", @"%27",@"%28", @"%29", @"%2A", nil];
+	NSData * data = [self dataUsingEncoding:encoding allowLossyConversion:NO];
+	if (data == nil) return nil;
 
-	NSMutableString * encodedString = [[[self stringByAddingPercentEscapesUsingEncoding:encoding] mutableCopy] autorelease];
+	const unsigned char * src = (const unsigned char *)[data bytes];
+	NSUInteger const length = [data length];
+	if (length == 0) return EmptyString;
 
-	const NSUInteger N = [escapes count];
-	for (NSUInteger i = 0; i < N; i++) {
-		[encodedString replaceOccurrencesOfString:[escapes objectAtIndex:i]
-									   withString:[replaces objectAtIndex:i]
-										  options:NSLiteralSearch
-											range:NSMakeRange(0, [encodedString length])];
-	}
+	// 全バイトがエスケープされても収まるサイズを確保しておく
+	char * buffer = (char *)malloc(length * 3);
+	if (buffer == NULL) return nil;
 
-	return encodedString;
+	NSUInteger const encoded = URLEncodeBytes(src, length, buffer);
+	return [[[NSString alloc] initWithBytesNoCopy:buffer length:encoded encoding:NSASCIIStringEncoding freeWhenDone:YES] autorelease];
 }
 
-static NSString * ESCAPE_CHARS[] = {
-	@";",
-	@"/",
-	@"?",
-	@":",
-	@"@",
-	@"&",
-	@"=",
-	@"+",
-	@"$",
-	@",",
-	@"[",
-	@"]",
-	@"#",
-	@"!",
-	@"'",
-	@"(",
-	@")",
-	@"*"
-};
-static NSString * REPLACE_CHARS[] = {
-	@"%3B",
-	@"%2F",
-	@"%3F",
-	@"%3A",
-	@"%40",
-	@"%26",
-	@"%3D",
-	@"%2B",
-	@"%24",
-	@"%2C",
-	@"%5B",
-	@"%5D",
-	@"%23",
-	@"%21",
-	@"%27",
-	@"%28",
-	@"%29",
-	@"%2A"
-};
+/// 16進数字の値を返す。16進数字でなければ -1
+static inline int hexValue(unsigned char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
 
 - (NSString *)stringByURLDecoding:(NSStringEncoding)encoding
 {
-	NSArray * escapes = [NSArray arrayWithObjects:ESCAPE_CHARS count:sizeof(ESCAPE_CHARS) / sizeof(ESCAPE_CHARS[0])];
-	NSArray * replaces = [NSArray arrayWithObjects:REPLACE_CHARS count:sizeof(REPLACE_CHARS) / sizeof(REPLACE_CHARS[0])];
-
-	NSMutableString * decoded = [[[self stringByReplacingPercentEscapesUsingEncoding:encoding] mutableCopy] autorelease];
-
-	NSUInteger const N = [replaces count];
-	for (NSUInteger i = 0; i < N; i++) {
-		[decoded replaceOccurrencesOfString:[replaces objectAtIndex:i]
-								 withString:[escapes objectAtIndex:i]
-									options:NSLiteralSearch
-									  range:NSMakeRange(0, [decoded length])];
+	// '%' を含まなければデコードするものはない
+	if ([self rangeOfString:@"%" options:NSLiteralSearch].location == NSNotFound) return self;
+
+	NSMutableData * data = [[[self dataUsingEncoding:encoding allowLossyConversion:NO] mutableCopy] autorelease];
+	if (data == nil) return nil;
+
+	// デコード結果は元より長くならないので、同じバッファに前から詰めていく
+	unsigned char * bytes = (unsigned char *)[data mutableBytes];
+	NSUInteger const length = [data length];
+	NSUInteger j = 0;
+	for (NSUInteger i = 0; i < length; ++i) {
+		unsigned char const c = bytes[i];
+		if (c == '%' && i + 2 < length) {
+			int const hi = hexValue(bytes[i + 1]);
+			int const lo = hexValue(bytes[i + 2]);
+			if (hi >= 0 && lo >= 0) {
+				bytes[j++] = (unsigned char)((hi << 4) | lo);
+				i += 2;
+				continue;
+			}
+		}
+		bytes[j++] = c; // 不正なエスケープはそのまま残す
 	}
 
-	return decoded;
+	return [[[NSString alloc] initWithBytes:bytes length:j encoding:encoding] autorelease];
 }
 
 - (NSString *)stripHTMLTags:(NSArray *)excludes
 {
-	NSScanner * scanner;
-	NSString * text = nil;
-	NSString * tag = nil;
-	NSString * result = [self copy];
+	// '<' を含まなければタグはない
+	if ([self rangeOfString:@"<" options:NSLiteralSearch].location == NSNotFound) return self;
+
+	// 除外タグは小文字にしてハッシュで引く
+	NSMutableSet * excludeSet = nil;
+	if ([excludes count] > 0) {
+		excludeSet = [NSMutableSet setWithCapacity:[excludes count]];
+		NSEnumerator * enumerator = [excludes objectEnumerator];
+		for (NSString * tag; (tag = [enumerator nextObject]) != nil; ) {
+			[excludeSet addObject:[tag lowercaseString]];
+		}
+	}
 
-	scanner = [NSScanner scannerWithString:self];
+	// 出力は元より長くならないので、同じバッファに前から詰めていく
+	NSUInteger const length = [self length];
+	unichar * buffer = malloc(sizeof(unichar) * length);
+	if (buffer == NULL) return self;
+	[self getCharacters:buffer range:NSMakeRange(0, length)];
+
+	NSCharacterSet * whitespaces = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+	NSUInteger j = 0;
+	for (NSUInteger i = 0; i < length; ) {
+		if (buffer[i] != '<') {
+			buffer[j++] = buffer[i++];
+			continue;
+		}
+
+		NSUInteger close = i + 1;
+		while (close < length && buffer[close] != '>') ++close;
+		if (close == length) {
+			// 閉じていないタグは文字列としてそのまま残す
+			while (i < length) buffer[j++] = buffer[i++];
+			break;
+		}
 
-	while ([scanner isAtEnd] == NO) {
-		[scanner scanUpToString:@"<" intoString:nil];
-		[scanner scanUpToString:@">" intoString:&text];
+		BOOL strip = YES;
+		if (excludeSet != nil) {
+			NSUInteger begin = i + 1;
+			if (begin < close && buffer[begin] == '/') ++begin;
+			NSUInteger end = begin;
+			while (end < close && buffer[end] != '/' && ![whitespaces characterIsMember:buffer[end]]) ++end;
 
-		if ([text rangeOfString:@"</"].location != NSNotFound) {
-			tag = [text substringFromIndex:2]; // remove "</"
+			NSString * name = [[NSString alloc] initWithCharactersNoCopy:&buffer[begin] length:(end - begin) freeWhenDone:NO];
+			strip = ![excludeSet containsObject:[name lowercaseString]];
+			[name release];
+		}
+
+		if (strip) {
+			i = close + 1;
 		}
 		else {
-			tag = [text substringFromIndex:1]; // remove "<"
-			if ([tag rangeOfString:@" "].location != NSNotFound)
-				tag = [tag substringToIndex:[tag rangeOfString:@" "].location];
+			while (i <= close) buffer[j++] = buffer[i++];
 		}
-
-		if (excludes == nil || [excludes containsObject:tag] == NO)
-			result = [result stringByReplacingOccurrencesOfString:[NSString stringWithFormat:@"%@>", text] withString:@""];
 	}
-	return result;
+
+	return [[[NSString alloc] initWithCharactersNoCopy:buffer length:j freeWhenDone:YES] autorelease];
 }
 
 - (NSDictionary *)dictionaryWithKVPConnector:(NSString *)connector withSeparator:(NSString *)separator
 {
-	NSArray * separated = [self componentsSeparatedByString:separator];
-
-	NSInteger const count = [separated count];
-	NSMutableDictionary * dict = [NSMutableDictionary dictionaryWithCapacity:count];
-	for (NSInteger i = 0; i < count; i++) {
-		NSArray * kvp = [(NSString *)[separated objectAtIndex:i] componentsSeparatedByString:connector];
-		if ([kvp count] == 2) {
-			[dict setObject:[kvp objectAtIndex:1] forKey:[kvp objectAtIndex:0]];
-		}
-	}
-
-	return dict;
+	return [[[KVPDictionary alloc] initWithString:self connector:connector separator:separator] autorelease];
 }
 
 + (NSString *)stringWithKVPDictionary:(NSDictionary *)dictionary withConnector:(NSString *)connector withSeparator:(NSString *)separator withEncoding:(NSStringEncoding)encoding
@@ -158,364 +212,94 @@ static NSString * REPLACE_CHARS[] = {
 	return [self caseInsensitiveCompare:s] == NSOrderedSame;
 }
 
-typedef struct {
-	NSString *escapeSequence;
-	unichar uchar;
-} HTMLEscapeMap;
-
-// from http://www.w3.org/TR/xhtml1/dtds.html#a_dtd_Special_characters
-// バイナリサーチの為に文字コードの値の昇順に並べている
-static HTMLEscapeMap gAsciiHTMLEscapeMap[] =
+/**
+ * 数値文字参照の中身(&# と ; の間)を解釈する
+ *	@return コードポイント. 不正なら 0
+ */
+static UTF32Char parseNumericReference(const unichar * p, NSUInteger length)
 {
-	// A.2.2. Special characters
-	{ @"&quot;", 34 },
-	{ @"&amp;", 38 },
-	{ @"&apos;", 39 },
-	{ @"&lt;", 60 },
-	{ @"&gt;", 62 },
-
-		// A.2.1. Latin-1 characters
-	{ @"&nbsp;", 160 },
-	{ @"&iexcl;", 161 },
-	{ @"&cent;", 162 },
-	{ @"&pound;", 163 },
-	{ @"&curren;", 164 },
-	{ @"&yen;", 165 },
-	{ @"&brvbar;", 166 },
-	{ @"&sect;", 167 },
-	{ @"&uml;", 168 },
-	{ @"&copy;", 169 },
-	{ @"&ordf;", 170 },
-	{ @"&laquo;", 171 },
-	{ @"&not;", 172 },
-	{ @"&shy;", 173 },
-	{ @"&reg;", 174 },
-	{ @"&macr;", 175 },
-	{ @"&deg;", 176 },
-	{ @"&plusmn;", 177 },
-	{ @"&sup2;", 178 },
-	{ @"&sup3;", 179 },
-	{ @"&acute;", 180 },
-	{ @"&micro;", 181 },
-	{ @"&para;", 182 },
-	{ @"&middot;", 183 },
-	{ @"&cedil;", 184 },
-	{ @"&sup1;", 185 },
-	{ @"&ordm;", 186 },
-	{ @"&raquo;", 187 },
-	{ @"&frac14;", 188 },
-	{ @"&frac12;", 189 },
-	{ @"&frac34;", 190 },
-	{ @"&iquest;", 191 },
-	{ @"&Agrave;", 192 },
-	{ @"&Aacute;", 193 },
-	{ @"&Acirc;", 194 },
-	{ @"&Atilde;", 195 },
-	{ @"&Auml;", 196 },
-	{ @"&Aring;", 197 },
-	{ @"&AElig;", 198 },
-	{ @"&Ccedil;", 199 },
-	{ @"&Egrave;", 200 },
-	{ @"&Eacute;", 201 },
-	{ @"&Ecirc;", 202 },
-	{ @"&Euml;", 203 },
-	{ @"&Igrave;", 204 },
-	{ @"&Iacute;", 205 },
-	{ @"&Icirc;", 206 },
-	{ @"&Iuml;", 207 },
-	{ @"&ETH;", 208 },
-	{ @"&Ntilde;", 209 },
-	{ @"&Ograve;", 210 },
-	{ @"&Oacute;", 211 },
-	{ @"&Ocirc;", 212 },
-	{ @"&Otilde;", 213 },
-	{ @"&Ouml;", 214 },
-	{ @"&times;", 215 },
-	{ @"&Oslash;", 216 },
-	{ @"&Ugrave;", 217 },
-	{ @"&Uacute;", 218 },
-	{ @"&Ucirc;", 219 },
-	{ @"&Uuml;", 220 },
-	{ @"&Yacute;", 221 },
-	{ @"&THORN;", 222 },
-	{ @"&szlig;", 223 },
-	{ @"&agrave;", 224 },
-	{ @"&aacute;", 225 },
-	{ @"&acirc;", 226 },
-	{ @"&atilde;", 227 },
-	{ @"&auml;", 228 },
-	{ @"&aring;", 229 },
-	{ @"&aelig;", 230 },
-	{ @"&ccedil;", 231 },
-	{ @"&egrave;", 232 },
-	{ @"&eacute;", 233 },
-	{ @"&ecirc;", 234 },
-	{ @"&euml;", 235 },
-	{ @"&igrave;", 236 },
-	{ @"&iacute;", 237 },
-	{ @"&icirc;", 238 },
-	{ @"&iuml;", 239 },
-	{ @"&eth;", 240 },
-	{ @"&ntilde;", 241 },
-	{ @"&ograve;", 242 },
-	{ @"&oacute;", 243 },
-	{ @"&ocirc;", 244 },
-	{ @"&otilde;", 245 },
-	{ @"&ouml;", 246 },
-	{ @"&divide;", 247 },
-	{ @"&oslash;", 248 },
-	{ @"&ugrave;", 249 },
-	{ @"&uacute;", 250 },
-	{ @"&ucirc;", 251 },
-	{ @"&uuml;", 252 },
-	{ @"&yacute;", 253 },
-	{ @"&thorn;", 254 },
-	{ @"&yuml;", 255 },
-
-	// A.2.2. Special characters cont'd
-	{ @"&OElig;", 338 },
-	{ @"&oelig;", 339 },
-	{ @"&Scaron;", 352 },
-	{ @"&scaron;", 353 },
-	{ @"&Yuml;", 376 },
-
-	// A.2.3. Symbols
-	{ @"&fnof;", 402 },
-
-	// A.2.2. Special characters cont'd
-	{ @"&circ;", 710 },
-	{ @"&tilde;", 732 },
-
-	// A.2.3. Symbols cont'd
-	{ @"&Alpha;", 913 },
-	{ @"&Beta;", 914 },
-	{ @"&Gamma;", 915 },
-	{ @"&Delta;", 916 },
-	{ @"&Epsilon;", 917 },
-	{ @"&Zeta;", 918 },
-	{ @"&Eta;", 919 },
-	{ @"&Theta;", 920 },
-	{ @"&Iota;", 921 },
-	{ @"&Kappa;", 922 },
-	{ @"&Lambda;", 923 },
-	{ @"&Mu;", 924 },
-	{ @"&Nu;", 925 },
-	{ @"&Xi;", 926 },
-	{ @"&Omicron;", 927 },
-	{ @"&Pi;", 928 },
-	{ @"&Rho;", 929 },
-	{ @"&Sigma;", 931 },
-	{ @"&Tau;", 932 },
-	{ @"&Upsilon;", 933 },
-	{ @"&Phi;", 934 },
-	{ @"&Chi;", 935 },
-	{ @"&Psi;", 936 },
-	{ @"&Omega;", 937 },
-	{ @"&alpha;", 945 },
-	{ @"&beta;", 946 },
-	{ @"&gamma;", 947 },
-	{ @"&delta;", 948 },
-	{ @"&epsilon;", 949 },
-	{ @"&zeta;", 950 },
-	{ @"&eta;", 951 },
-	{ @"&theta;", 952 },
-	{ @"&iota;", 953 },
-	{ @"&kappa;", 954 },
-	{ @"&lambda;", 955 },
-	{ @"&mu;", 956 },
-	{ @"&nu;", 957 },
-	{ @"&xi;", 958 },
-	{ @"&omicron;", 959 },
-	{ @"&pi;", 960 },
-	{ @"&rho;", 961 },
-	{ @"&sigmaf;", 962 },
-	{ @"&sigma;", 963 },
-	{ @"&tau;", 964 },
-	{ @"&upsilon;", 965 },
-	{ @"&phi;", 966 },
-	{ @"&chi;", 967 },
-	{ @"&psi;", 968 },
-	{ @"&omega;", 969 },
-	{ @"&thetasym;", 977 },
-	{ @"&upsih;", 978 },
-	{ @"&piv;", 982 },
-
-	// A.2.2. Special characters cont'd
-	{ @"&ensp;", 8194 },
-	{ @"&emsp;", 8195 },
-	{ @"&thinsp;", 8201 },
-	{ @"&zwnj;", 8204 },
-	{ @"&zwj;", 8205 },
-	{ @"&lrm;", 8206 },
-	{ @"&rlm;", 8207 },
-	{ @"&ndash;", 8211 },
-	{ @"&mdash;", 8212 },
-	{ @"&lsquo;", 8216 },
-	{ @"&rsquo;", 8217 },
-	{ @"&sbquo;", 8218 },
-	{ @"&ldquo;", 8220 },
-	{ @"&rdquo;", 8221 },
-	{ @"&bdquo;", 8222 },
-	{ @"&dagger;", 8224 },
-	{ @"&Dagger;", 8225 },
-		// A.2.3. Symbols cont'd
-	{ @"&bull;", 8226 },
-	{ @"&hellip;", 8230 },
-
-	// A.2.2. Special characters cont'd
-	{ @"&permil;", 8240 },
-
-	// A.2.3. Symbols cont'd
-	{ @"&prime;", 8242 },
-	{ @"&Prime;", 8243 },
-
-	// A.2.2. Special characters cont'd
-	{ @"&lsaquo;", 8249 },
-	{ @"&rsaquo;", 8250 },
-
-	// A.2.3. Symbols cont'd
-	{ @"&oline;", 8254 },
-	{ @"&frasl;", 8260 },
-
-	// A.2.2. Special characters cont'd
-	{ @"&euro;", 8364 },
-
-	// A.2.3. Symbols cont'd
-	{ @"&image;", 8465 },
-	{ @"&weierp;", 8472 },
-	{ @"&real;", 8476 },
-	{ @"&trade;", 8482 },
-	{ @"&alefsym;", 8501 },
-	{ @"&larr;", 8592 },
-	{ @"&uarr;", 8593 },
-	{ @"&rarr;", 8594 },
-	{ @"&darr;", 8595 },
-	{ @"&harr;", 8596 },
-	{ @"&crarr;", 8629 },
-	{ @"&lArr;", 8656 },
-	{ @"&uArr;", 8657 },
-	{ @"&rArr;", 8658 },
-	{ @"&dArr;", 8659 },
-	{ @"&hArr;", 8660 },
-	{ @"&forall;", 8704 },
-	{ @"&part;", 8706 },
-	{ @"&exist;", 8707 },
-	{ @"&empty;", 8709 },
-	{ @"&nabla;", 8711 },
-	{ @"&isin;", 8712 },
-	{ @"&notin;", 8713 },
-	{ @"&ni;", 8715 },
-	{ @"&prod;", 8719 },
-	{ @"&sum;", 8721 },
-	{ @"&minus;", 8722 },
-	{ @"&lowast;", 8727 },
-	{ @"&radic;", 8730 },
-	{ @"&prop;", 8733 },
-	{ @"&infin;", 8734 },
-	{ @"&ang;", 8736 },
-	{ @"&and;", 8743 },
-	{ @"&or;", 8744 },
-	{ @"&cap;", 8745 },
-	{ @"&cup;", 8746 },
-	{ @"&int;", 8747 },
-	{ @"&there4;", 8756 },
-	{ @"&sim;", 8764 },
-	{ @"&cong;", 8773 },
-	{ @"&asymp;", 8776 },
-	{ @"&ne;", 8800 },
-	{ @"&equiv;", 8801 },
-	{ @"&le;", 8804 },
-	{ @"&ge;", 8805 },
-	{ @"&sub;", 8834 },
-	{ @"&sup;", 8835 },
-	{ @"&nsub;", 8836 },
-	{ @"&sube;", 8838 },
-	{ @"&supe;", 8839 },
-	{ @"&oplus;", 8853 },
-	{ @"&otimes;", 8855 },
-	{ @"&perp;", 8869 },
-	{ @"&sdot;", 8901 },
-	{ @"&lceil;", 8968 },
-	{ @"&rceil;", 8969 },
-	{ @"&lfloor;", 8970 },
-	{ @"&rfloor;", 8971 },
-	{ @"&lang;", 9001 },
-	{ @"&rang;", 9002 },
-	{ @"&loz;", 9674 },
-	{ @"&spades;", 9824 },
-	{ @"&clubs;", 9827 },
-	{ @"&hearts;", 9829 },
-	{ @"&diams;", 9830 }
-};
+	BOOL hex = NO;
+	if (length > 0 && (p[0] == 'x' || p[0] == 'X')) {
+		hex = YES;
+		++p, --length;
+	}
+	if (length == 0) return 0;
+
+	UTF32Char value = 0;
+	for (NSUInteger i = 0; i < length; ++i) {
+		unichar c = p[i];
+		int digit;
+		if (c >= '0' && c <= '9')							digit = c - '0';
+		else if (hex && c >= 'a' && c <= 'f')				digit = c - 'a' + 10;
+		else if (hex && c >= 'A' && c <= 'F')				digit = c - 'A' + 10;
+		else												return 0;
+		value = value * (hex ? 16 : 10) + (UTF32Char)digit;
+		if (value > 0x10FFFF) return 0;
+	}
+	// サロゲートの値そのものは文字ではない
+	if (value >= 0xD800 && value <= 0xDFFF) return 0;
+	return value;
+}
 
 - (NSString *)stringByUnescapingFromHTML
 {
-	NSRange range = NSMakeRange(0, [self length]);
-	NSRange subrange = [self rangeOfString:@"&" options:NSBackwardsSearch range:range];
-
 	// if no ampersands, we've got a quick way out
-	if (subrange.length == 0) return self;
-
-	NSMutableString *finalString = [NSMutableString stringWithString:self];
-
-	do {
-		NSRange semiColonRange = NSMakeRange(subrange.location, NSMaxRange(range) - subrange.location);
-		semiColonRange = [self rangeOfString:@";" options:0 range:semiColonRange];
-		range = NSMakeRange(0, subrange.location);
-		// if we don't find a semicolon in the range, we don't have a sequence
-		if (semiColonRange.location == NSNotFound) {
+	if ([self rangeOfString:@"&" options:NSLiteralSearch].location == NSNotFound) return self;
+
+	// 展開後の文字数は必ず元の参照より短いので、同じバッファの上で前から詰めていく
+	NSUInteger length = [self length];
+	unichar * buffer = malloc(sizeof(unichar) * length);
+	if (buffer == NULL) return self;
+	[self getCharacters:buffer range:NSMakeRange(0, length)];
+
+	NSUInteger j = 0;
+	for (NSUInteger i = 0; i < length; ) {
+		unichar c = buffer[i];
+		if (c != '&') {
+			buffer[j++] = c;
+			++i;
 			continue;
 		}
-		NSRange escapeRange = NSMakeRange(subrange.location, semiColonRange.location - subrange.location + 1);
-		NSString *escapeString = [self substringWithRange:escapeRange];
-		NSUInteger length = [escapeString length];
-		// a squence must be longer than 3 (&lt;) and less than 11 (&thetasym;)
-		if (length > 3 && length < 11) {
-			if ([escapeString characterAtIndex:1] == '#') {
-				unichar char2 = [escapeString characterAtIndex:2];
-				if (char2 == 'x' || char2 == 'X') {
-					// Hex escape squences &#xa3;
-					NSString *hexSequence = [escapeString substringWithRange:NSMakeRange(3, length - 4)];
-					NSScanner *scanner = [NSScanner scannerWithString:hexSequence];
-					unsigned value;
-					if ([scanner scanHexInt:&value] &&
-							value < USHRT_MAX &&
-							value > 0
-							&& [scanner scanLocation] == length - 4) {
-						unichar uchar = value;
-						NSString *charString = [NSString stringWithCharacters:&uchar length:1];
-						[finalString replaceCharactersInRange:escapeRange withString:charString];
-					}
 
+		// 対応する ';' を探す. 途中に '&' があれば参照ではない
+		NSUInteger limit = MIN(length, i + 2 + HTML_ENTITY_NAME_MAX);
+		NSUInteger semicolon = i + 1;
+		while (semicolon < limit && buffer[semicolon] != ';' && buffer[semicolon] != '&') ++semicolon;
+
+		NSUInteger count = 0;
+		unichar chars[2];
+		if (semicolon < limit && buffer[semicolon] == ';') {
+			const unichar * name = &buffer[i + 1];
+			NSUInteger nameLength = semicolon - i - 1;
+			if (nameLength > 0 && name[0] == '#') {
+				UTF32Char value = parseNumericReference(name + 1, nameLength - 1);
+				if (value > 0xFFFF) {
+					value -= 0x10000;
+					chars[0] = (unichar)(0xD800 + (value >> 10));
+					chars[1] = (unichar)(0xDC00 + (value & 0x3FF));
+					count = 2;
 				}
-				else {
-					// Decimal Sequences &#123;
-					NSString *numberSequence = [escapeString substringWithRange:NSMakeRange(2, length - 3)];
-					NSScanner *scanner = [NSScanner scannerWithString:numberSequence];
-					int value;
-					if ([scanner scanInt:&value] &&
-							value < USHRT_MAX &&
-							value > 0
-							&& [scanner scanLocation] == length - 3) {
-						unichar uchar = value;
-						NSString *charString = [NSString stringWithCharacters:&uchar length:1];
-						[finalString replaceCharactersInRange:escapeRange withString:charString];
-					}
+				else if (value > 0) {
+					chars[0] = (unichar)value;
+					count = 1;
 				}
 			}
 			else {
-				// "standard" sequences
-				for (unsigned i = 0; i < sizeof(gAsciiHTMLEscapeMap) / sizeof(HTMLEscapeMap); ++i) {
-					if ([escapeString isEqualToString:gAsciiHTMLEscapeMap[i].escapeSequence]) {
-						[finalString replaceCharactersInRange:escapeRange withString:[NSString stringWithCharacters:&gAsciiHTMLEscapeMap[i].uchar length:1]];
-						break;
-					}
-				}
+				count = HTMLEntityLookup(name, nameLength, chars);
 			}
 		}
+
+		if (count > 0) {
+			for (NSUInteger k = 0; k < count; ++k) buffer[j++] = chars[k];
+			i = semicolon + 1;
+		}
+		else {
+			// 参照として解釈できなければ '&' をそのまま残す
+			buffer[j++] = c;
+			++i;
+		}
 	}
-	while ((subrange = [self rangeOfString:@"&" options:NSBackwardsSearch range:range]).length != 0);
 
-	return finalString;
+	return [[[NSString alloc] initWithCharactersNoCopy:buffer length:j freeWhenDone:YES] autorelease];
 }
 @end
@@ -0,0 +1,50 @@
+/**
+ * @file PayloadCache.h
+ * @brief PayloadCache class declaration
+ */
+#import <Cocoa/Cocoa.h>
+#import "Anchor.h"
+
+@class ImageEncoder;
+
+/**
+ * 1回のポスト操作の中で、複数の PostAdaptor が共有する派生データのキャッシュ
+ *	DelivererBase がアクションごとに1つ作って、選択された全アダプタに渡す.
+ *	エンコード済みの画像、タグを除いたキャプション、キャプションから作った Anchor を一度だけ計算する.
+ *	返すオブジェクトは共有されるので、受け取った側で変更しないこと.
+ *	エンコードはバックグラウンドスレッドから呼ばれるので、すべてのメソッドはスレッドセーフ.
+ */
+@interface PayloadCache : NSObject
+{
+	NSMutableDictionary * entries_;
+}
+
+/**
+ * NSImage のビットマップ(画像オブジェクトごと)
+ *	@param[in] image	画像
+ *	@return NSBitmapImageRep object
+ */
+- (NSBitmapImageRep *)bitmapImageRepForImage:(NSImage *)image;
+
+/**
+ * エンコード済みの画像データ(ビットマップとエンコーダのポリシーごと)
+ *	@param[in] imageRep	ビットマップ
+ *	@param[in] encoder	エンコーダ
+ *	@return エンコードしたデータ
+ */
+- (NSData *)encodedDataForBitmapImageRep:(NSBitmapImageRep *)imageRep encoder:(ImageEncoder *)encoder;
+
+/**
+ * HTMLタグを除いた文字列(文字列の内容ごと)
+ *	@param[in] html	HTML
+ *	@return NSString object
+ */
+- (NSString *)strippedHTML:(NSString *)html;
+
+/**
+ * HTMLから作った Anchor(文字列の内容ごと)
+ *	@param[in] html	HTML
+ *	@return Anchor object
+ */
+- (Anchor *)anchorWithHTML:(NSString *)html;
+@end
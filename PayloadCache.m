@@ -0,0 +1,117 @@
+/**
+ * @file PayloadCache.m
+ * @brief PayloadCache class implementation
+ */
+#import "PayloadCache.h"
+#import "ImageEncoder.h"
+#import "NSString+Tumblrful.h"
+#import "DebugLog.h"
+
+@interface PayloadCache ()
+- (id)objectForKind:(NSString *)kind key:(id)key;
+- (void)setObject:(id)object forKind:(NSString *)kind key:(id)key;
+@end
+
+@implementation PayloadCache
+
+- (id)init
+{
+	if ((self = [super init]) != nil) {
+		entries_ = [[NSMutableDictionary alloc] init];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[entries_ release], entries_ = nil;
+	[super dealloc];
+}
+
+/**
+ * 画像はオブジェクトの同一性で、文字列は内容で引く.
+ *	同一性で引くものは元のオブジェクトも保持して、アドレスが再利用されないようにする.
+ */
+- (id)objectForKind:(NSString *)kind key:(id)key
+{
+	@synchronized (self) {
+		return [[[[entries_ objectForKey:kind] objectForKey:key] retain] autorelease];
+	}
+}
+
+- (void)setObject:(id)object forKind:(NSString *)kind key:(id)key
+{
+	if (object == nil) return;
+
+	@synchronized (self) {
+		NSMutableDictionary * entries = [entries_ objectForKey:kind];
+		if (entries == nil) {
+			entries = [NSMutableDictionary dictionary];
+			[entries_ setObject:entries forKey:kind];
+		}
+		[entries setObject:object forKey:key];
+	}
+}
+
+- (NSBitmapImageRep *)bitmapImageRepForImage:(NSImage *)image
+{
+	if (image == nil) return nil;
+
+	NSValue * key = [NSValue valueWithNonretainedObject:image];
+	NSArray * entry = [self objectForKind:@"bitmap" key:key];
+	if (entry == nil) {
+		NSBitmapImageRep * imageRep = [ImageEncoder bitmapImageRepForImage:image];
+		if (imageRep == nil) return nil;
+		entry = [NSArray arrayWithObjects:imageRep, image, nil];
+		[self setObject:entry forKind:@"bitmap" key:key];
+	}
+	return [entry objectAtIndex:0];
+}
+
+- (NSData *)encodedDataForBitmapImageRep:(NSBitmapImageRep *)imageRep encoder:(ImageEncoder *)encoder
+{
+	if (imageRep == nil) return nil;
+
+	NSString * key = [NSString stringWithFormat:@"%p:%f:%lu", imageRep, encoder.quality, (unsigned long)encoder.maxDimension];
+	NSArray * entry;
+
+	// 同じ画像を別々のスレッドで同時にエンコードしないように、エンコードも排他する
+	@synchronized (imageRep) {
+		entry = [self objectForKind:@"encoded" key:key];
+		if (entry == nil) {
+			NSData * data = [encoder encodeBitmapImageRep:imageRep];
+			if (data == nil) return nil;
+			entry = [NSArray arrayWithObjects:data, imageRep, nil];
+			[self setObject:entry forKind:@"encoded" key:key];
+		}
+		else {
+			D(@"hit: %@", key);
+		}
+	}
+	return [entry objectAtIndex:0];
+}
+
+- (NSString *)strippedHTML:(NSString *)html
+{
+	if (html == nil) return nil;
+
+	NSString * stripped = [self objectForKind:@"stripped" key:html];
+	if (stripped == nil) {
+		stripped = [html stripHTMLTags:nil];
+		[self setObject:stripped forKind:@"stripped" key:html];
+	}
+	return stripped;
+}
+
+- (Anchor *)anchorWithHTML:(NSString *)html
+{
+	if (html == nil) return nil;
+
+	Anchor * anchor = [self objectForKind:@"anchor" key:html];
+	if (anchor == nil) {
+		anchor = [Anchor anchorWithHTML:html];
+		[self setObject:anchor forKind:@"anchor" key:html];
+	}
+	return anchor;
+}
+@end
@@ -8,6 +8,7 @@
 #import "Anchor.h"
 #import "PostType.h"
 #import "PostCallback.h"
+#import "PayloadCache.h"
 #import <Foundation/Foundation.h>
 
 /**
@@ -20,6 +21,7 @@
 	BOOL queuingEnabled_;
 	BOOL extractEnabled_;
 	NSDictionary * options_;
+	PayloadCache * payload_;
 }
 
 /// コールバックオブジェクト
@@ -37,6 +39,9 @@
 /// Options for subclass - TODO 上の３つもサブクラスに入れるかなぁ
 @property (nonatomic, retain) NSDictionary * options;
 
+/// 同じポスト操作の他のアダプタと共有する派生データ. 設定されていなければ自分専用のものを作る
+@property (nonatomic, retain) PayloadCache * payload;
+
 /**
  * Initialize object
  *	@param[in] callback PostCallback object
@@ -14,6 +14,7 @@
 @synthesize queuingEnabled = queuingEnabled_;
 @synthesize extractEnabled = extractEnabled_;
 @synthesize options = options_;
+@synthesize payload = payload_;
 
 + (NSString *)titleForMenuItem
 {
@@ -41,10 +42,19 @@
 {
 	[callback_ release], callback_ = nil;
 	[options_ release], options_ = nil;
+	[payload_ release], payload_ = nil;
 
 	[super dealloc];
 }
 
+- (PayloadCache *)payload
+{
+	if (payload_ == nil) {
+		payload_ = [[PayloadCache alloc] init];
+	}
+	return payload_;
+}
+
 - (void)callbackWith:(NSString *)response
 {
 	if (callback_ != nil) [callback_ successed:response];
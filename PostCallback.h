@@ -14,4 +14,12 @@
 
 - (void)failedWithException:(NSException *)exception;
 
+@optional
+
+/**
+ * 送信に失敗したが、PostQueue が後で送り直す. 最終的な結果は後で successed: などで届く
+ *	@param[in] error	送り直すことになった原因
+ */
+- (void)deferredWithError:(NSError *)error;
+
 @end
@@ -0,0 +1,96 @@
+/**
+ * @file PostGroup.h
+ * @brief PostGroup class declaration
+ */
+#import "PostCallback.h"
+
+@class PostGroup;
+
+/**
+ * PostGroup の完了を受け取る
+ */
+@protocol PostGroupDelegate <NSObject>
+/**
+ * 全サービスの結果が揃った(またはタイムアウトした)
+ *	@param[in] group	完了したグループ
+ */
+- (void)postGroupCompleted:(PostGroup *)group;
+@end
+
+/**
+ * サービスごとの結果
+ */
+@interface PostGroupResult : NSObject
+{
+	NSString * name_;
+	NSDate * start_;
+	NSTimeInterval latency_;
+	BOOL finished_;
+	BOOL deferred_;
+	BOOL succeeded_;
+	id outcome_;	///< response(NSString), NSError, NSException のいずれか
+}
+
+/// サービス名
+@property (nonatomic, readonly) NSString * name;
+
+/// ポスト開始から結果までの秒数
+@property (nonatomic, readonly) NSTimeInterval latency;
+
+/// 結果が返ってきたか
+@property (nonatomic, readonly) BOOL finished;
+
+/// 結果が返る前に PostQueue が預かって送り直しているか. 本当の結果は後で Growl に出る
+@property (nonatomic, readonly) BOOL deferred;
+
+/// 成功したか
+@property (nonatomic, readonly) BOOL succeeded;
+
+/// 結果. response(NSString), NSError, NSException のいずれか. 送り直し中ならその原因の NSError, タイムアウトなら TUMBLRFUL_ERROR_DOMAIN の NSError
+@property (nonatomic, readonly) id outcome;
+
+/**
+ * 人が読む1行の要約
+ *	@return "Tumblr: OK (0.82 sec)" のような文字列
+ */
+- (NSString *)summary;
+@end
+
+/**
+ * 複数のサービスへ同時に行うポストを1つにまとめる
+ *	サービスごとに memberForAdaptorClass: で PostCallback を払い出し、
+ *	全部の結果が揃ったら delegate に一度だけ通知する.
+ *	PostQueue が送り直すことになったサービスとタイムアウトしたサービスは揃ったものとして扱い、
+ *	後から届いた本当の結果は Growl で知らせる.
+ */
+@interface PostGroup : NSObject
+{
+	NSObject<PostGroupDelegate> * delegate_;
+	NSMutableArray * members_;
+	NSMutableArray * results_;
+	NSUInteger pending_;
+	BOOL sealed_;
+	BOOL completed_;
+}
+
+/// サービスごとの結果(払い出した順)
+@property (nonatomic, readonly) NSArray * results;
+
+/**
+ * 初期化する. 完了するまで delegate を保持する
+ *	@param[in] delegate	完了の通知先
+ */
+- (id)initWithDelegate:(NSObject<PostGroupDelegate> *)delegate;
+
+/**
+ * サービス1つ分のコールバックを払い出す
+ *	@param[in] adaptorClass	PostAdaptor のクラス
+ *	@return PostCallback object
+ */
+- (NSObject<PostCallback> *)memberForAdaptorClass:(Class)adaptorClass;
+
+/**
+ * 払い出しを終える. 以降、全部の結果が揃った時点で完了する
+ */
+- (void)seal;
+@end
@@ -0,0 +1,261 @@
+/**
+ * @file PostGroup.m
+ * @brief PostGroup class implementation
+ */
+#import "PostGroup.h"
+#import "PostAdaptor.h"
+#import "NSString+Tumblrful.h"
+#import "TumblrfulConstants.h"
+#import "GrowlSupport.h"
+#import "DebugLog.h"
+
+/// 結果を待つ最長の秒数. 通信のタイムアウト(60秒)に余裕を持たせる
+static NSTimeInterval GROUP_TIMEOUT = 120.0;
+
+#pragma mark -
+@interface PostGroupResult ()
+- (id)initWithName:(NSString *)name;
+- (BOOL)finishWithSuccess:(BOOL)succeeded outcome:(id)outcome;
+- (BOOL)deferWithError:(NSError *)error;
+- (void)expireWithError:(NSError *)error;
+@end
+
+@implementation PostGroupResult
+
+@synthesize name = name_;
+@synthesize latency = latency_;
+@synthesize finished = finished_;
+@synthesize deferred = deferred_;
+@synthesize succeeded = succeeded_;
+@synthesize outcome = outcome_;
+
+- (id)initWithName:(NSString *)name
+{
+	if ((self = [super init]) != nil) {
+		name_ = [name copy];
+		start_ = [[NSDate alloc] init];
+		latency_ = 0;
+		finished_ = NO;
+		deferred_ = NO;
+		succeeded_ = NO;
+		outcome_ = nil;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[name_ release], name_ = nil;
+	[start_ release], start_ = nil;
+	[outcome_ release], outcome_ = nil;
+	[super dealloc];
+}
+
+- (BOOL)finishWithSuccess:(BOOL)succeeded outcome:(id)outcome
+{
+	if (finished_) return NO;
+
+	finished_ = YES;
+	succeeded_ = succeeded;
+	[outcome_ release], outcome_ = [outcome retain];
+	latency_ = -[start_ timeIntervalSinceNow];
+	return YES;
+}
+
+- (BOOL)deferWithError:(NSError *)error
+{
+	if (finished_ || deferred_) return NO;
+
+	deferred_ = YES;
+	[outcome_ release], outcome_ = [error retain];
+	latency_ = -[start_ timeIntervalSinceNow];
+	return YES;
+}
+
+/// 結果を待つのをやめる. 後から本当の結果が来れば finishWithSuccess:outcome: で上書きする
+- (void)expireWithError:(NSError *)error
+{
+	if (finished_ || deferred_) return;
+
+	[outcome_ release], outcome_ = [error retain];
+	latency_ = -[start_ timeIntervalSinceNow];
+}
+
+- (NSString *)summary
+{
+	NSString * reason = @"";
+	if ([outcome_ isKindOfClass:[NSError class]])			reason = [(NSError *)outcome_ localizedDescription];
+	else if ([outcome_ isKindOfClass:[NSException class]])	reason = [(NSException *)outcome_ reason];
+
+	if (!finished_ && deferred_) return [NSString stringWithFormat:@"%@: queued, will retry %@", name_, Stringnize(reason)];
+	if (!finished_ && outcome_ == nil) return [NSString stringWithFormat:@"%@: no response", name_];
+	if (succeeded_) return [NSString stringWithFormat:@"%@: OK (%.2f sec)", name_, latency_];
+	return [NSString stringWithFormat:@"%@: failed %@ (%.2f sec)", name_, Stringnize(reason), latency_];
+}
+@end
+
+#pragma mark -
+/**
+ * サービス1つ分のコールバック. 結果を PostGroup へ渡す
+ */
+@interface PostGroupMember : NSObject<PostCallback>
+{
+	PostGroup * group_;
+	PostGroupResult * result_;
+}
+- (id)initWithGroup:(PostGroup *)group result:(PostGroupResult *)result;
+@end
+
+@interface PostGroup ()
+- (void)member:(PostGroupResult *)result finishedWithSuccess:(BOOL)succeeded outcome:(id)outcome;
+- (void)member:(PostGroupResult *)result deferredWithError:(NSError *)error;
+- (void)completeIfDone;
+- (void)expire;
+@end
+
+@implementation PostGroupMember
+
+- (id)initWithGroup:(PostGroup *)group result:(PostGroupResult *)result
+{
+	if ((self = [super init]) != nil) {
+		group_ = [group retain];
+		result_ = [result retain];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[group_ release], group_ = nil;
+	[result_ release], result_ = nil;
+	[super dealloc];
+}
+
+- (void)successed:(NSString *)response
+{
+	[group_ member:result_ finishedWithSuccess:YES outcome:response];
+}
+
+- (void)failedWithError:(NSError *)error
+{
+	[group_ member:result_ finishedWithSuccess:NO outcome:error];
+}
+
+- (void)failedWithException:(NSException *)exception
+{
+	[group_ member:result_ finishedWithSuccess:NO outcome:exception];
+}
+
+- (void)deferredWithError:(NSError *)error
+{
+	[group_ member:result_ deferredWithError:error];
+}
+@end
+
+#pragma mark -
+@implementation PostGroup
+
+@synthesize results = results_;
+
+- (id)initWithDelegate:(NSObject<PostGroupDelegate> *)delegate
+{
+	if ((self = [super init]) != nil) {
+		delegate_ = [delegate retain];
+		members_ = [[NSMutableArray alloc] init];
+		results_ = [[NSMutableArray alloc] init];
+		pending_ = 0;
+		sealed_ = NO;
+		completed_ = NO;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[delegate_ release], delegate_ = nil;
+	[members_ release], members_ = nil;
+	[results_ release], results_ = nil;
+	[super dealloc];
+}
+
+- (NSObject<PostCallback> *)memberForAdaptorClass:(Class)adaptorClass
+{
+	NSString * name = [adaptorClass titleForMenuItem];
+	if (name == nil) {
+		name = [NSStringFromClass(adaptorClass) stringByReplacingOccurrencesOfString:@"PostAdaptor" withString:@""];
+	}
+
+	PostGroupResult * result = [[[PostGroupResult alloc] initWithName:name] autorelease];
+	PostGroupMember * member = [[[PostGroupMember alloc] initWithGroup:self result:result] autorelease];
+	[results_ addObject:result];
+	[members_ addObject:member];
+	++pending_;
+	return member;
+}
+
+- (void)seal
+{
+	sealed_ = YES;
+	if (pending_ > 0) {
+		// 結果を返さないサービスがあっても、いずれは完了させる
+		[self performSelector:@selector(expire) withObject:nil afterDelay:GROUP_TIMEOUT];
+	}
+	[self completeIfDone];
+}
+
+- (void)member:(PostGroupResult *)result finishedWithSuccess:(BOOL)succeeded outcome:(id)outcome
+{
+	BOOL const deferred = result.deferred;	// 送り直しを知らせた時に揃ったものとして数えている
+	if (![result finishWithSuccess:succeeded outcome:outcome]) return;
+
+	D(@"%@", [result summary]);
+	if (completed_) {
+		// タイムアウトや送り直しで先に完了を知らせた後の本当の結果. 知らせる相手がいないので Growl に出す
+		[GrowlSupport notifyWithTitle:@"Tumblrful" description:[result summary]];
+		return;
+	}
+	if (deferred) return;
+	--pending_;
+	[self completeIfDone];
+}
+
+/// PostQueue が送り直すことになったサービスは、待ち行列に預けたものとして結果を揃える
+- (void)member:(PostGroupResult *)result deferredWithError:(NSError *)error
+{
+	if (completed_ || ![result deferWithError:error]) return;
+
+	D(@"%@", [result summary]);
+	--pending_;
+	[self completeIfDone];
+}
+
+- (void)completeIfDone
+{
+	if (completed_ || !sealed_ || pending_ > 0) return;
+
+	completed_ = YES;
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(expire) object:nil];
+
+	// delegate への通知中に解放されないようにしておく
+	[[self retain] autorelease];
+	[delegate_ postGroupCompleted:self];
+
+	// member が group を保持しているので、ここで循環を断つ
+	[members_ removeAllObjects];
+	[delegate_ release], delegate_ = nil;
+}
+
+- (void)expire
+{
+	D(@"timeout. pending=%lu", (unsigned long)pending_);
+
+	// 結果が返ってこなかったサービスはタイムアウトの NSError で失敗にする
+	NSString * description = [NSString stringWithFormat:@"No response within %.0f seconds", GROUP_TIMEOUT];
+	NSError * error = [NSError errorWithDomain:TUMBLRFUL_ERROR_DOMAIN code:NSURLErrorTimedOut userInfo:[NSDictionary dictionaryWithObject:description forKey:NSLocalizedDescriptionKey]];
+	for (PostGroupResult * result in results_) {
+		[result expireWithError:error];
+	}
+	pending_ = 0;
+	[self completeIfDone];
+}
+@end
@@ -0,0 +1,67 @@
+/**
+ * @file PostQueue.h
+ * @brief PostQueue class declaration
+ */
+#import "Post.h"
+
+/// 待ち行列の状態が変わった時に main thread で送る通知. userInfo は PostQueueEventKey などを持つ
+extern NSString * PostQueueDidChangeNotification;
+
+/// 通知の userInfo: 何が起きたか(PostQueueEventEnqueued など)
+extern NSString * PostQueueEventKey;
+
+/// 通知の userInfo: 対象のポストの識別子
+extern NSString * PostQueueIdentifierKey;
+
+/// 通知の userInfo: 残りの件数(NSNumber)
+extern NSString * PostQueuePendingCountKey;
+
+extern NSString * PostQueueEventEnqueued;	///< 受け付けてジャーナルに書いた
+extern NSString * PostQueueEventSent;		///< 送信に成功した
+extern NSString * PostQueueEventRetrying;	///< 失敗したので待ってから送り直す
+extern NSString * PostQueueEventFailed;		///< 送り直しをあきらめた, または送り直しても無駄な失敗
+extern NSString * PostQueueEventOffline;	///< ネットワークが無いので止めた
+extern NSString * PostQueueEventOnline;		///< ネットワークが戻ったので再開した
+
+/**
+ * 送信待ちのポストをディスクに残しながら送る待ち行列
+ *	受け付けたポストは追記専用のジャーナル(~/Library/Application Support/Tumblrful/Outbox)に書いてから送る.
+ *	大きな NSData の値(写真など)はジャーナルとは別のファイルに書き、ジャーナルにはファイル名だけを残す.
+ *	サーバに届かなかった通信エラーは間隔を倍にしながら送り直し、ネットワークが無い間は止めておく.
+ *	送り直す間は callback の deferredWithError: で知らせ、最終的な結果は後で届ける.
+ *	Safari が落ちても、次に起動した時に残っていたものから送り直す.
+ *	ただし送信中に落ちたものは届いたかどうか分からないので、送り直さずに Growl で知らせるだけにする.
+ *
+ *	資格情報はジャーナルに書かない. 送る直前に Post の createMinimumRequestParams で足す.
+ *	ジャーナルの読み書きは専用のスレッドで行い、状態の変更と送信は main thread で行う.
+ */
+@interface PostQueue : NSObject
+{
+	NSString * directory_;
+	NSString * journalPath_;
+	NSOperationQueue * ioQueue_;
+	NSMutableArray * items_;		///< 送信待ち(送信中, 再試行待ちを含む)
+	NSMutableArray * parked_;		///< オフラインで止めているもの
+	BOOL offline_;
+	NSUInteger offlineProbes_;
+	BOOL replayed_;					///< 起動時のジャーナルを読み終えた
+}
+
+/// 送信待ちの件数
+@property (nonatomic, readonly) NSUInteger pendingCount;
+
+/// ネットワークが無いとみなして止めているか
+@property (nonatomic, readonly) BOOL offline;
+
++ (PostQueue *)sharedQueue;
+
+/**
+ * ポストを受け付ける. ジャーナルへの書き込みが終わったら送信する
+ *	@param[in] postClass	Post プロトコルを実装するクラス
+ *	@param[in] params	サービス固有のパラメータ. createMinimumRequestParams の分は含めない
+ *	@param[in] options	送る前に Post オブジェクトに KVC で設定する値(nil 可)
+ *	@param[in] callback	最終的な結果の通知先(nil 可). 再起動をまたいだものは Growl で通知する
+ *	@return 識別子
+ */
+- (NSString *)enqueuePostClass:(Class)postClass params:(NSDictionary *)params options:(NSDictionary *)options callback:(NSObject<PostCallback> *)callback;
+@end
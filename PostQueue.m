@@ -0,0 +1,764 @@
+/**
+ * @file PostQueue.m
+ * @brief PostQueue class implementation
+ *
+ * ジャーナルの形式: レコードを追記していくだけのファイル.
+ *	1レコード = 4バイトの長さ(ビッグエンディアン) + binary plist の辞書.
+ *	辞書の "op" が "add" なら受け付けたポスト, "done" なら終わったポスト("id" だけを持つ).
+ *	"sending" は送信を始める直前に書き、サーバに届かなかったと分かった失敗では "unsent" で打ち消す.
+ *	"sending" が残ったまま "done" の無いポストは届いたかどうか分からないので、読み込み時に送り直さない.
+ *	書きかけで落ちた末尾のレコードは読み込み時に捨てる.
+ */
+#import "PostQueue.h"
+#import "GrowlSupport.h"
+#import "TumblrfulConstants.h"
+#import "DebugLog.h"
+#import <AppKit/AppKit.h>
+
+NSString * PostQueueDidChangeNotification = @"PostQueueDidChangeNotification";
+NSString * PostQueueEventKey = @"event";
+NSString * PostQueueIdentifierKey = @"identifier";
+NSString * PostQueuePendingCountKey = @"pendingCount";
+NSString * PostQueueEventEnqueued = @"enqueued";
+NSString * PostQueueEventSent = @"sent";
+NSString * PostQueueEventRetrying = @"retrying";
+NSString * PostQueueEventFailed = @"failed";
+NSString * PostQueueEventOffline = @"offline";
+NSString * PostQueueEventOnline = @"online";
+
+static NSString * JOURNAL_NAME = @"outbox.journal";
+static NSString * PAYLOAD_EXTENSION = @"payload";
+
+/// これより大きい NSData の値はジャーナルに入れずに別のファイルにする
+static NSUInteger PAYLOAD_THRESHOLD = 4096;
+
+/// 送信を試みる最大回数
+static NSUInteger MAX_ATTEMPTS = 8;
+
+/// 再試行の間隔(秒). 失敗するたびに倍にし、MAX_RETRY_DELAY で頭打ちにする
+static NSTimeInterval BASE_RETRY_DELAY = 2.0;
+static NSTimeInterval MAX_RETRY_DELAY = 600.0;
+
+/// オフラインの間にネットワークを確かめる間隔(秒). これも倍にしていく
+static NSTimeInterval BASE_PROBE_DELAY = 30.0;
+static NSTimeInterval MAX_PROBE_DELAY = 300.0;
+
+/// 起動時に残っていたポストを送り始めるまでの秒数. Safari の起動を邪魔しない
+static NSTimeInterval RESTORE_DELAY = 10.0;
+
+#pragma mark -
+/**
+ * 待ち行列の中のポスト1つ. 送信に使う Post の callback にもなる
+ */
+@interface PostQueueItem : NSObject<PostCallback>
+{
+	PostQueue * queue_;	///< queue は singleton なので assign
+	NSString * identifier_;
+	NSString * className_;
+	NSDictionary * params_;		///< 大きな NSData を除いたもの
+	NSDictionary * payloads_;	///< key -> ペイロードのファイル名
+	NSDictionary * options_;
+	NSObject<PostCallback> * callback_;
+	NSMutableDictionary * pendingData_;	///< ファイルに書くまで持っておく key -> NSData
+	NSUInteger attempts_;
+	BOOL persisted_;
+	BOOL inflight_;
+	BOOL deferred_;		///< 送り直すことを callback に知らせた
+}
+@property (nonatomic, readonly) NSString * identifier;
+@property (nonatomic, readonly) NSString * className;
+@property (nonatomic, readonly) NSDictionary * payloads;
+@property (nonatomic, readonly) NSDictionary * options;
+@property (nonatomic, readonly) NSObject<PostCallback> * callback;
+@property (nonatomic, readonly) NSDictionary * pendingData;
+@property (nonatomic, assign) NSUInteger attempts;
+@property (nonatomic, assign) BOOL persisted;
+@property (nonatomic, assign) BOOL inflight;
+@property (nonatomic, assign) BOOL deferred;
+- (id)initWithQueue:(PostQueue *)queue postClass:(Class)postClass params:(NSDictionary *)params options:(NSDictionary *)options callback:(NSObject<PostCallback> *)callback;
+- (id)initWithQueue:(PostQueue *)queue record:(NSDictionary *)record;
+- (NSDictionary *)record;
+- (NSDictionary *)paramsInDirectory:(NSString *)directory;
+- (void)dropPendingData;
+@end
+
+@interface PostQueue ()
++ (NSString *)createIdentifier;
++ (NSData *)dataWithRecord:(NSDictionary *)record;
++ (BOOL)isOfflineError:(NSError *)error;
++ (BOOL)isTransientError:(NSError *)error;
+- (void)replayJournal;
+- (void)reportUncertainRecords:(NSArray *)records;
+- (void)restoreRecords:(NSArray *)records;
+- (void)restoreItems;
+- (void)writeItem:(PostQueueItem *)item;
+- (void)itemPersisted:(PostQueueItem *)item;
+- (void)appendRecord:(NSDictionary *)record;
+- (void)appendOp:(NSString *)op forItem:(PostQueueItem *)item;
+- (void)writeSending:(PostQueueItem *)item;
+- (void)rewriteJournal:(NSArray *)records;
+- (void)removePayloads:(NSArray *)names;
+- (void)dispatchItem:(PostQueueItem *)item;
+- (void)sendItem:(PostQueueItem *)item;
+- (void)postItem:(PostQueueItem *)item;
+- (void)item:(PostQueueItem *)item finishedWithSuccess:(BOOL)succeeded outcome:(id)outcome;
+- (void)deferItem:(PostQueueItem *)item error:(NSError *)error;
+- (void)completeItem:(PostQueueItem *)item succeeded:(BOOL)succeeded outcome:(id)outcome;
+- (void)goOffline;
+- (void)scheduleProbe;
+- (void)probe;
+- (void)goOnline;
+- (void)workspaceDidWake:(NSNotification *)notification;
+- (void)postEvent:(NSString *)event item:(PostQueueItem *)item;
+@end
+
+#pragma mark -
+@implementation PostQueueItem
+
+@synthesize identifier = identifier_;
+@synthesize className = className_;
+@synthesize payloads = payloads_;
+@synthesize options = options_;
+@synthesize callback = callback_;
+@synthesize pendingData = pendingData_;
+@synthesize attempts = attempts_;
+@synthesize persisted = persisted_;
+@synthesize inflight = inflight_;
+@synthesize deferred = deferred_;
+
+- (id)initWithQueue:(PostQueue *)queue postClass:(Class)postClass params:(NSDictionary *)params options:(NSDictionary *)options callback:(NSObject<PostCallback> *)callback
+{
+	if ((self = [super init]) != nil) {
+		queue_ = queue;
+		identifier_ = [[PostQueue createIdentifier] retain];
+		className_ = [NSStringFromClass(postClass) copy];
+		options_ = [(options != nil ? options : [NSDictionary dictionary]) copy];
+		callback_ = [callback retain];
+
+		// 大きな NSData はペイロードとして別ファイルに書く
+		NSMutableDictionary * small = [NSMutableDictionary dictionaryWithCapacity:[params count]];
+		NSMutableDictionary * payloads = [NSMutableDictionary dictionary];
+		pendingData_ = [[NSMutableDictionary alloc] init];
+		for (NSString * key in params) {
+			id value = [params objectForKey:key];
+			if ([value isKindOfClass:[NSData class]] && [(NSData *)value length] > PAYLOAD_THRESHOLD) {
+				NSString * name = [NSString stringWithFormat:@"%@-%u.%@", identifier_, [payloads count], PAYLOAD_EXTENSION];
+				[payloads setObject:name forKey:key];
+				[pendingData_ setObject:value forKey:key];
+			}
+			else if ([value isKindOfClass:[NSURL class]]) {
+				[small setObject:[(NSURL *)value absoluteString] forKey:key];
+			}
+			else {
+				[small setObject:value forKey:key];
+			}
+		}
+		params_ = [small copy];
+		payloads_ = [payloads copy];
+	}
+	return self;
+}
+
+- (id)initWithQueue:(PostQueue *)queue record:(NSDictionary *)record
+{
+	if ((self = [super init]) != nil) {
+		queue_ = queue;
+		identifier_ = [[record objectForKey:@"id"] copy];
+		className_ = [[record objectForKey:@"class"] copy];
+		params_ = [[record objectForKey:@"params"] copy];
+		payloads_ = [[record objectForKey:@"payloads"] copy];
+		options_ = [[record objectForKey:@"options"] copy];
+		attempts_ = [[record objectForKey:@"attempts"] unsignedIntegerValue];
+		persisted_ = YES;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[identifier_ release], identifier_ = nil;
+	[className_ release], className_ = nil;
+	[params_ release], params_ = nil;
+	[payloads_ release], payloads_ = nil;
+	[options_ release], options_ = nil;
+	[callback_ release], callback_ = nil;
+	[pendingData_ release], pendingData_ = nil;
+	[super dealloc];
+}
+
+- (NSDictionary *)record
+{
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+		@"add", @"op",
+		identifier_, @"id",
+		className_, @"class",
+		params_, @"params",
+		payloads_, @"payloads",
+		options_, @"options",
+		[NSNumber numberWithUnsignedInteger:attempts_], @"attempts",
+		nil];
+}
+
+- (NSDictionary *)paramsInDirectory:(NSString *)directory
+{
+	NSMutableDictionary * params = [NSMutableDictionary dictionaryWithDictionary:params_];
+	for (NSString * key in payloads_) {
+		NSData * data = [pendingData_ objectForKey:key];
+		if (data == nil) {
+			data = [NSData dataWithContentsOfMappedFile:[directory stringByAppendingPathComponent:[payloads_ objectForKey:key]]];
+		}
+		if (data == nil) {
+			[NSException raise:TUMBLRFUL_EXCEPTION_NAME format:@"Payload missing: %@", [payloads_ objectForKey:key]];
+		}
+		[params setObject:data forKey:key];
+	}
+	return params;
+}
+
+- (void)dropPendingData
+{
+	[pendingData_ release], pendingData_ = nil;
+}
+
+- (void)successed:(NSString *)response
+{
+	[queue_ item:self finishedWithSuccess:YES outcome:response];
+}
+
+- (void)failedWithError:(NSError *)error
+{
+	[queue_ item:self finishedWithSuccess:NO outcome:error];
+}
+
+- (void)failedWithException:(NSException *)exception
+{
+	[queue_ item:self finishedWithSuccess:NO outcome:exception];
+}
+@end
+
+#pragma mark -
+@implementation PostQueue
+
+@synthesize offline = offline_;
+
++ (PostQueue *)sharedQueue
+{
+	static PostQueue * instance = nil;
+	if (instance == nil) {
+		instance = [[PostQueue alloc] init];
+	}
+	return instance;
+}
+
++ (NSString *)createIdentifier
+{
+	CFUUIDRef uuid = CFUUIDCreate(NULL);
+	NSString * identifier = [(NSString *)CFUUIDCreateString(NULL, uuid) autorelease];
+	CFRelease(uuid);
+	return identifier;
+}
+
++ (NSData *)dataWithRecord:(NSDictionary *)record
+{
+	NSError * error = nil;
+	NSData * plist = [NSPropertyListSerialization dataWithPropertyList:record format:NSPropertyListBinaryFormat_v1_0 options:0 error:&error];
+	if (plist == nil) {
+		D0([error description]);
+		return nil;
+	}
+
+	uint32_t const length = NSSwapHostIntToBig((uint32_t)[plist length]);
+	NSMutableData * data = [NSMutableData dataWithCapacity:sizeof(length) + [plist length]];
+	[data appendBytes:&length length:sizeof(length)];
+	[data appendData:plist];
+	return data;
+}
+
+/// 送り直しても同じ結果になるので、ネットワークが戻るまで待つべきエラー
++ (BOOL)isOfflineError:(NSError *)error
+{
+	if (![[error domain] isEqualToString:NSURLErrorDomain]) return NO;
+
+	switch ([error code]) {
+	case NSURLErrorNotConnectedToInternet:
+	case NSURLErrorCannotFindHost:
+	case NSURLErrorDNSLookupFailed:
+	case NSURLErrorInternationalRoamingOff:
+	case NSURLErrorDataNotAllowed:
+		return YES;
+	}
+	return NO;
+}
+
+/**
+ * 時間をおけば成功するかもしれず、送り直しても二重にポストにならないエラー
+ *	ポストは冪等ではないので、リクエストがサーバに届いていないと言えるものだけにする.
+ *	タイムアウトや接続断、おかしな応答はサーバが受け付けた後でも起きるので送り直さない.
+ */
++ (BOOL)isTransientError:(NSError *)error
+{
+	if (![[error domain] isEqualToString:NSURLErrorDomain]) return NO;
+
+	switch ([error code]) {
+	case NSURLErrorCannotConnectToHost:
+		return YES;
+	}
+	return NO;
+}
+
+- (id)init
+{
+	if ((self = [super init]) != nil) {
+		NSArray * paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES);
+		directory_ = [[[[paths objectAtIndex:0] stringByAppendingPathComponent:@"Tumblrful"] stringByAppendingPathComponent:@"Outbox"] retain];
+		journalPath_ = [[directory_ stringByAppendingPathComponent:JOURNAL_NAME] retain];
+		[[NSFileManager defaultManager] createDirectoryAtPath:directory_ withIntermediateDirectories:YES attributes:nil error:nil];
+
+		ioQueue_ = [[NSOperationQueue alloc] init];
+		[ioQueue_ setMaxConcurrentOperationCount:1];	// ジャーナルへの書き込みは1本に並べる
+
+		items_ = [[NSMutableArray alloc] init];
+		parked_ = [[NSMutableArray alloc] init];
+
+		// ジャーナルとペイロードは Safari の起動を待たせないように ioQueue_ で読む
+		[ioQueue_ addOperation:[[[NSInvocationOperation alloc] initWithTarget:self selector:@selector(replayJournal) object:nil] autorelease]];
+
+		[[[NSWorkspace sharedWorkspace] notificationCenter] addObserver:self selector:@selector(workspaceDidWake:) name:NSWorkspaceDidWakeNotification object:nil];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[[[NSWorkspace sharedWorkspace] notificationCenter] removeObserver:self];
+	[ioQueue_ waitUntilAllOperationsAreFinished];
+	[ioQueue_ release], ioQueue_ = nil;
+	[directory_ release], directory_ = nil;
+	[journalPath_ release], journalPath_ = nil;
+	[items_ release], items_ = nil;
+	[parked_ release], parked_ = nil;
+	[super dealloc];
+}
+
+- (NSUInteger)pendingCount
+{
+	return [items_ count];
+}
+
+- (NSString *)enqueuePostClass:(Class)postClass params:(NSDictionary *)params options:(NSDictionary *)options callback:(NSObject<PostCallback> *)callback
+{
+	PostQueueItem * item = [[[PostQueueItem alloc] initWithQueue:self postClass:postClass params:params options:options callback:callback] autorelease];
+	[items_ addObject:item];
+
+	if ([NSPropertyListSerialization propertyList:[item record] isValidForFormat:NSPropertyListBinaryFormat_v1_0]) {
+		// ファイルへの書き込みは待たずに戻る. 書き終わったら main thread で送る
+		NSInvocationOperation * operation = [[[NSInvocationOperation alloc] initWithTarget:self selector:@selector(writeItem:) object:item] autorelease];
+		[ioQueue_ addOperation:operation];
+	}
+	else {
+		// plist にできない値(NSImage など)を含むものはディスクに残さずにそのまま送る
+		Log(@"post queue: not persisted %@ (%@)", [item identifier], [item className]);
+		[self dispatchItem:item];
+	}
+	return [item identifier];
+}
+
+#pragma mark -
+#pragma mark Journal (ioQueue_)
+
+/// ペイロードとレコードを書いてから main thread に戻す
+- (void)writeItem:(PostQueueItem *)item
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	@try {
+		NSDictionary * payloads = [item payloads];
+		for (NSString * key in payloads) {
+			NSString * path = [directory_ stringByAppendingPathComponent:[payloads objectForKey:key]];
+			if (![[[item pendingData] objectForKey:key] writeToFile:path atomically:YES]) {
+				[NSException raise:TUMBLRFUL_EXCEPTION_NAME format:@"Could not write payload: %@", path];
+			}
+		}
+		[self appendRecord:[item record]];
+		[self performSelectorOnMainThread:@selector(itemPersisted:) withObject:item waitUntilDone:NO];
+	}
+	@catch (NSException * e) {
+		// 書けなくても送信はする. 落ちたら失われるのは従来どおり
+		Log(@"post queue: %@", [e description]);
+		[self performSelectorOnMainThread:@selector(dispatchItem:) withObject:item waitUntilDone:NO];
+	}
+	[pool release];
+}
+
+- (void)appendRecord:(NSDictionary *)record
+{
+	NSData * data = [PostQueue dataWithRecord:record];
+	if (data == nil) return;
+
+	NSFileManager * manager = [NSFileManager defaultManager];
+	if (![manager fileExistsAtPath:journalPath_]) {
+		[manager createFileAtPath:journalPath_ contents:nil attributes:nil];
+	}
+	NSFileHandle * handle = [NSFileHandle fileHandleForWritingAtPath:journalPath_];
+	if (handle == nil) {
+		[NSException raise:TUMBLRFUL_EXCEPTION_NAME format:@"Could not open journal: %@", journalPath_];
+	}
+	[handle seekToEndOfFile];
+	[handle writeData:data];
+	[handle synchronizeFile];	// 受け付けたものは落ちても残るように
+	[handle closeFile];
+}
+
+/// "id" だけを持つレコードを ioQueue_ で追記する
+- (void)appendOp:(NSString *)op forItem:(PostQueueItem *)item
+{
+	NSDictionary * record = [NSDictionary dictionaryWithObjectsAndKeys:op, @"op", [item identifier], @"id", nil];
+	[ioQueue_ addOperation:[[[NSInvocationOperation alloc] initWithTarget:self selector:@selector(appendRecord:) object:record] autorelease]];
+}
+
+/// 送信を始めることをジャーナルに書いてから main thread で送る
+- (void)writeSending:(PostQueueItem *)item
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	@try {
+		[self appendRecord:[NSDictionary dictionaryWithObjectsAndKeys:@"sending", @"op", [item identifier], @"id", nil]];
+	}
+	@catch (NSException * e) {
+		// 書けなくても送信はする. 落ちた時に送り直すかもしれないのは従来どおり
+		Log(@"post queue: %@", [e description]);
+	}
+	[self performSelectorOnMainThread:@selector(postItem:) withObject:item waitUntilDone:NO];
+	[pool release];
+}
+
+/// 生きているレコードだけでジャーナルを書き直す(空なら空にする)
+- (void)rewriteJournal:(NSArray *)records
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	NSMutableData * data = [NSMutableData data];
+	for (NSDictionary * record in records) {
+		NSData * recordData = [PostQueue dataWithRecord:record];
+		if (recordData != nil) [data appendData:recordData];
+	}
+	if (![data writeToFile:journalPath_ atomically:YES]) {
+		Log(@"post queue: could not rewrite journal %@", journalPath_);
+	}
+	[pool release];
+}
+
+- (void)removePayloads:(NSArray *)names
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	NSFileManager * manager = [NSFileManager defaultManager];
+	for (NSString * name in names) {
+		[manager removeItemAtPath:[directory_ stringByAppendingPathComponent:name] error:nil];
+	}
+	[pool release];
+}
+
+/// 起動時にジャーナルを読み、終わっていないポストのレコードを main thread に戻す
+- (void)replayJournal
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+
+	NSMutableArray * live = [NSMutableArray array];
+	NSMutableArray * uncertain = [NSMutableArray array];
+	NSData * data = [NSData dataWithContentsOfFile:journalPath_];
+	if (data != nil) {
+		NSMutableArray * order = [NSMutableArray array];
+		NSMutableDictionary * records = [NSMutableDictionary dictionary];
+		NSMutableSet * sending = [NSMutableSet set];	// 送信中に落ちたかもしれないもの
+		unsigned char const * bytes = [data bytes];
+		NSUInteger const length = [data length];
+		NSUInteger offset = 0;
+		while (offset + sizeof(uint32_t) <= length) {
+			uint32_t recordLength;
+			memcpy(&recordLength, bytes + offset, sizeof(recordLength));
+			recordLength = NSSwapBigIntToHost(recordLength);
+			if (recordLength > length - offset - sizeof(uint32_t)) break;	// 書きかけ
+
+			NSData * plist = [data subdataWithRange:NSMakeRange(offset + sizeof(uint32_t), recordLength)];
+			NSDictionary * record = [NSPropertyListSerialization propertyListWithData:plist options:NSPropertyListImmutable format:NULL error:NULL];
+			if (![record isKindOfClass:[NSDictionary class]]) break;
+			offset += sizeof(uint32_t) + recordLength;
+
+			NSString * identifier = [record objectForKey:@"id"];
+			if (identifier == nil) continue;
+			NSString * op = [record objectForKey:@"op"];
+			if ([op isEqualToString:@"add"]) {
+				[order addObject:identifier];
+				[records setObject:record forKey:identifier];
+			}
+			else if ([op isEqualToString:@"sending"]) {
+				[sending addObject:identifier];
+			}
+			else if ([op isEqualToString:@"unsent"]) {
+				[sending removeObject:identifier];
+			}
+			else {
+				[order removeObject:identifier];
+				[records removeObjectForKey:identifier];
+				[sending removeObject:identifier];
+			}
+		}
+
+		NSMutableSet * referenced = [NSMutableSet set];
+		for (NSString * identifier in order) {
+			NSDictionary * record = [records objectForKey:identifier];
+			if (NSClassFromString([record objectForKey:@"class"]) == nil) continue;
+			if ([sending containsObject:identifier]) {
+				// 届いたかどうか分からない. 送り直すと二重にポストになるので、知らせるだけにしてジャーナルから落とす
+				[uncertain addObject:record];
+				continue;
+			}
+
+			[live addObject:record];
+			[referenced addObjectsFromArray:[[record objectForKey:@"payloads"] allValues]];
+		}
+
+		// 書きかけの末尾と終わったレコードを落とし、どこからも指されていないペイロードを消す
+		NSMutableArray * orphans = [NSMutableArray array];
+		for (NSString * name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:directory_ error:nil]) {
+			if ([[name pathExtension] isEqualToString:PAYLOAD_EXTENSION] && ![referenced containsObject:name]) {
+				[orphans addObject:name];
+			}
+		}
+		[self rewriteJournal:live];
+		[self removePayloads:orphans];
+	}
+	if ([uncertain count] > 0) {
+		[self performSelectorOnMainThread:@selector(reportUncertainRecords:) withObject:uncertain waitUntilDone:NO];
+	}
+	[self performSelectorOnMainThread:@selector(restoreRecords:) withObject:live waitUntilDone:NO];
+
+	[pool release];
+}
+
+#pragma mark -
+#pragma mark Dispatch (main thread)
+
+/// 前回の起動で送信中のまま終わったものを Growl で知らせる. 送り直しはしない
+- (void)reportUncertainRecords:(NSArray *)records
+{
+	for (NSDictionary * record in records) {
+		Log(@"post queue: not resending %@ (%@), it may already have been posted", [record objectForKey:@"id"], [record objectForKey:@"class"]);
+		NSString * message = [NSString stringWithFormat:@"Queued post may already have been delivered, not resent (%@)", [record objectForKey:@"class"]];
+		[GrowlSupport notifyWithTitle:@"Tumblrful" description:message];
+	}
+}
+
+- (void)restoreRecords:(NSArray *)records
+{
+	for (NSDictionary * record in records) {
+		PostQueueItem * item = [[[PostQueueItem alloc] initWithQueue:self record:record] autorelease];
+		[items_ addObject:item];
+	}
+	replayed_ = YES;
+	Log(@"post queue: %u pending posts restored", [records count]);
+
+	if ([records count] > 0) {
+		[self performSelector:@selector(restoreItems) withObject:nil afterDelay:RESTORE_DELAY];
+	}
+}
+
+- (void)restoreItems
+{
+	for (PostQueueItem * item in [[items_ copy] autorelease]) {
+		if (![item inflight]) [self dispatchItem:item];
+	}
+}
+
+- (void)itemPersisted:(PostQueueItem *)item
+{
+	item.persisted = YES;
+	[self postEvent:PostQueueEventEnqueued item:item];
+	[self dispatchItem:item];
+}
+
+- (void)dispatchItem:(PostQueueItem *)item
+{
+	if (![items_ containsObject:item] || [item inflight]) return;
+
+	if (offline_) {
+		if (![parked_ containsObject:item]) [parked_ addObject:item];
+		return;
+	}
+	[self sendItem:item];
+}
+
+- (void)sendItem:(PostQueueItem *)item
+{
+	item.inflight = YES;
+	if ([item persisted]) {
+		// "sending" を書き終えてから送る. 書く前に落ちたなら届いていないので、次の起動で送り直してよい
+		[ioQueue_ addOperation:[[[NSInvocationOperation alloc] initWithTarget:self selector:@selector(writeSending:) object:item] autorelease]];
+	}
+	else {
+		[self postItem:item];
+	}
+}
+
+- (void)postItem:(PostQueueItem *)item
+{
+	@try {
+		Class postClass = NSClassFromString([item className]);
+		NSObject<Post> * post = [[postClass alloc] initWithCallback:item];	// Post は終わったら自分で release する
+		[post setValuesForKeysWithDictionary:[item options]];
+
+		NSMutableDictionary * params = [post createMinimumRequestParams];
+		[params addEntriesFromDictionary:[item paramsInDirectory:directory_]];
+		if ([item persisted]) [item dropPendingData];
+
+		item.attempts = [item attempts] + 1;
+		D(@"dispatch %@ (%@) attempt %u", [item identifier], [item className], [item attempts]);
+		[post postWith:params];
+	}
+	@catch (NSException * e) {
+		D0([e description]);
+		[self item:item finishedWithSuccess:NO outcome:e];
+	}
+}
+
+- (void)item:(PostQueueItem *)item finishedWithSuccess:(BOOL)succeeded outcome:(id)outcome
+{
+	if (![item inflight]) return;	// 二重の通知は無視する
+	item.inflight = NO;
+	[parked_ removeObject:item];
+
+	if (succeeded) {
+		if (offline_) [self goOnline];
+		[self completeItem:item succeeded:YES outcome:outcome];
+		return;
+	}
+
+	NSError * error = [outcome isKindOfClass:[NSError class]] ? outcome : nil;
+	if ([item persisted] && [PostQueue isOfflineError:error]) {
+		// オフラインでの失敗は回数に数えない. サーバに届いていないので "sending" も打ち消す
+		item.attempts = [item attempts] - 1;
+		[self appendOp:@"unsent" forItem:item];
+		[parked_ addObject:item];
+		if (!offline_) [self goOffline];
+		else [self scheduleProbe];
+		[self deferItem:item error:error];
+		return;
+	}
+
+	if (offline_) [self goOnline];	// 届いてはいる
+
+	if ([item persisted] && [PostQueue isTransientError:error] && [item attempts] < MAX_ATTEMPTS) {
+		NSTimeInterval const delay = MIN(BASE_RETRY_DELAY * (1 << ([item attempts] - 1)), MAX_RETRY_DELAY);
+		Log(@"post queue: retry %@ in %.0f sec (%@)", [item className], delay, [error localizedDescription]);
+		[self appendOp:@"unsent" forItem:item];
+		[self postEvent:PostQueueEventRetrying item:item];
+		[self performSelector:@selector(dispatchItem:) withObject:item afterDelay:delay];
+		[self deferItem:item error:error];
+		return;
+	}
+
+	[self completeItem:item succeeded:NO outcome:outcome];
+}
+
+/// 待ち行列がまだ持っていることを callback に一度だけ知らせる. 最終的な結果は completeItem: で届く
+- (void)deferItem:(PostQueueItem *)item error:(NSError *)error
+{
+	if ([item deferred]) return;
+	item.deferred = YES;
+
+	NSObject<PostCallback> * callback = [item callback];
+	if ([callback respondsToSelector:@selector(deferredWithError:)]) {
+		[callback deferredWithError:error];
+	}
+}
+
+/// 最終的な結果を通知して、ジャーナルから消す
+- (void)completeItem:(PostQueueItem *)item succeeded:(BOOL)succeeded outcome:(id)outcome
+{
+	[[item retain] autorelease];
+	[items_ removeObject:item];
+
+	if ([item persisted]) {
+		[self appendOp:@"done" forItem:item];
+		[ioQueue_ addOperation:[[[NSInvocationOperation alloc] initWithTarget:self selector:@selector(removePayloads:) object:[[item payloads] allValues]] autorelease]];
+		if ([items_ count] == 0 && replayed_) {
+			// 全部終わったらジャーナルを空にして、ファイルが伸び続けないようにする
+			[ioQueue_ addOperation:[[[NSInvocationOperation alloc] initWithTarget:self selector:@selector(rewriteJournal:) object:[NSArray array]] autorelease]];
+		}
+	}
+
+	[self postEvent:(succeeded ? PostQueueEventSent : PostQueueEventFailed) item:item];
+
+	NSObject<PostCallback> * callback = [item callback];
+	if (callback != nil) {
+		if (succeeded)											[callback successed:outcome];
+		else if ([outcome isKindOfClass:[NSException class]])	[callback failedWithException:outcome];
+		else													[callback failedWithError:outcome];
+	}
+	else {
+		// 前回の起動で受け付けたもの. 知らせる相手がいないので Growl に出す
+		NSString * message = succeeded
+			? [NSString stringWithFormat:@"Queued post delivered (%@)", [item className]]
+			: [NSString stringWithFormat:@"Queued post failed (%@)", [item className]];
+		[GrowlSupport notifyWithTitle:@"Tumblrful" description:message];
+	}
+}
+
+- (void)goOffline
+{
+	Log(@"post queue: offline, %u posts parked", [parked_ count]);
+	offline_ = YES;
+	offlineProbes_ = 0;
+	[self postEvent:PostQueueEventOffline item:nil];
+	[self scheduleProbe];
+}
+
+- (void)scheduleProbe
+{
+	NSTimeInterval const delay = MIN(BASE_PROBE_DELAY * (1 << MIN(offlineProbes_, (NSUInteger)4)), MAX_PROBE_DELAY);
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(probe) object:nil];
+	[self performSelector:@selector(probe) withObject:nil afterDelay:delay];
+}
+
+/// 止めているものを1つだけ送ってネットワークを確かめる
+- (void)probe
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(probe) object:nil];
+	if (!offline_) return;
+	if ([parked_ count] == 0) {
+		[self goOnline];
+		return;
+	}
+
+	++offlineProbes_;
+	PostQueueItem * item = [parked_ objectAtIndex:0];
+	if (![item inflight]) [self sendItem:item];
+}
+
+- (void)goOnline
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(probe) object:nil];
+	offline_ = NO;
+	Log(@"post queue: online, resuming %u posts", [parked_ count]);
+	[self postEvent:PostQueueEventOnline item:nil];
+
+	NSArray * parked = [[parked_ copy] autorelease];
+	[parked_ removeAllObjects];
+	for (PostQueueItem * item in parked) {
+		[self dispatchItem:item];
+	}
+}
+
+- (void)workspaceDidWake:(NSNotification *)notification
+{
+#pragma unused (notification)
+	if (offline_) [self probe];
+}
+
+- (void)postEvent:(NSString *)event item:(PostQueueItem *)item
+{
+	NSMutableDictionary * userInfo = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+		event, PostQueueEventKey,
+		[NSNumber numberWithUnsignedInteger:[items_ count]], PostQueuePendingCountKey,
+		nil];
+	if (item != nil) [userInfo setObject:[item identifier] forKey:PostQueueIdentifierKey];
+	[[NSNotificationCenter defaultCenter] postNotificationName:PostQueueDidChangeNotification object:self userInfo:userInfo];
+}
+@end
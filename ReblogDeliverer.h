@@ -64,4 +64,13 @@
  *	@return Dictionary that contains the tokens.
  */
 + (NSDictionary *)reblogTokensFromIFrame:(DOMHTMLDocument *)document;
+
+/**
+ * Tokens of Reblog for every post on the page.
+ *	collects iframe#tumblr_controls and "/reblog/<pid>/<rk>" links in one DOM pass.
+ *	scans only Tumblr pages (tumblr.com host or iframe#tumblr_controls), and accepts only numeric post IDs.
+ *	@param[in] document	DOMHTMLDocument object of Tumblr page.
+ *	@return Array of dictionaries that contain "pid" and "rk", in document order without duplicates.
+ */
++ (NSArray *)reblogTokensFromDocument:(DOMHTMLDocument *)document;
 @end
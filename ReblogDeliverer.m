@@ -9,10 +9,17 @@
 #import "DelivererRules.h"
 #import "NSString+Tumblrful.h"
 #import "GrowlSupport.h"
+#import "TumblrfulConstants.h"
 #import "DebugLog.h"
 
 static NSString * TYPE = @"Reblog";
 
+/// 数字だけからなる Post ID か
+static BOOL isNumericPostID(NSString * postID)
+{
+	return [postID length] > 0 && [postID rangeOfCharacterFromSet:[[NSCharacterSet decimalDigitCharacterSet] invertedSet]].location == NSNotFound;
+}
+
 #pragma mark -
 @implementation ReblogDeliverer
 
@@ -93,13 +100,10 @@ static NSString * TYPE = @"Reblog";
 
 + (NSDictionary *)reblogTokensFromIFrame:(DOMHTMLDocument *)document
 {
-	static NSString * XPath = @"//iframe[@id='tumblr_controls']";
-
-	DOMXPathResult * result = [document evaluate:XPath contextNode:document resolver:nil type:DOM_ANY_TYPE inResult:nil];
-
-	if (result != nil && ![result invalidIteratorState]) {
-		DOMHTMLIFrameElement * iframe = (DOMHTMLIFrameElement *)[result iterateNext];
-		NSString * src = [[iframe getAttribute:@"src"] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+	// 右クリックのたびに呼ばれるので、文書全体を XPath で探さずに id で引く
+	DOMElement * element = [document getElementById:@"tumblr_controls"];
+	if (element != nil && [[element tagName] caseInsensitiveCompare:@"iframe"] == NSOrderedSame) {
+		NSString * src = [element getAttribute:@"src"];
 		if (src != nil) {
 			//D(@"src=%@", src);
 			NSURL * u = [NSURL URLWithString:src];
@@ -107,18 +111,54 @@ static NSString * TYPE = @"Reblog";
 			//D(@"tokens=%@", [tokens description]);
 			return tokens;
 		}
-		//else {
-		//	D0([iframe description]);
-		//	D0([iframe innerHTML]);
-		//	D0([iframe outerHTML]);
-		//}
-	}
-	else {
-		D0([result description]);
 	}
 	return nil;
 }
 
++ (NSArray *)reblogTokensFromDocument:(DOMHTMLDocument *)document
+{
+	static NSString * XPath = @"//iframe[@id='tumblr_controls'] | //a[contains(@href, '/reblog/')]";
+
+	// 右クリックのたびに呼ばれるので、文書全体を探すのは Tumblr のページ(独自ドメインなら iframe がある)だけにする
+	NSString * host = [[[DelivererBase URLOfDocument:document] host] lowercaseString];
+	BOOL const tumblrHost = [host isEqualToString:@"tumblr.com"] || [host hasSuffix:@".tumblr.com"];
+	if (!tumblrHost && [document getElementById:@"tumblr_controls"] == nil) return nil;
+
+	DOMXPathResult * result = [document evaluate:XPath contextNode:document resolver:nil type:DOM_ANY_TYPE inResult:nil];
+	if (result == nil || [result invalidIteratorState]) return nil;
+
+	NSMutableArray * tokensArray = [NSMutableArray array];
+	NSMutableSet * seen = [NSMutableSet set];
+	for (DOMHTMLElement * element; (element = (DOMHTMLElement *)[result iterateNext]) != nil; ) {
+		NSString * postID = nil;
+		NSString * reblogKey = nil;
+
+		if ([element isKindOfClass:[DOMHTMLIFrameElement class]]) {
+			NSString * src = [element getAttribute:@"src"];
+			if (src == nil) continue;
+			NSDictionary * tokens = [[[NSURL URLWithString:src] query] dictionaryWithKVPConnector:@"=" withSeparator:@"&"];
+			postID = [tokens objectForKey:@"pid"];
+			reblogKey = [tokens objectForKey:@"rk"];
+		}
+		else {
+			// href="/reblog/<pid>/<rk>?redirect_to=..." の形
+			NSString * href = [element getAttribute:@"href"];
+			if (href == nil) continue;
+			NSArray * components = [[[NSURL URLWithString:href relativeToURL:[NSURL URLWithString:TUMBLRFUL_TUMBLR_URL]] path] pathComponents];
+			NSUInteger const index = [components indexOfObject:@"reblog"];
+			if (index == NSNotFound || index + 2 >= [components count]) continue;
+			postID = [components objectAtIndex:index + 1];
+			reblogKey = [components objectAtIndex:index + 2];
+		}
+
+		if (!isNumericPostID(postID) || [reblogKey length] == 0 || [seen containsObject:postID]) continue;
+		[seen addObject:postID];
+		[tokensArray addObject:[NSDictionary dictionaryWithObjectsAndKeys:postID, @"pid", reblogKey, @"rk", nil]];
+	}
+	D(@"%u tokens", [tokensArray count]);
+	return tokensArray;
+}
+
 #pragma mark -
 #pragma mark Override Methods
 
@@ -0,0 +1,72 @@
+/**
+ * @file ReblogFormCache.h
+ * @brief ReblogFormCache class declaration
+ */
+#import <Foundation/Foundation.h>
+
+/**
+ * 抽出済みの Reblog フォームを覚えておく LRU キャッシュ
+ *	(postID, reblogKey) ごとに TumblrReblogExtractor が作るフィールドの辞書を持つ.
+ *	エントリは timeToLive で期限切れになる. form_key を含むエントリは
+ *	セッション側で無効になる前に捨てるため formKeyTimeToLive のほうが短ければそちらで切れる.
+ */
+@interface ReblogFormCache : NSObject
+{
+	NSMutableDictionary * entries_;
+	NSMutableArray * order_;	///< 古い順のキー. 末尾が最近使ったもの
+	NSUInteger capacity_;
+	NSTimeInterval timeToLive_;
+	NSTimeInterval formKeyTimeToLive_;
+	NSUInteger hits_;
+	NSUInteger misses_;
+	NSUInteger evictions_;
+}
+
+/// 保持するエントリの最大数
+@property (nonatomic, assign) NSUInteger capacity;
+
+/// エントリの有効期間(秒)
+@property (nonatomic, assign) NSTimeInterval timeToLive;
+
+/// form_key を含むエントリの有効期間(秒)
+@property (nonatomic, assign) NSTimeInterval formKeyTimeToLive;
+
+/// ヒット数
+@property (nonatomic, readonly) NSUInteger hits;
+
+/// ミス数(期限切れを含む)
+@property (nonatomic, readonly) NSUInteger misses;
+
+/// 容量超過または期限切れで捨てた数
+@property (nonatomic, readonly) NSUInteger evictions;
+
++ (ReblogFormCache *)sharedInstance;
+
+/**
+ * フィールドを引く. ヒットしたエントリは最近使ったものになる
+ *	@param[in] postID	Post ID
+ *	@param[in] reblogKey	Reblog key
+ *	@return フィールドの辞書. 無いか期限切れなら nil
+ */
+- (NSDictionary *)fieldsForPostID:(NSString *)postID reblogKey:(NSString *)reblogKey;
+
+/**
+ * フィールドを覚える
+ *	@param[in] fields	フィールドの辞書
+ *	@param[in] postID	Post ID
+ *	@param[in] reblogKey	Reblog key
+ */
+- (void)setFields:(NSDictionary *)fields forPostID:(NSString *)postID reblogKey:(NSString *)reblogKey;
+
+/**
+ * フィールドを忘れる(form_key が拒否されたときなど)
+ *	@param[in] postID	Post ID
+ *	@param[in] reblogKey	Reblog key
+ */
+- (void)removeFieldsForPostID:(NSString *)postID reblogKey:(NSString *)reblogKey;
+
+/**
+ * すべて忘れる. 統計はそのまま
+ */
+- (void)removeAllFields;
+@end
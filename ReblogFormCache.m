@@ -0,0 +1,140 @@
+/**
+ * @file ReblogFormCache.m
+ * @brief ReblogFormCache class implementation
+ */
+#import "ReblogFormCache.h"
+#import "DebugLog.h"
+
+/// 既定の容量. 同時に扱う Reblog 対象はたかだか数十
+static NSUInteger DEFAULT_CAPACITY = 32;
+
+/// 既定の有効期間. 編集シートや再試行、別の tumblelog への Reblog をまかなえる程度
+static NSTimeInterval DEFAULT_TIME_TO_LIVE = 600.0;
+
+/// form_key の既定の有効期間. Tumblr のセッションより十分短くしておく
+static NSTimeInterval DEFAULT_FORM_KEY_TIME_TO_LIVE = 300.0;
+
+static NSString * ENTRY_FIELDS = @"fields";
+static NSString * ENTRY_EXPIRES = @"expires";
+
+@interface ReblogFormCache ()
++ (NSString *)keyWithPostID:(NSString *)postID reblogKey:(NSString *)reblogKey;
+- (void)removeEntryForKey:(NSString *)key;
+@end
+
+@implementation ReblogFormCache
+
+@synthesize capacity = capacity_;
+@synthesize timeToLive = timeToLive_;
+@synthesize formKeyTimeToLive = formKeyTimeToLive_;
+@synthesize hits = hits_;
+@synthesize misses = misses_;
+@synthesize evictions = evictions_;
+
++ (ReblogFormCache *)sharedInstance
+{
+	static ReblogFormCache * instance = nil;
+	if (instance == nil) {
+		instance = [[ReblogFormCache alloc] init];
+	}
+	return instance;
+}
+
++ (NSString *)keyWithPostID:(NSString *)postID reblogKey:(NSString *)reblogKey
+{
+	return [NSString stringWithFormat:@"%@/%@", postID, reblogKey];
+}
+
+- (id)init
+{
+	if ((self = [super init]) != nil) {
+		entries_ = [[NSMutableDictionary alloc] init];
+		order_ = [[NSMutableArray alloc] init];
+		capacity_ = DEFAULT_CAPACITY;
+		timeToLive_ = DEFAULT_TIME_TO_LIVE;
+		formKeyTimeToLive_ = DEFAULT_FORM_KEY_TIME_TO_LIVE;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[entries_ release], entries_ = nil;
+	[order_ release], order_ = nil;
+	[super dealloc];
+}
+
+- (NSDictionary *)fieldsForPostID:(NSString *)postID reblogKey:(NSString *)reblogKey
+{
+	if (postID == nil || reblogKey == nil) return nil;
+
+	NSString * key = [ReblogFormCache keyWithPostID:postID reblogKey:reblogKey];
+	NSDictionary * entry = [entries_ objectForKey:key];
+	if (entry == nil) {
+		++misses_;
+		return nil;
+	}
+
+	if ([[entry objectForKey:ENTRY_EXPIRES] timeIntervalSinceNow] <= 0) {
+		D(@"expired: %@", key);
+		[self removeEntryForKey:key];
+		++evictions_;
+		++misses_;
+		return nil;
+	}
+
+	// 最近使ったものとして末尾へ
+	[order_ removeObject:key];
+	[order_ addObject:key];
+	++hits_;
+	D(@"hit: %@ hits=%u misses=%u", key, hits_, misses_);
+	return [entry objectForKey:ENTRY_FIELDS];
+}
+
+- (void)setFields:(NSDictionary *)fields forPostID:(NSString *)postID reblogKey:(NSString *)reblogKey
+{
+	if (fields == nil || postID == nil || reblogKey == nil || capacity_ == 0) return;
+
+	NSTimeInterval lifetime = timeToLive_;
+	if ([fields objectForKey:@"form_key"] != nil && formKeyTimeToLive_ < lifetime) {
+		lifetime = formKeyTimeToLive_;
+	}
+
+	NSString * key = [ReblogFormCache keyWithPostID:postID reblogKey:reblogKey];
+	NSDictionary * entry = [NSDictionary dictionaryWithObjectsAndKeys:
+		[[fields copy] autorelease], ENTRY_FIELDS,
+		[NSDate dateWithTimeIntervalSinceNow:lifetime], ENTRY_EXPIRES,
+		nil];
+	[order_ removeObject:key];
+	[entries_ setObject:entry forKey:key];
+	[order_ addObject:key];
+
+	// 容量を超えた分を古いほうから捨てる
+	while ([order_ count] > capacity_) {
+		[self removeEntryForKey:[order_ objectAtIndex:0]];
+		++evictions_;
+	}
+}
+
+- (void)removeFieldsForPostID:(NSString *)postID reblogKey:(NSString *)reblogKey
+{
+	if (postID == nil || reblogKey == nil) return;
+	[self removeEntryForKey:[ReblogFormCache keyWithPostID:postID reblogKey:reblogKey]];
+}
+
+- (void)removeAllFields
+{
+	[entries_ removeAllObjects];
+	[order_ removeAllObjects];
+}
+
+#pragma mark -
+#pragma mark Private Methods
+
+- (void)removeEntryForKey:(NSString *)key
+{
+	[[key retain] autorelease];
+	[entries_ removeObjectForKey:key];
+	[order_ removeObject:key];
+}
+@end
@@ -0,0 +1,44 @@
+/**
+ * @file ReblogFormParser.h
+ * @brief ReblogFormParser class declaration
+ */
+#import <Foundation/Foundation.h>
+
+/**
+ * Reblog フォームの要素
+ *	TumblrReblogExtractor が DOMHTMLElement から読むもの(tagName, getAttribute:, innerHTML)だけを持つ.
+ */
+@interface ReblogFormElement : NSObject
+{
+	NSString * tagName_;
+	NSDictionary * attributes_;
+	NSString * innerHTML_;
+}
+
+/// タグ名(大文字)
+@property (nonatomic, readonly) NSString * tagName;
+
+/// 要素の中身(ソースのまま). textarea 以外は空文字列
+@property (nonatomic, readonly) NSString * innerHTML;
+
+- (NSString *)getAttribute:(NSString *)name;
+@end
+
+/**
+ * Reblog ページの HTML から Reblog フォームの要素を取り出す
+ *	DOM は作らずに HTML を先頭から一度だけ字句解析する.
+ *	取り出す要素は TumblrReblogExtractor の XPath と同じ:
+ *	- form#edit_post の中の name が "post" で始まる input
+ *	- name が "post" で始まる textarea
+ *	- input#form_key
+ *	- div#current_photo の中の img
+ */
+@interface ReblogFormParser : NSObject
+
+/**
+ * HTML を解析する
+ *	@param[in] html	Reblog ページの HTML
+ *	@return ReblogFormElement の配列(出現順)
+ */
++ (NSArray *)elementsWithHTML:(NSString *)html;
+@end
@@ -0,0 +1,246 @@
+/**
+ * @file ReblogFormParser.m
+ * @brief ReblogFormParser class implementation
+ */
+#import "ReblogFormParser.h"
+#import "NSString+Tumblrful.h"
+#import "DebugLog.h"
+
+#pragma mark -
+@interface ReblogFormElement ()
+- (id)initWithTagName:(NSString *)tagName attributes:(NSDictionary *)attributes innerHTML:(NSString *)innerHTML;
+@end
+
+@implementation ReblogFormElement
+
+@synthesize tagName = tagName_;
+@synthesize innerHTML = innerHTML_;
+
+- (id)initWithTagName:(NSString *)tagName attributes:(NSDictionary *)attributes innerHTML:(NSString *)innerHTML
+{
+	if ((self = [super init]) != nil) {
+		tagName_ = [[tagName uppercaseString] retain];
+		attributes_ = [attributes retain];
+		innerHTML_ = [innerHTML retain];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[tagName_ release], tagName_ = nil;
+	[attributes_ release], attributes_ = nil;
+	[innerHTML_ release], innerHTML_ = nil;
+	[super dealloc];
+}
+
+- (NSString *)getAttribute:(NSString *)name
+{
+	// DOMElement と同じく、無い属性は空文字列
+	NSString * value = [attributes_ objectForKey:[name lowercaseString]];
+	return value != nil ? value : EmptyString;
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@ %@>", tagName_, [attributes_ description]];
+}
+@end
+
+#pragma mark -
+/**
+ * 字句解析の状態
+ */
+typedef struct {
+	const unichar * chars;
+	NSUInteger length;
+	NSUInteger position;
+} HTMLScanner;
+
+static inline BOOL isHTMLSpace(unichar c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+static inline BOOL isASCIIAlpha(unichar c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline unichar lowerASCII(unichar c)
+{
+	return (c >= 'A' && c <= 'Z') ? (unichar)(c + ('a' - 'A')) : c;
+}
+
+/// position から needle(小文字の ASCII)が大文字小文字を無視して一致するか
+static BOOL scannerMatches(const HTMLScanner * scanner, NSUInteger position, const char * needle)
+{
+	for (NSUInteger i = 0; needle[i] != '\0'; ++i) {
+		if (position + i >= scanner->length) return NO;
+		if (lowerASCII(scanner->chars[position + i]) != (unichar)needle[i]) return NO;
+	}
+	return YES;
+}
+
+/// from 以降で needle が最初に現れる位置. 無ければ length
+static NSUInteger scannerFind(const HTMLScanner * scanner, NSUInteger from, const char * needle)
+{
+	for (NSUInteger i = from; i < scanner->length; ++i) {
+		if (lowerASCII(scanner->chars[i]) == (unichar)needle[0] && scannerMatches(scanner, i, needle)) return i;
+	}
+	return scanner->length;
+}
+
+static NSString * scannerString(const HTMLScanner * scanner, NSUInteger begin, NSUInteger end)
+{
+	return [NSString stringWithCharacters:scanner->chars + begin length:end - begin];
+}
+
+@interface ReblogFormParser ()
++ (NSString *)scanTag:(HTMLScanner *)scanner closing:(BOOL *)closing attributes:(NSMutableDictionary *)attributes;
+@end
+
+@implementation ReblogFormParser
+
+/**
+ * '<' の次から '>' の次までを読んで、タグ名を返す. 属性値は文字参照を展開して attributes に入れる
+ */
++ (NSString *)scanTag:(HTMLScanner *)scanner closing:(BOOL *)closing attributes:(NSMutableDictionary *)attributes
+{
+	const unichar * chars = scanner->chars;
+	NSUInteger const length = scanner->length;
+	NSUInteger p = scanner->position;
+
+	*closing = NO;
+	if (p < length && chars[p] == '/') {
+		*closing = YES;
+		++p;
+	}
+
+	NSUInteger const nameBegin = p;
+	while (p < length && !isHTMLSpace(chars[p]) && chars[p] != '>' && chars[p] != '/') ++p;
+	NSString * name = [scannerString(scanner, nameBegin, p) lowercaseString];
+
+	while (p < length && chars[p] != '>') {
+		if (isHTMLSpace(chars[p]) || chars[p] == '/') {
+			++p;
+			continue;
+		}
+
+		NSUInteger const keyBegin = p;
+		while (p < length && !isHTMLSpace(chars[p]) && chars[p] != '=' && chars[p] != '>' && chars[p] != '/') ++p;
+		NSString * key = [scannerString(scanner, keyBegin, p) lowercaseString];
+
+		while (p < length && isHTMLSpace(chars[p])) ++p;
+		NSString * value = EmptyString;
+		if (p < length && chars[p] == '=') {
+			++p;
+			while (p < length && isHTMLSpace(chars[p])) ++p;
+			if (p < length && (chars[p] == '"' || chars[p] == '\'')) {
+				unichar const quote = chars[p++];
+				NSUInteger const valueBegin = p;
+				while (p < length && chars[p] != quote) ++p;
+				value = scannerString(scanner, valueBegin, p);
+				if (p < length) ++p;
+			}
+			else {
+				NSUInteger const valueBegin = p;
+				while (p < length && !isHTMLSpace(chars[p]) && chars[p] != '>') ++p;
+				value = scannerString(scanner, valueBegin, p);
+			}
+			value = [value stringByUnescapingFromHTML];
+		}
+		// DOM と同じく、同じ名前の属性は最初のものを使う
+		if ([key length] > 0 && [attributes objectForKey:key] == nil) {
+			[attributes setObject:value forKey:key];
+		}
+	}
+
+	scanner->position = p < length ? p + 1 : length;
+	return name;
+}
+
++ (NSArray *)elementsWithHTML:(NSString *)html
+{
+	NSMutableArray * elements = [NSMutableArray array];
+
+	NSUInteger const length = [html length];
+	unichar * chars = (unichar *)malloc(sizeof(unichar) * (length + 1));
+	if (chars == NULL) return elements;
+	[html getCharacters:chars range:NSMakeRange(0, length)];
+
+	HTMLScanner scanner = { chars, length, 0 };
+	BOOL inEditForm = NO;
+	NSUInteger photoDivDepth = 0;	// div#current_photo の中にいる間は 1 以上
+
+	NSMutableDictionary * attributes = [NSMutableDictionary dictionary];
+	while (scanner.position < length) {
+		NSUInteger const lt = scannerFind(&scanner, scanner.position, "<");
+		if (lt >= length) break;
+		scanner.position = lt + 1;
+
+		// コメントと宣言は読み飛ばす
+		if (scannerMatches(&scanner, scanner.position, "!--")) {
+			NSUInteger const end = scannerFind(&scanner, scanner.position + 3, "-->");
+			scanner.position = end < length ? end + 3 : length;
+			continue;
+		}
+		if (scanner.position < length && (chars[scanner.position] == '!' || chars[scanner.position] == '?')) {
+			NSUInteger const end = scannerFind(&scanner, scanner.position, ">");
+			scanner.position = end < length ? end + 1 : length;
+			continue;
+		}
+		if (scanner.position >= length || !(chars[scanner.position] == '/' || isASCIIAlpha(chars[scanner.position]))) {
+			continue;	// タグではない '<'
+		}
+
+		BOOL closing;
+		[attributes removeAllObjects];
+		NSString * tag = [self scanTag:&scanner closing:&closing attributes:attributes];
+
+		if (closing) {
+			if ([tag isEqualToString:@"form"]) inEditForm = NO;
+			else if ([tag isEqualToString:@"div"] && photoDivDepth > 0) --photoDivDepth;
+			continue;
+		}
+
+		if ([tag isEqualToString:@"script"] || [tag isEqualToString:@"style"]) {
+			// 中身はタグとして解釈しない
+			NSString * closer = [tag isEqualToString:@"script"] ? @"</script" : @"</style";
+			NSUInteger const end = scannerFind(&scanner, scanner.position, [closer UTF8String]);
+			scanner.position = end;
+		}
+		else if ([tag isEqualToString:@"form"]) {
+			inEditForm = [[attributes objectForKey:@"id"] isEqualToString:@"edit_post"];
+		}
+		else if ([tag isEqualToString:@"div"]) {
+			if (photoDivDepth > 0) ++photoDivDepth;
+			else if ([[attributes objectForKey:@"id"] isEqualToString:@"current_photo"]) photoDivDepth = 1;
+		}
+		else if ([tag isEqualToString:@"input"]) {
+			NSString * name = [attributes objectForKey:@"name"];
+			if ((inEditForm && [name hasPrefix:@"post"]) || [[attributes objectForKey:@"id"] isEqualToString:@"form_key"]) {
+				[elements addObject:[[[ReblogFormElement alloc] initWithTagName:tag attributes:[[attributes copy] autorelease] innerHTML:EmptyString] autorelease]];
+			}
+		}
+		else if ([tag isEqualToString:@"textarea"]) {
+			// textarea の中身はテキストとして扱う. 開始タグ直後の改行は DOM と同じく捨てる
+			NSUInteger begin = scanner.position;
+			if (begin < length && chars[begin] == '\r') ++begin;
+			if (begin < length && chars[begin] == '\n') ++begin;
+			NSUInteger const end = scannerFind(&scanner, begin, "</textarea");
+			if ([[attributes objectForKey:@"name"] hasPrefix:@"post"]) {
+				NSString * inner = scannerString(&scanner, begin, end);
+				[elements addObject:[[[ReblogFormElement alloc] initWithTagName:tag attributes:[[attributes copy] autorelease] innerHTML:inner] autorelease]];
+			}
+			scanner.position = end;
+		}
+		else if ([tag isEqualToString:@"img"] && photoDivDepth > 0) {
+			[elements addObject:[[[ReblogFormElement alloc] initWithTagName:tag attributes:[[attributes copy] autorelease] innerHTML:EmptyString] autorelease]];
+		}
+	}
+
+	free(chars);
+	return elements;
+}
+@end
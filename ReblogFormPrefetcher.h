@@ -0,0 +1,35 @@
+/**
+ * @file ReblogFormPrefetcher.h
+ * @brief ReblogFormPrefetcher class declaration
+ */
+#import <Foundation/Foundation.h>
+#import "TumblrReblogExtractor.h"
+
+/**
+ * コンテキストメニューが出ている間に Reblog フォームを先に取得しておく
+ *	UserSettings の "tumblrReblogPrefetchEnabled" が YES のときだけ動く.
+ *	取得結果は ReblogFormCache に入れる. メニューが閉じられて誰も使わなかった取得は中止する.
+ */
+@interface ReblogFormPrefetcher : NSObject<TumblrReblogExtractorDelegate>
+{
+	NSMutableDictionary * inflight_;	///< key -> TumblrReblogExtractor
+	NSMutableDictionary * waiters_;		///< key -> 結果を待っている TumblrReblogExtractor の配列
+}
+
++ (ReblogFormPrefetcher *)sharedInstance;
+
+/**
+ * 先読みを開始する. 無効設定, キャッシュ済み, 取得中のときは何もしない
+ *	@param[in] postID	Post ID
+ *	@param[in] reblogKey	Reblog key
+ */
+- (void)prefetchWithPostID:(NSString *)postID reblogKey:(NSString *)reblogKey;
+
+/**
+ * 取得中の先読みがあれば、その結果を待つ
+ *	結果が出たら waiter に deliverContents: を, 失敗したら fetch を送る.
+ *	@param[in] waiter	結果を受け取る extractor
+ *	@return 取得中の先読みがあれば YES
+ */
+- (BOOL)addWaiter:(TumblrReblogExtractor *)waiter;
+@end
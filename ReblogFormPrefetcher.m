@@ -0,0 +1,150 @@
+/**
+ * @file ReblogFormPrefetcher.m
+ * @brief ReblogFormPrefetcher class implementation
+ */
+#import "ReblogFormPrefetcher.h"
+#import "ReblogFormCache.h"
+#import "UserSettings.h"
+#import "DebugLog.h"
+#import <AppKit/AppKit.h>
+
+/// メニューが閉じてから未使用の先読みを中止するまでの猶予(秒). メニュー項目のアクションはこの間に走る
+static NSTimeInterval CANCEL_DELAY = 1.0;
+
+@interface ReblogFormPrefetcher ()
++ (NSString *)keyWithPostID:(NSString *)postID reblogKey:(NSString *)reblogKey;
+- (void)menuDidEndTracking:(NSNotification *)notification;
+- (void)cancelUnclaimed;
+- (NSArray *)finishExtractor:(TumblrReblogExtractor *)extractor;
+@end
+
+@implementation ReblogFormPrefetcher
+
++ (ReblogFormPrefetcher *)sharedInstance
+{
+	static ReblogFormPrefetcher * instance = nil;
+	if (instance == nil) {
+		instance = [[ReblogFormPrefetcher alloc] init];
+	}
+	return instance;
+}
+
++ (NSString *)keyWithPostID:(NSString *)postID reblogKey:(NSString *)reblogKey
+{
+	return [NSString stringWithFormat:@"%@/%@", postID, reblogKey];
+}
+
+- (id)init
+{
+	if ((self = [super init]) != nil) {
+		inflight_ = [[NSMutableDictionary alloc] init];
+		waiters_ = [[NSMutableDictionary alloc] init];
+		[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(menuDidEndTracking:) name:NSMenuDidEndTrackingNotification object:nil];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	[inflight_ release], inflight_ = nil;
+	[waiters_ release], waiters_ = nil;
+	[super dealloc];
+}
+
+- (void)prefetchWithPostID:(NSString *)postID reblogKey:(NSString *)reblogKey
+{
+	if (postID == nil || reblogKey == nil) return;
+	if (![[UserSettings sharedInstance] boolForKey:@"tumblrReblogPrefetchEnabled"]) return;
+
+	NSString * key = [ReblogFormPrefetcher keyWithPostID:postID reblogKey:reblogKey];
+	if ([inflight_ objectForKey:key] != nil) return;
+	if ([[ReblogFormCache sharedInstance] fieldsForPostID:postID reblogKey:reblogKey] != nil) return;
+
+	D(@"prefetch: %@", key);
+	TumblrReblogExtractor * extractor = [[TumblrReblogExtractor alloc] initWithDelegate:self];
+	extractor.headless = YES;
+	[inflight_ setObject:extractor forKey:key];
+	[extractor fetchWithPostID:postID withReblogKey:reblogKey];
+}
+
+- (BOOL)addWaiter:(TumblrReblogExtractor *)waiter
+{
+	NSString * key = [ReblogFormPrefetcher keyWithPostID:waiter.postID reblogKey:waiter.reblogKey];
+	if ([inflight_ objectForKey:key] == nil) return NO;
+
+	NSMutableArray * waiters = [waiters_ objectForKey:key];
+	if (waiters == nil) {
+		waiters = [NSMutableArray array];
+		[waiters_ setObject:waiters forKey:key];
+	}
+	[waiters addObject:waiter];
+	D(@"attached to prefetch: %@", key);
+	return YES;
+}
+
+#pragma mark -
+#pragma mark Private Methods
+
+- (void)menuDidEndTracking:(NSNotification *)notification
+{
+#pragma unused (notification)
+	if ([inflight_ count] == 0) return;
+
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(cancelUnclaimed) object:nil];
+	[self performSelector:@selector(cancelUnclaimed) withObject:nil afterDelay:CANCEL_DELAY];
+}
+
+/// メニューが閉じられた後も誰も待っていない先読みを中止する
+- (void)cancelUnclaimed
+{
+	for (NSString * key in [inflight_ allKeys]) {
+		if ([waiters_ objectForKey:key] != nil) continue;
+
+		D(@"cancel prefetch: %@", key);
+		TumblrReblogExtractor * extractor = [inflight_ objectForKey:key];
+		[extractor cancel];
+		[inflight_ removeObjectForKey:key];
+	}
+}
+
+/// 取得中の一覧から外して、待っていた extractor を返す
+- (NSArray *)finishExtractor:(TumblrReblogExtractor *)extractor
+{
+	NSString * key = [ReblogFormPrefetcher keyWithPostID:extractor.postID reblogKey:extractor.reblogKey];
+	NSArray * waiters = [[[waiters_ objectForKey:key] retain] autorelease];
+	[waiters_ removeObjectForKey:key];
+	[inflight_ removeObjectForKey:key];
+	return waiters;
+}
+
+#pragma mark -
+#pragma mark TumblrReblogExtractorDelegate Methods
+
+- (void)extractor:(TumblrReblogExtractor *)extractor didFinishExtract:(NSDictionary *)contents
+{
+	// ReblogFormCache へは extractor 自身が入れている
+	for (TumblrReblogExtractor * waiter in [self finishExtractor:extractor]) {
+		[waiter deliverContents:contents];
+	}
+}
+
+- (void)extractor:(TumblrReblogExtractor *)extractor didFailExtractWithError:(NSError *)error
+{
+	D0([error description]);
+
+	// 先読みの失敗は表に出さず、待っていたものは自分で取得し直す
+	for (TumblrReblogExtractor * waiter in [self finishExtractor:extractor]) {
+		[waiter fetchWithPostID:waiter.postID withReblogKey:waiter.reblogKey];
+	}
+}
+
+- (void)extractor:(TumblrReblogExtractor *)extractor didFailExtractWithException:(NSException *)exception
+{
+	D0([exception description]);
+
+	for (TumblrReblogExtractor * waiter in [self finishExtractor:extractor]) {
+		[waiter fetchWithPostID:waiter.postID withReblogKey:waiter.reblogKey];
+	}
+}
+@end
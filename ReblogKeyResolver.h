@@ -0,0 +1,38 @@
+/**
+ * @file ReblogKeyResolver.h
+ * @brief ReblogKeyResolver class declaration
+ */
+#import <Foundation/Foundation.h>
+
+@class DOMHTMLDocument;
+
+/**
+ * フィードリーダー(LDR, Fastladder, Google Reader)のページに見えている Tumblr のポストの reblog-key をまとめて引く
+ *	ページ内の "http://<tumblelog>.tumblr.com/post/<id>" へのリンクを tumblelog ごとに集め、
+ *	read API(/api/read?start=&num=50)を tumblelog ごとに数回だけ呼んで postID -> reblog-key の表を作る.
+ *	AggregatorReblogDeliverer は表に載っていれば read API を待たずに Reblog する.
+ *	見つからなかったポストは従来どおり1件ずつ引く.
+ */
+@interface ReblogKeyResolver : NSObject
+{
+	NSMutableDictionary * reblogKeys_;	///< postID -> reblog-key
+	NSMutableDictionary * unresolved_;	///< host -> まだ引いていない postID の集合
+	NSMutableSet * tried_;				///< 一度引きに行った postID. 見つからなくても再び引かない
+	NSMutableDictionary * batches_;		///< host -> 取得中のバッチ
+}
+
++ (ReblogKeyResolver *)sharedInstance;
+
+/**
+ * ページに見えている Tumblr のポストを集め、まだ知らないものの reblog-key をバックグラウンドで引き始める
+ *	@param[in] document	フィードリーダーのページ
+ */
+- (void)resolveDocument:(DOMHTMLDocument *)document;
+
+/**
+ * 引き済みの reblog-key
+ *	@param[in] postID	Post ID
+ *	@return reblog-key. まだ無ければ nil
+ */
+- (NSString *)reblogKeyForPostID:(NSString *)postID;
+@end
@@ -0,0 +1,334 @@
+/**
+ * @file ReblogKeyResolver.m
+ * @brief ReblogKeyResolver class implementation
+ */
+#import "ReblogKeyResolver.h"
+#import "HTTPSession.h"
+#import "XMLPathScanner.h"
+#import "DebugLog.h"
+#import <WebKit/WebKit.h>
+
+#define TIMEOUT	(30)
+
+/// read API が1回で返すポスト数の上限
+static NSUInteger PAGE_SIZE = 50;
+
+/// tumblelog ごとに引くページ数の上限. フィードに出ているのはたいてい最近のポスト
+static NSUInteger MAX_PAGES = 3;
+
+/// 1回の resolveDocument: で引き始める tumblelog の数の上限. 残りは次の機会に引く
+static NSUInteger MAX_HOSTS_PER_SCAN = 8;
+
+/// 表に持つ postID の数の上限. 超えたら作り直す
+static NSUInteger MAX_KEYS = 2000;
+
+@class ReblogKeyBatch;
+
+@interface ReblogKeyResolver ()
+- (void)startBatchForHost:(NSString *)host start:(NSUInteger)start;
+- (void)batch:(ReblogKeyBatch *)batch didResolvePosts:(NSArray *)posts;
+- (void)batchDidFail:(ReblogKeyBatch *)batch;
+- (void)giveUpHost:(NSString *)host;
+@end
+
+#pragma mark -
+
+/**
+ * 1つの tumblelog の read API 1ページ分を引いて ReblogKeyResolver に戻す
+ */
+@interface ReblogKeyBatch : NSObject
+{
+	ReblogKeyResolver * resolver_;	///< singleton なので assign
+	NSString * host_;
+	NSUInteger start_;
+	id task_;
+	NSMutableData * data_;
+	NSInteger statusCode_;
+	NSDate * startDate_;
+}
+@property (nonatomic, readonly) NSString * host;
+@property (nonatomic, readonly) NSUInteger start;
+@property (nonatomic, readonly) NSDate * startDate;
+- (id)initWithResolver:(ReblogKeyResolver *)resolver host:(NSString *)host start:(NSUInteger)start;
+- (BOOL)startRequest;
+@end
+
+@implementation ReblogKeyBatch
+
+@synthesize host = host_;
+@synthesize start = start_;
+@synthesize startDate = startDate_;
+
+- (id)initWithResolver:(ReblogKeyResolver *)resolver host:(NSString *)host start:(NSUInteger)start
+{
+	if ((self = [super init]) != nil) {
+		resolver_ = resolver;
+		host_ = [host copy];
+		start_ = start;
+		data_ = [[NSMutableData alloc] init];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[host_ release], host_ = nil;
+	[task_ release], task_ = nil;
+	[data_ release], data_ = nil;
+	[startDate_ release], startDate_ = nil;
+
+	[super dealloc];
+}
+
+- (BOOL)startRequest
+{
+	NSString * endpoint = [NSString stringWithFormat:@"http://%@/api/read?start=%u&num=%u", host_, start_, PAGE_SIZE];
+	D(@"API endpoint=%@", endpoint);
+
+	NSURLRequest * request = [NSURLRequest requestWithURL:[NSURL URLWithString:endpoint] cachePolicy:NSURLRequestReloadIgnoringCacheData timeoutInterval:TIMEOUT];
+	[startDate_ release], startDate_ = [[NSDate alloc] init];
+	task_ = [[[HTTPSession sharedSession] startRequest:request delegate:self] retain];
+	return task_ != nil;
+}
+
+/**
+ * 応答からポストごとの属性(id, reblog-key)を集める(別スレッドで動く)
+ *	@param[in] data	read API の応答
+ */
+- (void)parseData:(NSData *)data
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+
+	NSArray * posts = nil;
+	@try {
+		NSError * error = nil;
+		posts = [XMLPathScanner attributesForPath:@"/tumblr/posts/post" inData:data error:&error];
+		if (posts == nil) {
+			D(@"Unrecognize Tumblr read XML. %@", [error description]);
+		}
+	}
+	@catch (NSException * e) {
+		D0([e description]);
+		posts = nil;
+	}
+	[self performSelectorOnMainThread:@selector(didParsePosts:) withObject:posts waitUntilDone:NO];
+
+	[pool release];
+}
+
+- (void)didParsePosts:(NSArray *)posts
+{
+	if (posts != nil) {
+		[resolver_ batch:self didResolvePosts:posts];
+	}
+	else {
+		[resolver_ batchDidFail:self];
+	}
+}
+
+#pragma mark -
+#pragma mark NSURLConnection delegate
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+#pragma unused (connection)
+	statusCode_ = [(NSHTTPURLResponse *)response statusCode];
+	[data_ setLength:0];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+#pragma unused (connection)
+	[data_ appendData:data];
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection
+{
+#pragma unused (connection)
+	[task_ release], task_ = nil;
+
+	if (statusCode_ != 200) {
+		D(@"statusCode:%d host:%@", statusCode_, host_);
+		[resolver_ batchDidFail:self];
+		return;
+	}
+
+	// 50件分の応答は大きいので main thread の外で読む
+	[NSThread detachNewThreadSelector:@selector(parseData:) toTarget:self withObject:[[data_ copy] autorelease]];
+}
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+#pragma unused (connection)
+	[task_ release], task_ = nil;
+
+	D(@"host:%@ error:%@", host_, [error description]);
+	[resolver_ batchDidFail:self];
+}
+@end
+
+#pragma mark -
+
+@implementation ReblogKeyResolver
+
++ (ReblogKeyResolver *)sharedInstance
+{
+	static ReblogKeyResolver * instance = nil;
+	if (instance == nil) {
+		instance = [[ReblogKeyResolver alloc] init];
+	}
+	return instance;
+}
+
+- (id)init
+{
+	if ((self = [super init]) != nil) {
+		reblogKeys_ = [[NSMutableDictionary alloc] init];
+		unresolved_ = [[NSMutableDictionary alloc] init];
+		tried_ = [[NSMutableSet alloc] init];
+		batches_ = [[NSMutableDictionary alloc] init];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[reblogKeys_ release], reblogKeys_ = nil;
+	[unresolved_ release], unresolved_ = nil;
+	[tried_ release], tried_ = nil;
+	[batches_ release], batches_ = nil;
+
+	[super dealloc];
+}
+
+- (void)resolveDocument:(DOMHTMLDocument *)document
+{
+	static NSString * XPath = @"//a[contains(@href, '.tumblr.com/post/')]";
+
+	@try {
+		DOMXPathResult * result = [document evaluate:XPath contextNode:document resolver:nil type:DOM_ANY_TYPE inResult:nil];
+		if (result == nil || [result invalidIteratorState]) return;
+
+		NSUInteger found = 0;
+		for (DOMHTMLElement * element; (element = (DOMHTMLElement *)[result iterateNext]) != nil; ) {
+			// href="http://<tumblelog>.tumblr.com/post/<id>/<slug>" の形
+			NSURL * u = [NSURL URLWithString:[element getAttribute:@"href"]];
+			NSString * host = [[u host] lowercaseString];
+			if (![host hasSuffix:@".tumblr.com"]) continue;
+
+			NSArray * components = [[u path] pathComponents];
+			NSUInteger const index = [components indexOfObject:@"post"];
+			if (index == NSNotFound || index + 1 >= [components count]) continue;
+			NSString * postID = [components objectAtIndex:index + 1];
+			if ([postID longLongValue] <= 0 || ![postID isEqualToString:[NSString stringWithFormat:@"%qi", [postID longLongValue]]]) continue;
+
+			if ([reblogKeys_ objectForKey:postID] != nil || [tried_ containsObject:postID]) continue;
+
+			NSMutableSet * postIDs = [unresolved_ objectForKey:host];
+			if (postIDs == nil) {
+				postIDs = [NSMutableSet set];
+				[unresolved_ setObject:postIDs forKey:host];
+			}
+			[postIDs addObject:postID];
+			++found;
+		}
+		D(@"%u unresolved posts on %u tumblelogs", found, [unresolved_ count]);
+
+		NSUInteger started = 0;
+		for (NSString * host in [unresolved_ allKeys]) {
+			if (started >= MAX_HOSTS_PER_SCAN) break;
+			if ([batches_ objectForKey:host] != nil) continue;
+			[self startBatchForHost:host start:0];
+			++started;
+		}
+	}
+	@catch (NSException * e) {
+		D0([e description]);
+	}
+}
+
+- (NSString *)reblogKeyForPostID:(NSString *)postID
+{
+	if (postID == nil) return nil;
+	return [reblogKeys_ objectForKey:postID];
+}
+
+#pragma mark -
+#pragma mark Private Methods
+
+- (void)startBatchForHost:(NSString *)host start:(NSUInteger)start
+{
+	ReblogKeyBatch * batch = [[[ReblogKeyBatch alloc] initWithResolver:self host:host start:start] autorelease];
+	if (![batch startRequest]) {
+		[self giveUpHost:host];
+		return;
+	}
+	[batches_ setObject:batch forKey:host];
+}
+
+- (void)batch:(ReblogKeyBatch *)batch didResolvePosts:(NSArray *)posts
+{
+	NSString * host = [[batch.host retain] autorelease];
+	NSMutableSet * remaining = [unresolved_ objectForKey:host];
+
+	if ([reblogKeys_ count] + [posts count] > MAX_KEYS) {
+		[reblogKeys_ removeAllObjects];
+	}
+
+	long long oldest = LLONG_MAX;
+	for (NSDictionary * post in posts) {
+		NSString * postID = [post objectForKey:@"id"];
+		NSString * reblogKey = [post objectForKey:@"reblog-key"];
+		if (postID == nil || reblogKey == nil) continue;
+
+		[reblogKeys_ setObject:reblogKey forKey:postID];
+		[remaining removeObject:postID];
+		oldest = MIN(oldest, [postID longLongValue]);
+	}
+	D(@"%@: %u posts (start=%u) in %.3fs, %u remaining", host, [posts count], batch.start, -[batch.startDate timeIntervalSinceNow], [remaining count]);
+
+	[[batch retain] autorelease];
+	[batches_ removeObjectForKey:host];
+
+	// 残りがこのページより古いポストなら次のページを引く
+	BOOL older = NO;
+	for (NSString * postID in remaining) {
+		if ([postID longLongValue] < oldest) {
+			older = YES;
+			break;
+		}
+	}
+	NSUInteger const next = batch.start + PAGE_SIZE;
+	if (older && [posts count] >= PAGE_SIZE && next < PAGE_SIZE * MAX_PAGES) {
+		[self startBatchForHost:host start:next];
+		return;
+	}
+
+	[self giveUpHost:host];
+}
+
+- (void)batchDidFail:(ReblogKeyBatch *)batch
+{
+	NSString * host = [[batch.host retain] autorelease];
+
+	[[batch retain] autorelease];
+	[batches_ removeObjectForKey:host];
+	[self giveUpHost:host];
+}
+
+/**
+ * 残りは AggregatorReblogDeliverer が1件ずつ引くのに任せる
+ *	@param[in] host	tumblelog のホスト名
+ */
+- (void)giveUpHost:(NSString *)host
+{
+	NSSet * remaining = [unresolved_ objectForKey:host];
+	if (remaining != nil) {
+		if ([tried_ count] + [remaining count] > MAX_KEYS) {
+			[tried_ removeAllObjects];
+		}
+		[tried_ unionSet:remaining];
+		[unresolved_ removeObjectForKey:host];
+	}
+}
+@end
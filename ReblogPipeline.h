@@ -0,0 +1,41 @@
+/**
+ * @file ReblogPipeline.h
+ * @brief ReblogPipeline class declaration
+ */
+#import <Foundation/Foundation.h>
+
+/**
+ * 複数のポストをまとめて Reblog する
+ *	フォームの抽出とポストを別々の段として並行に流す. どちらの段も同時に走るのは concurrency 個まで.
+ *	抽出結果は ReblogFormCache を通してポストの段へ渡る.
+ *	進捗は同じ identifier の Growl 通知1つで知らせる.
+ */
+@interface ReblogPipeline : NSObject
+{
+	NSMutableArray * extractQueue_;	///< 抽出待ちのトークン
+	NSMutableArray * postQueue_;	///< 抽出済みでポスト待ちのトークン
+	NSUInteger concurrency_;
+	NSUInteger extracting_;
+	NSUInteger posting_;
+	NSUInteger total_;
+	NSUInteger succeeded_;
+	NSUInteger failed_;
+	NSDate * startDate_;
+	NSString * identifier_;
+}
+
+/// 各段の同時実行数. 初期値は UserSettings の "tumblrBulkReblogConcurrency"(無ければ 3, 最大 8)
+@property (nonatomic, assign) NSUInteger concurrency;
+
+/**
+ * 初期化する
+ *	@param[in] tokens	"pid" と "rk" を持つ辞書の配列(ReblogDeliverer の形式)
+ *	@return 初期化したオブジェクト
+ */
+- (id)initWithTokens:(NSArray *)tokens;
+
+/**
+ * 開始する. 全部終わるまで自分自身を保持する
+ */
+- (void)start;
+@end
@@ -0,0 +1,222 @@
+/**
+ * @file ReblogPipeline.m
+ * @brief ReblogPipeline class implementation
+ */
+#import "ReblogPipeline.h"
+#import "TumblrReblogExtractor.h"
+#import "TumblrPostAdaptor.h"
+#import "PostCallback.h"
+#import "GrowlSupport.h"
+#import "UserSettings.h"
+#import "DebugLog.h"
+
+static NSUInteger DEFAULT_CONCURRENCY = 3;
+
+/// 先に抽出する分(concurrency * 2)が ReblogFormCache の容量を超えないようにする
+static NSUInteger MAX_CONCURRENCY = 8;
+
+static NSString * TITLE = @"Reblog";
+
+@interface ReblogPipeline ()
+- (void)pump;
+- (void)tokenExtracted:(NSDictionary *)token;
+- (void)tokenFinished:(NSDictionary *)token posted:(BOOL)posted succeeded:(BOOL)succeeded;
+- (void)notifyProgress;
+@end
+
+#pragma mark -
+
+/**
+ * トークン1つ分の抽出とポストの結果を ReblogPipeline に戻す
+ */
+@interface ReblogPipelineJob : NSObject<TumblrReblogExtractorDelegate, PostCallback>
+{
+	ReblogPipeline * pipeline_;	///< 全部終わるまで pipeline は自分を保持しているので assign
+	NSDictionary * token_;
+}
+- (id)initWithPipeline:(ReblogPipeline *)pipeline token:(NSDictionary *)token;
+@end
+
+@implementation ReblogPipelineJob
+
+- (id)initWithPipeline:(ReblogPipeline *)pipeline token:(NSDictionary *)token
+{
+	if ((self = [super init]) != nil) {
+		pipeline_ = pipeline;
+		token_ = [token retain];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[token_ release], token_ = nil;
+	[super dealloc];
+}
+
+#pragma mark -
+#pragma mark TumblrReblogExtractorDelegate Methods
+
+- (void)extractor:(TumblrReblogExtractor *)extractor didFinishExtract:(NSDictionary *)contents
+{
+#pragma unused (extractor)
+	if (contents == nil || [contents count] < 2) {
+		D(@"unrecognized form: %@", [token_ objectForKey:@"pid"]);
+		[pipeline_ tokenFinished:token_ posted:NO succeeded:NO];
+		return;
+	}
+	[pipeline_ tokenExtracted:token_];
+}
+
+- (void)extractor:(TumblrReblogExtractor *)extractor didFailExtractWithError:(NSError *)error
+{
+#pragma unused (extractor, error)
+	D0([error description]);
+	[pipeline_ tokenFinished:token_ posted:NO succeeded:NO];
+}
+
+- (void)extractor:(TumblrReblogExtractor *)extractor didFailExtractWithException:(NSException *)exception
+{
+#pragma unused (extractor, exception)
+	D0([exception description]);
+	[pipeline_ tokenFinished:token_ posted:NO succeeded:NO];
+}
+
+#pragma mark -
+#pragma mark PostCallback Methods
+
+- (void)successed:(NSString *)response
+{
+#pragma unused (response)
+	[pipeline_ tokenFinished:token_ posted:YES succeeded:YES];
+}
+
+- (void)failedWithError:(NSError *)error
+{
+#pragma unused (error)
+	D0([error description]);
+	[pipeline_ tokenFinished:token_ posted:YES succeeded:NO];
+}
+
+- (void)failedWithException:(NSException *)exception
+{
+#pragma unused (exception)
+	D0([exception description]);
+	[pipeline_ tokenFinished:token_ posted:YES succeeded:NO];
+}
+@end
+
+#pragma mark -
+
+@implementation ReblogPipeline
+
+@synthesize concurrency = concurrency_;
+
+- (id)initWithTokens:(NSArray *)tokens
+{
+	if ((self = [super init]) != nil) {
+		extractQueue_ = [[NSMutableArray alloc] initWithArray:tokens];
+		postQueue_ = [[NSMutableArray alloc] init];
+		total_ = [tokens count];
+
+		NSInteger const concurrency = [[[UserSettings sharedInstance] stringForKey:@"tumblrBulkReblogConcurrency"] integerValue];
+		concurrency_ = concurrency > 0 ? MIN((NSUInteger)concurrency, MAX_CONCURRENCY) : DEFAULT_CONCURRENCY;
+		identifier_ = [[NSString alloc] initWithFormat:@"ReblogPipeline-%p", self];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[extractQueue_ release], extractQueue_ = nil;
+	[postQueue_ release], postQueue_ = nil;
+	[startDate_ release], startDate_ = nil;
+	[identifier_ release], identifier_ = nil;
+	[super dealloc];
+}
+
+- (void)start
+{
+	if (startDate_ != nil || total_ == 0) return;
+
+	[self retain];	// tokenFinished: で最後のトークンが終わったら release する
+	startDate_ = [[NSDate alloc] init];
+	[self notifyProgress];
+	[self pump];
+}
+
+#pragma mark -
+#pragma mark Private Methods
+
+/// 空いている段に次のトークンを流す
+- (void)pump
+{
+	// ポスト待ちが溜まりすぎないように、抽出はポスト側に 2 段分の余裕がある間だけ進める.
+	// 抽出結果は ReblogFormCache の容量内に収まる
+	while (extracting_ < concurrency_ && [extractQueue_ count] > 0 && [postQueue_ count] + posting_ < concurrency_ * 2) {
+		NSDictionary * token = [[[extractQueue_ objectAtIndex:0] retain] autorelease];
+		[extractQueue_ removeObjectAtIndex:0];
+		++extracting_;
+
+		ReblogPipelineJob * job = [[[ReblogPipelineJob alloc] initWithPipeline:self token:token] autorelease];
+		TumblrReblogExtractor * extractor = [[TumblrReblogExtractor alloc] initWithDelegate:job];	// 終わったら自分で release する
+		[extractor startWithPostID:[token objectForKey:@"pid"] withReblogKey:[token objectForKey:@"rk"]];
+	}
+
+	while (posting_ < concurrency_ && [postQueue_ count] > 0) {
+		NSDictionary * token = [[[postQueue_ objectAtIndex:0] retain] autorelease];
+		[postQueue_ removeObjectAtIndex:0];
+		++posting_;
+
+		// TumblrPost の抽出は ReblogFormCache に当たるので、ここではポストだけが走る
+		ReblogPipelineJob * job = [[[ReblogPipelineJob alloc] initWithPipeline:self token:token] autorelease];
+		TumblrPostAdaptor * adaptor = [[[TumblrPostAdaptor alloc] initWithCallback:job] autorelease];
+		[adaptor postEntry:token];
+	}
+}
+
+- (void)tokenExtracted:(NSDictionary *)token
+{
+	--extracting_;
+	[postQueue_ addObject:token];
+	[self pump];
+}
+
+- (void)tokenFinished:(NSDictionary *)token posted:(BOOL)posted succeeded:(BOOL)succeeded
+{
+#pragma unused (token)
+	if (posted) --posting_;
+	else --extracting_;
+
+	if (succeeded) ++succeeded_;
+	else ++failed_;
+
+	[self notifyProgress];
+
+	if (succeeded_ + failed_ < total_) {
+		[self pump];
+		return;
+	}
+
+	NSTimeInterval const elapsed = -[startDate_ timeIntervalSinceNow];
+	Log(@"bulk reblog: %u posts in %.2f sec (%.2f posts/sec, concurrency %u, %u failed)", total_, elapsed, elapsed > 0 ? total_ / elapsed : 0.0, concurrency_, failed_);
+	[self release];
+}
+
+/// 同じ identifier で通知するので、Growl 上では1つの通知が更新されていく
+- (void)notifyProgress
+{
+	NSUInteger const done = succeeded_ + failed_;
+	NSString * message;
+	if (done < total_) {
+		message = [NSString stringWithFormat:@"Reblogging %u/%u posts", done, total_];
+	}
+	else {
+		message = [NSString stringWithFormat:@"Reblogged %u of %u posts (%.1f sec)", succeeded_, total_, -[startDate_ timeIntervalSinceNow]];
+	}
+	if (failed_ > 0) {
+		message = [message stringByAppendingFormat:@"\n%u failed", failed_];
+	}
+	[GrowlSupport notifyWithTitle:TITLE description:message identifier:identifier_];
+}
+@end
@@ -26,7 +26,7 @@ static NSString * SLIDESHARE_HOSTNAME = @"slideshare.net";
 	//D(@"DOMNode:%@", [node description]);
 
 	// check URL's host
-	NSURL* url = [NSURL URLWithString:[[document URL] stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+	NSURL* url = [DelivererBase URLOfDocument:document];
 	if ([[url host] hasSuffix:SLIDESHARE_HOSTNAME] == NO) {
 		return nil;
 	}
@@ -7,6 +7,7 @@
 #import "Post.h"
 #import "PostCallback.h"
 #import "TumblrReblogExtractor.h"
+#import "MultipartFormWriter.h"
 
 /**
  * TumblrPost class
@@ -19,6 +20,7 @@
 	NSMutableData* responseData_;
 	NSObject<PostCallback>* callback_; // for Deliverer
 	NSDictionary * reblogParams_;	// for Reblog
+	MultipartFormWriter * multipart_;	// for Photo. 送信が終わるまで一時ファイルを保持する
 }
 
 /// private post or not
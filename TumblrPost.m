@@ -5,9 +5,13 @@
  * @date 2008-03-07
  */
 #import "TumblrPost.h"
+#import "HTTPSession.h"
 #import "UserSettings.h"
 #import "TumblrfulConstants.h"
 #import "NSString+Tumblrful.h"
+#import "FormEncoder.h"
+#import "ImageEncoder.h"
+#import "ReblogFormCache.h"
 #import "DebugLog.h"
 #import <WebKit/WebKit.h>
 #import <Foundation/NSXMLDocument.h>
@@ -20,6 +24,7 @@ static float TIMEOUT = 60.0f;
 - (void)postWithEndpoint:(NSString *)endpointURL withParams:(NSDictionary *)params;
 - (void)postWithEndpoint:(NSString *)endpointURL withReblogContents:(NSDictionary *)contents;
 - (void)callbackOnMainThread:(SEL)selector withObject:(NSObject *)param;
+- (void)invalidateReblogForm;
 @end
 
 #pragma mark -
@@ -48,6 +53,7 @@ static float TIMEOUT = 60.0f;
 	[callback_ release], callback_ = nil;
 	[responseData_ release], responseData_ = nil;
 	[reblogParams_ release], reblogParams_ = nil;
+	[multipart_ release], multipart_ = nil;
 
 	[super dealloc];
 }
@@ -71,29 +77,14 @@ static float TIMEOUT = 60.0f;
 
 - (NSURLRequest *)createRequest:(NSString *)url params:(NSDictionary *)params
 {
-	NSMutableString * escaped = [NSMutableString string];
-
 	// create the body. add key-values paire from the NSDictionary object
-	NSEnumerator * enumerator = [params keyEnumerator];
-	NSString * key;
-	while ((key = [enumerator nextObject]) != nil) {
-        NSObject * any = [params objectForKey:key]; 
-		NSString * value;
-        if ([any isMemberOfClass:[NSURL class]]) {
-            value = [(NSURL *)any absoluteString];
-        }
-        else {
-            value = (NSString *)any;
-        }
-		value = [value stringByURLEncoding:NSUTF8StringEncoding];
-		[escaped appendFormat:@"&%@=%@", key, value];
-	}
-	D0(escaped);
+	NSData * body = [FormEncoder dataWithParams:params];
+	D(@"body=%@", [[[NSString alloc] initWithData:body encoding:NSASCIIStringEncoding] autorelease]);
 
 	// create the POST request
 	NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:url] cachePolicy:NSURLRequestReloadIgnoringCacheData timeoutInterval:TIMEOUT];
 	[request setHTTPMethod:@"POST"];
-	[request setHTTPBody:[escaped dataUsingEncoding:NSUTF8StringEncoding]];
+	[request setHTTPBody:body];
 
 	return request;
 }
@@ -132,6 +123,7 @@ static float TIMEOUT = 60.0f;
 	if (httpStatus != 201 && httpStatus != 200) {
 		D(@"statusCode:%d", httpStatus);
 		D(@"ResponseHeader:%@", [[httpResponse allHeaderFields] description]);
+		[self invalidateReblogForm];
 	}
 
 	responseData_ = [[NSMutableData data] retain];
@@ -163,41 +155,44 @@ static float TIMEOUT = 60.0f;
 #pragma unused (connection)
 	D0([error description]);
 
+	[self invalidateReblogForm];
 	[self callbackOnMainThread:@selector(failedWithError:) withObject:error];
 	[self release];
 }
 
+- (NSInputStream *)connection:(NSURLConnection *)connection needNewBodyStream:(NSURLRequest *)request
+{
+#pragma unused (connection, request)
+	// リダイレクトや認証で送り直す時は本文を先頭から読み直す
+	return [multipart_ inputStream];
+}
+
 - (NSURLRequest *)createRequest:(NSString *)url params:(NSDictionary *)params withData:(NSData *)data
 {
 	static NSString * BOUNDARY = @"0xKhTmLbOuNdArY";
 
-	// create the body
-	NSMutableData * body = [NSMutableData data];
+	// create the body. パートは一時ファイルに書き出し、送信時にストリームで読む
+	MultipartFormWriter * writer = [[[MultipartFormWriter alloc] initWithBoundary:BOUNDARY] autorelease];
+	if (writer == nil) return nil;
+
 	// add key-values from the NSDictionary object
-	NSEnumerator * enumerator = [params keyEnumerator];
-	NSString * key;
-	NSString * value;
-	while ((key = [enumerator nextObject]) != nil) {
-		value = [params objectForKey:key];
-		[body appendData:[[NSString stringWithFormat:@"--%@\n", BOUNDARY] dataUsingEncoding:NSUTF8StringEncoding]];
-		[body appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"%@\"\n\n", key] dataUsingEncoding:NSUTF8StringEncoding]];
-		[body appendData:[[NSString stringWithFormat:@"%@", value] dataUsingEncoding:NSUTF8StringEncoding]];
-		[body appendData:[[NSString stringWithString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding]];
+	NSArray * keys = [[params allKeys] sortedArrayUsingSelector:@selector(compare:)];
+	NSEnumerator * enumerator = [keys objectEnumerator];
+	for (NSString * key; (key = [enumerator nextObject]) != nil; ) {
+		if (![writer appendValue:[params objectForKey:key] forName:key]) return nil;
 	}
 
-	// add data field and file data(jpeg only)
-	[body appendData:[[NSString stringWithFormat:@"--%@\n", BOUNDARY] dataUsingEncoding:NSUTF8StringEncoding]];
-	[body appendData:[[NSString stringWithString:@"Content-Disposition: form-data; name=\"data\"\n"] dataUsingEncoding:NSUTF8StringEncoding]];
-	[body appendData:[[NSString stringWithString:@"Content-Type: image/jpeg\n\n"] dataUsingEncoding:NSUTF8StringEncoding]];
-	[body appendData:data];
-	[body appendData:[[NSString stringWithString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding]];
-	[body appendData:[[NSString stringWithFormat:@"\n--%@--\n", BOUNDARY] dataUsingEncoding:NSUTF8StringEncoding]];
+	// add data field and file data(jpeg or png)
+	if (![writer appendData:data forName:@"data" contentType:[ImageEncoder contentTypeForData:data]]) return nil;
 
 	// create the POST request. and add the body to the post
 	NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:url] cachePolicy:NSURLRequestReloadIgnoringCacheData timeoutInterval:TIMEOUT];
 	[request setHTTPMethod:@"POST"];
-	[request addValue:[NSString stringWithFormat:@"multipart/form-data; boundary=%@", BOUNDARY] forHTTPHeaderField: @"Content-Type"];
-	[request setHTTPBody:body];
+	if (![writer applyToRequest:request]) return nil;	// 一時ファイルに書けなかった(ディスクが一杯など)
+	D(@"Content-Length=%llu", writer.contentLength);
+
+	[multipart_ release];
+	multipart_ = [writer retain];
 
 	return request;
 }
@@ -224,9 +219,12 @@ static float TIMEOUT = 60.0f;
 	else {
 		request = [self createRequest:endpointURL params:params];	// request は connection に指定した時点で reatin upする
 	}
-	NSURLConnection * connection = [NSURLConnection connectionWithRequest:request delegate:self];	// autoreleased
-	if (connection == nil) {
-		[self callbackOnMainThread:@selector(failedWithError:) withObject:nil];
+	id task = [[HTTPSession sharedSession] startRequest:request delegate:self];	// 同じホストへの接続を使い回す. request が nil なら nil
+	if (task == nil) {
+		// 本文を作れなかった(一時ファイルに書けないなど)
+		NSDictionary * info = [NSDictionary dictionaryWithObject:@"Could not create the post request." forKey:NSLocalizedDescriptionKey];
+		NSError * error = [NSError errorWithDomain:TUMBLRFUL_ERROR_DOMAIN code:-1 userInfo:info];
+		[self callbackOnMainThread:@selector(failedWithError:) withObject:error];
 	}
 }
 
@@ -239,6 +237,13 @@ static float TIMEOUT = 60.0f;
 	[self postWithEndpoint:endpointURL withParams:params];
 }
 
+/// 失敗した Reblog のフォームは form_key が古い可能性があるので、再試行では取り直させる
+- (void)invalidateReblogForm
+{
+	if (reblogParams_ == nil) return;
+	[[ReblogFormCache sharedInstance] removeFieldsForPostID:[reblogParams_ objectForKey:@"pid"] reblogKey:[reblogParams_ objectForKey:@"rk"]];
+}
+
 - (void)callbackOnMainThread:(SEL)selector withObject:(NSObject *)object
 {
 	if (callback_ != nil && [callback_ respondsToSelector:selector]) {
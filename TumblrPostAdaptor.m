@@ -6,12 +6,16 @@
  */
 #import "TumblrPostAdaptor.h"
 #import "TumblrPost.h"
+#import "PostQueue.h"
+#import "ImageEncoder.h"
 #import "DebugLog.h"
 #import <AppKit/NSBitmapImageRep.h>
 
 #pragma mark -
 @interface TumblrPostAdaptor ()
 - (void)postWithType:(NSString *)type withParams:(NSDictionary *)params;
+- (void)encodePhotoInBackground:(NSDictionary *)job;
+- (void)postPhotoWithParams:(NSDictionary *)params;
 @end
 
 #pragma mark -
@@ -34,16 +38,45 @@
 		[params setObject:source forKey:@"source"];
 	}
 	else {
-		NSBitmapImageRep * imageRep = [NSBitmapImageRep imageRepWithData:[image TIFFRepresentation]];
-		NSDictionary * properties = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithFloat:1.0f], NSImageCompressionFactor, nil];
-		NSData * data = [imageRep representationUsingType:NSJPEGFileType properties:properties];
-		[params setObject:data forKey:@"data"];
+		// エンコードは重いのでバックグラウンドで行い、終わったらメインスレッドでポストする
+		NSBitmapImageRep * imageRep = [self.payload bitmapImageRepForImage:image];
+		if (imageRep != nil) {
+			NSDictionary * job = [NSDictionary dictionaryWithObjectsAndKeys:params, @"params", imageRep, @"imageRep", [ImageEncoder encoderWithUserSettings], @"encoder", nil];
+			[self performSelectorInBackground:@selector(encodePhotoInBackground:) withObject:job];
+			return;
+		}
 	}
 	D0([params description]);
 
 	[self postWithType:@"photo" withParams:params];
 }
 
+- (void)encodePhotoInBackground:(NSDictionary *)job
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	@try {
+		ImageEncoder * encoder = [job objectForKey:@"encoder"];
+		NSData * data = [self.payload encodedDataForBitmapImageRep:[job objectForKey:@"imageRep"] encoder:encoder];
+		if (data == nil) {
+			[NSException raise:NSGenericException format:@"failed to encode image"];
+		}
+
+		NSMutableDictionary * params = [job objectForKey:@"params"];
+		[params setObject:data forKey:@"data"];
+		[self performSelectorOnMainThread:@selector(postPhotoWithParams:) withObject:params waitUntilDone:NO];
+	}
+	@catch (NSException * e) {
+		D0([e description]);
+		[self performSelectorOnMainThread:@selector(callbackWithException:) withObject:e waitUntilDone:NO];
+	}
+	[pool release];
+}
+
+- (void)postPhotoWithParams:(NSDictionary *)params
+{
+	[self postWithType:@"photo" withParams:params];
+}
+
 - (void)postVideo:(NSString *)embed caption:(NSString*)caption
 {
 	[self postWithType:@"video" withParams:[NSMutableDictionary dictionaryWithObjectsAndKeys:embed, @"embed", caption, @"caption", nil]];
@@ -60,13 +93,12 @@
 - (void)postWithType:(NSString *)type withParams:(NSDictionary *)params
 {
 	@try {
-		// Tumblrへポストするオブジェクトを生成する
-		TumblrPost * tumblr = [[TumblrPost alloc] initWithCallback:callback_];
-
-		// プライベートとキューイングの設定をしておく
-		tumblr.privated = self.privated;
-		tumblr.queuingEnabled = self.queuingEnabled;
-		tumblr.extractEnabled = self.extractEnabled;
+		// プライベートとキューイングの設定は、送信する時に TumblrPost へ設定される
+		NSDictionary * options = [NSDictionary dictionaryWithObjectsAndKeys:
+			[NSNumber numberWithBool:self.privated], @"privated",
+			[NSNumber numberWithBool:self.queuingEnabled], @"queuingEnabled",
+			[NSNumber numberWithBool:self.extractEnabled], @"extractEnabled",
+			nil];
 
 		// リクエストパラメータを構築する
 		/*
@@ -96,7 +128,7 @@
 			$('create_post_button_label').innerHTML = 'Create post';
 		}
 		*/
-		NSMutableDictionary * requestParams = [tumblr createMinimumRequestParams];
+		NSMutableDictionary * requestParams = [NSMutableDictionary dictionary];	// email と password は送信する時に足される
 		// private
 		if (self.privated) {
 			if ([type isEqualToString:@"reblog"]) {
@@ -121,8 +153,8 @@
 
 		[requestParams addEntriesFromDictionary:params];
 
-		// Tumblrへポストする
-		[tumblr postWith:requestParams];
+		// 送信待ち行列に入れる. Tumblrへのポストは PostQueue が行う
+		[[PostQueue sharedQueue] enqueuePostClass:[TumblrPost class] params:requestParams options:options callback:callback_];
 	}
 	@catch (NSException * e) {
 		D0([e description]);
@@ -28,7 +28,13 @@
 	NSString * postID_;
 	NSString * reblogKey_;
 	NSString * endpoint_;
-	WebView * webView_;
+	WebView * webView_;	///< WebViewPool から借りたもの
+	BOOL pooled_;
+	BOOL headless_;
+	NSURLConnection * connection_;
+	NSMutableData * responseData_;
+	NSString * textEncodingName_;
+	NSDate * startDate_;
 }
 
 /// URL for endpoint to post
@@ -40,6 +46,9 @@
 /// Reblog key
 @property (nonatomic, retain) NSString * reblogKey;
 
+/// WebView を使わずに HTTP で取得して字句解析する. 初期値は UserSettings の "tumblrExtractWithWebView" が NO なら YES
+@property (nonatomic, assign) BOOL headless;
+
 /**
  * Initialize object
  *	@param[in] delegate TumblrReblogExtractorDelegate object
@@ -54,6 +63,24 @@
  */
 - (void)startWithPostID:(NSString *)postID withReblogKey:(NSString *)reblogKey;
 
+/**
+ * Fetch Reblog form without consulting cache and prefetch
+ *	@param[in] postID	Post ID
+ *	@param[in] reblogKey	Reblog key
+ */
+- (void)fetchWithPostID:(NSString *)postID withReblogKey:(NSString *)reblogKey;
+
+/**
+ * Deliver already extracted contents to the delegate, then release self
+ *	@param[in] contents	extracted contents
+ */
+- (void)deliverContents:(NSDictionary *)contents;
+
+/**
+ * Cancel fetching without calling the delegate, then release self
+ */
+- (void)cancel;
+
 /**
  * URL for endpoint to post
  *	@param[in] postID	Post ID
@@ -7,22 +7,58 @@
 #import "TumblrReblogExtractor.h"
 #import "TumblrfulConstants.h"
 #import "NSString+Tumblrful.h"
+#import "ReblogFormParser.h"
+#import "ReblogFormCache.h"
+#import "ReblogFormPrefetcher.h"
+#import "WebViewPool.h"
+#import "UserSettings.h"
 #import "DebugLog.h"
+#import <WebKit/WebKit.h>
+
+/// フィールドの値の取り出し方
+typedef enum {
+	ReblogFieldSkip,		///< 使わない
+	ReblogFieldValue,		///< value 属性
+	ReblogFieldInnerHTML,	///< 中身の文字参照を展開したもの
+} ReblogFieldRule;
+
+/// フィールドの位置
+enum {
+	ReblogSlotOne,
+	ReblogSlotTwo,
+	ReblogSlotThree,
+	ReblogSlotFormKey,
+	ReblogSlotImage,
+	ReblogSlotCount
+};
 
-static const NSRange EmptyRange = {NSNotFound, 0};
+/**
+ * post type ごとの post[one], post[two], post[three] の取り出し方
+ *	form_key はすべての type で value を使う. img-src は photo だけ.
+ */
+static const struct {
+	NSString * type;
+	ReblogFieldRule rules[3];
+	BOOL imageSource;
+} REBLOG_FIELD_MAP[] = {
+	{ @"link",			{ ReblogFieldValue,		ReblogFieldValue,		ReblogFieldInnerHTML },	NO },
+	{ @"photo",			{ ReblogFieldSkip,		ReblogFieldInnerHTML,	ReblogFieldValue },		YES },
+	{ @"quote",			{ ReblogFieldInnerHTML,	ReblogFieldInnerHTML,	ReblogFieldSkip },		NO },
+	{ @"regular",		{ ReblogFieldValue,		ReblogFieldInnerHTML,	ReblogFieldSkip },		NO },
+	{ @"conversation",	{ ReblogFieldValue,		ReblogFieldInnerHTML,	ReblogFieldSkip },		NO },
+	{ @"video",			{ ReblogFieldInnerHTML,	ReblogFieldInnerHTML,	ReblogFieldSkip },		NO },
+	{ @"audio",			{ ReblogFieldInnerHTML,	ReblogFieldInnerHTML,	ReblogFieldSkip },		NO },
+};
+
+/// post[one], post[two], post[three] のフォーム上の名前
+static NSString * REBLOG_SLOT_NAMES[] = { @"post[one]", @"post[two]", @"post[three]" };
 
 @interface TumblrReblogExtractor ()
-- (NSString *)postTypeWithElements:(NSArray *)elements;
 - (NSArray *)inputElementsWithDocument:(DOMHTMLDocument *)document;
 - (NSDictionary *)contentsWithElements:(NSArray *)elements;
-- (NSMutableDictionary *)fieldsForLink:(NSArray *)elements;
-- (NSMutableDictionary *)fieldsForPhoto:(NSArray *)elements;
-- (NSMutableDictionary *)fieldsForQuote:(NSArray *)elements;
-- (NSMutableDictionary *)fieldsForRegular:(NSArray *)elements;
-- (NSMutableDictionary *)fieldsForConversation:(NSArray *)elements;
-- (NSMutableDictionary *)fieldsForVideo:(NSArray *)elements;
-- (NSMutableDictionary *)fieldsForAudio:(NSArray *)elements;
-- (void)setFormKeyFieldIfExist:(DOMHTMLElement *)element fields:(NSMutableDictionary *)fields;
+- (void)finishWithElements:(NSArray *)elements;
+- (void)failWithError:(NSError *)error;
+- (void)logElapse;
 @end
 
 @implementation TumblrReblogExtractor
@@ -30,6 +66,7 @@ static const NSRange EmptyRange = {NSNotFound, 0};
 @synthesize endpoint = endpoint_;
 @synthesize postID = postID_;
 @synthesize reblogKey = reblogKey_;
+@synthesize headless = headless_;
 
 #pragma mark -
 #pragma mark Custom Methods
@@ -46,16 +83,62 @@ static const NSRange EmptyRange = {NSNotFound, 0};
 	self.reblogKey = reblogKey;
 	self.endpoint = [TumblrReblogExtractor endpointWithPostID:self.postID withReblogKey:self.reblogKey];
 
+	// 抽出済みならそれを使う. デリゲートの呼び出しは従来どおり start から戻った後にする
+	NSDictionary * fields = [[ReblogFormCache sharedInstance] fieldsForPostID:postID reblogKey:reblogKey];
+	if (fields != nil) {
+		D(@"cache hit: %@", postID);
+		[self performSelector:@selector(deliverContents:) withObject:fields afterDelay:0];
+		return;
+	}
+
+	// 先読み中なら、その結果を待つ
+	if ([[ReblogFormPrefetcher sharedInstance] addWaiter:self]) return;
+
+	[self fetchWithPostID:postID withReblogKey:reblogKey];
+}
+
+- (void)fetchWithPostID:(NSString *)postID withReblogKey:(NSString *)reblogKey
+{
+	self.postID = postID;
+	self.reblogKey = reblogKey;
+	self.endpoint = [TumblrReblogExtractor endpointWithPostID:self.postID withReblogKey:self.reblogKey];
+
 	NSURLRequest * request = [NSURLRequest requestWithURL:[NSURL URLWithString:self.endpoint]];
+	[startDate_ release];
+	startDate_ = [[NSDate alloc] init];
+
+	if (headless_) {
+		// ページを HTTP で取得するだけ. Cookie は共有の NSHTTPCookieStorage のものが使われる
+		[responseData_ release];
+		responseData_ = [[NSMutableData alloc] init];
+		connection_ = [[NSURLConnection alloc] initWithRequest:request delegate:self];
+		if (connection_ == nil) {
+			[self failWithError:[NSError errorWithDomain:TUMBLRFUL_ERROR_DOMAIN code:-1 userInfo:nil]];
+		}
+		return;
+	}
 
-	webView_ = [[WebView alloc] initWithFrame:NSZeroRect frameName:nil groupName:nil];
-	[webView_ setHidden:YES];
-	[webView_ setDrawsBackground:NO];
-	[webView_ setShouldUpdateWhileOffscreen:NO];
+	// フォームの DOM が組み上がれば十分なので JavaScript は要らない
+	webView_ = [[[WebViewPool sharedPool] checkoutWebViewWithJavaScriptEnabled:NO reused:&pooled_] retain];
 	[webView_ setFrameLoadDelegate:self];
 	[[webView_ mainFrame] loadRequest:request];
 }
 
+- (void)deliverContents:(NSDictionary *)contents
+{
+	[self delegateDidFinishExtractMethod:contents];
+	[self autorelease];
+}
+
+- (void)cancel
+{
+	D(@"cancel: %@", postID_);
+	[connection_ cancel];
+	[webView_ setFrameLoadDelegate:nil];
+	[webView_ stopLoading:nil];
+	[self autorelease];
+}
+
 + (NSString *)endpointWithPostID:(NSString *)postID withReblogKey:(NSString *)reblogKey
 {
 	return [NSString stringWithFormat:@"%@/reblog/%@/%@", TUMBLRFUL_TUMBLR_URL, postID, reblogKey];
@@ -65,6 +148,7 @@ static const NSRange EmptyRange = {NSNotFound, 0};
 {
 	if ((self = [super init]) != nil) {
 		delegate_ = [delegate retain];
+		headless_ = ![[UserSettings sharedInstance] boolForKey:@"tumblrExtractWithWebView"];
 	}
 	return self;
 }
@@ -74,7 +158,12 @@ static const NSRange EmptyRange = {NSNotFound, 0};
 
 - (void)dealloc
 {
+	[[WebViewPool sharedPool] checkinWebView:webView_];
 	[webView_ release], webView_ = nil;
+	[connection_ release], connection_ = nil;
+	[responseData_ release], responseData_ = nil;
+	[textEncodingName_ release], textEncodingName_ = nil;
+	[startDate_ release], startDate_ = nil;
 	[postID_ release], postID_ = nil;
 	[reblogKey_ release], reblogKey_ = nil;
 	[endpoint_ release], endpoint_ = nil;
@@ -110,16 +199,12 @@ static const NSRange EmptyRange = {NSNotFound, 0};
 	if (![htmlDoc isKindOfClass:[DOMHTMLDocument class]]) return;
 
 	@try {
-		NSDictionary * contents = [self contentsWithElements:[self inputElementsWithDocument:htmlDoc]];
-		D0([contents description]);
-
-		// デリゲートメソッドをメインスレッド上で呼び出す
-		[self performSelectorOnMainThread:@selector(delegateDidFinishExtractMethod:) withObject:contents waitUntilDone:YES];
+		[self finishWithElements:[self inputElementsWithDocument:htmlDoc]];
 	}
 	@catch (NSException * e) {
 		[self performSelectorOnMainThread:@selector(delegateDidFailExtractMethodWithException:) withObject:e waitUntilDone:YES];
+		[self autorelease];
 	}
-	[self autorelease];
 }
 
 - (void)webView:(WebView *)sender didFailLoadWithError:(NSError *)error forFrame:(WebFrame *)frame
@@ -132,6 +217,59 @@ static const NSRange EmptyRange = {NSNotFound, 0};
 	[self autorelease];
 }
 
+#pragma mark -
+#pragma mark NSURLConnection Delegate Methods
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+	NSInteger const status = [response isKindOfClass:[NSHTTPURLResponse class]] ? [(NSHTTPURLResponse *)response statusCode] : 200;
+	if (status != 200) {
+		// エラーページやログインページを Reblog フォームとして読まないように、ここで失敗にする
+		D(@"statusCode:%d", status);
+		[connection cancel];
+		NSString * message = [NSString stringWithFormat:@"Could not get Reblog form. HTTP status %d", status];
+		[self failWithError:[NSError errorWithDomain:TUMBLRFUL_ERROR_DOMAIN code:status userInfo:[NSDictionary dictionaryWithObject:message forKey:NSLocalizedDescriptionKey]]];
+		return;
+	}
+
+	[textEncodingName_ release];
+	textEncodingName_ = [[response textEncodingName] retain];
+	[responseData_ setLength:0];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+#pragma unused (connection)
+	[responseData_ appendData:data];
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection
+{
+#pragma unused (connection)
+	NSStringEncoding encoding = NSUTF8StringEncoding;
+	if (textEncodingName_ != nil) {
+		CFStringEncoding const cfEncoding = CFStringConvertIANACharSetNameToEncoding((CFStringRef)textEncodingName_);
+		if (cfEncoding != kCFStringEncodingInvalidId) encoding = CFStringConvertEncodingToNSStringEncoding(cfEncoding);
+	}
+	NSString * html = [[[NSString alloc] initWithData:responseData_ encoding:encoding] autorelease];
+	if (html == nil) html = [[[NSString alloc] initWithData:responseData_ encoding:NSISOLatin1StringEncoding] autorelease];
+
+	@try {
+		[self finishWithElements:[ReblogFormParser elementsWithHTML:html]];
+	}
+	@catch (NSException * e) {
+		[self performSelectorOnMainThread:@selector(delegateDidFailExtractMethodWithException:) withObject:e waitUntilDone:YES];
+		[self autorelease];
+	}
+}
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+#pragma unused (connection)
+	D0([error description]);
+	[self failWithError:error];
+}
+
 - (void)delegateDidFinishExtractMethod:(NSDictionary *)fields
 {
 	[delegate_ extractor:self didFinishExtract:fields];
@@ -149,6 +287,37 @@ static const NSRange EmptyRange = {NSNotFound, 0};
 
 #pragma mark -
 #pragma mark Private Methods
+
+/// 抽出した要素からフィールドを作ってデリゲートに渡す. WebView でも HTTP でも同じ
+- (void)finishWithElements:(NSArray *)elements
+{
+	NSDictionary * contents = [self contentsWithElements:elements];
+	D0([contents description]);
+	[self logElapse];
+
+	// 編集シートや再試行で同じフォームを取り直さないように覚えておく. TumblrPost がポストに使えると判断するものだけ
+	if (contents != nil && [contents count] >= 2) {
+		[[ReblogFormCache sharedInstance] setFields:contents forPostID:postID_ reblogKey:reblogKey_];
+	}
+
+	// デリゲートメソッドをメインスレッド上で呼び出す
+	[self performSelectorOnMainThread:@selector(delegateDidFinishExtractMethod:) withObject:contents waitUntilDone:YES];
+	[self autorelease];
+}
+
+- (void)failWithError:(NSError *)error
+{
+	[self logElapse];
+	[self performSelectorOnMainThread:@selector(delegateDidFailExtractMethod:) withObject:error waitUntilDone:YES];
+	[self autorelease];
+}
+
+/// WebView と HTTP, 使い回した WebView と新しい WebView の比較用に、取得開始からの時間を残す
+- (void)logElapse
+{
+	Log(@"reblog form extracted: %@ %.3f sec (%@)", postID_, -[startDate_ timeIntervalSinceNow], headless_ ? @"HTTP" : (pooled_ ? @"WebView pooled" : @"WebView new"));
+}
+
 /**
  * Reblog formからinput要素を得る.
  *	@param[in] document を含む DOMDocument
@@ -176,264 +345,72 @@ static const NSRange EmptyRange = {NSNotFound, 0};
 
 - (NSDictionary *)contentsWithElements:(NSArray *)elements
 {
-	NSMutableDictionary * contents = nil;
-	NSString * type = [self postTypeWithElements:elements];
-	//D(@"type=%@ elements=%@", type, [elements description]);
-
-	if ([type isEqualToString:@"link"])					contents = [self fieldsForLink:elements];
-	else if ([type isEqualToString:@"photo"])			contents = [self fieldsForPhoto:elements];
-	else if ([type isEqualToString:@"quote"])			contents = [self fieldsForQuote:elements];
-	else if ([type isEqualToString:@"regular"])			contents = [self fieldsForRegular:elements];
-	else if ([type isEqualToString:@"conversation"])	contents = [self fieldsForConversation:elements];
-	else if ([type isEqualToString:@"video"])			contents = [self fieldsForVideo:elements];
-	else if ([type isEqualToString:@"audio"])			contents = [self fieldsForAudio:elements];
-
-	NSString * message = nil;
-	if (contents == nil) {
-		message = [NSString stringWithFormat:@"Unrecognized Reblog form. type:%@", SafetyDescription(type)];
-		D0(message);
-		// nilもデリゲートに渡す
-	}
-	else if ([contents count] < 2) { // type[post] + 1このフィールドは絶対あるはず
-		message = [NSString stringWithFormat:@"Unrecognized Reblog form. too few contents. type:%@", SafetyDescription(type)];
-		D0(message);
-	}
-	else {
-		[contents setObject:type forKey:@"type"];
-	}
-	return contents;
-}
-
-/// DOMHTMLElementの配列から post[type] の value を得る
-- (NSString *)postTypeWithElements:(NSArray *)elements
-{
-	NSEnumerator * enumerator = [elements objectEnumerator];
-	DOMHTMLElement * element;
-	while ((element = [enumerator nextObject]) != nil) {
-		NSString * name = [element getAttribute:@"name"];
-		if (name == nil) continue;
-		if (!NSEqualRanges([name rangeOfString:@"post[type]"], EmptyRange)) {
-			return [element getAttribute:@"value"];
-		}
-	}
-	return @"not-found";
-}
-
-/// "Link" post type の時の input fields の抽出
-- (NSMutableDictionary *)fieldsForLink:(NSArray*)elements
-{
-	NSMutableDictionary * fields = [NSMutableDictionary dictionaryWithObjectsAndKeys:@"link", @"post[type]", nil];
-
-	NSString * name;
-	NSEnumerator * enumerator = [elements objectEnumerator];
-	DOMHTMLElement * element;
-	while ((element = [enumerator nextObject]) != nil) {
-
-		name = [element getAttribute:@"name"];
-		if (name == nil) continue;
-
-		if (!NSEqualRanges([name rangeOfString:@"post[one]"], EmptyRange)) {
-			[fields setObject:[element getAttribute:@"value"] forKey:@"post[one]"];
-		}
-		else if (!NSEqualRanges([name rangeOfString:@"post[two]"], EmptyRange)) {
-			[fields setObject:[element getAttribute:@"value"] forKey:@"post[two]"];
-		}
-		else if (!NSEqualRanges([name rangeOfString:@"post[three]"], EmptyRange)) {
-			[fields setObject:[[element innerHTML] stringByUnescapingFromHTML] forKey:@"post[three]"];
-		}
-		else {
-			[self setFormKeyFieldIfExist:element fields:fields];
-		}
-	}
-
-	return fields;
-}
-
-/// "Photo" post type の時の input fields の抽出
-- (NSMutableDictionary *)fieldsForPhoto:(NSArray *)elements
-{
-	NSMutableDictionary * fields = [NSMutableDictionary dictionaryWithObjectsAndKeys:@"photo", @"post[type]", nil];
-
-	NSString * name;
+	// 1回の走査で post[type] と各フィールドの要素を集める. 同じ名前が複数あれば最後のものを使う
+	NSString * type = nil;
+	DOMHTMLElement * slots[ReblogSlotCount] = { nil, nil, nil, nil, nil };
 	for (DOMHTMLElement * element in elements) {
 		if ([element.tagName isCaseInsensitiveEqualToString:@"img"]) {
-			NSString * source = [element getAttribute:@"src"];
-			[fields setObject:source forKey:@"img-src"];
+			slots[ReblogSlotImage] = element;
 			continue;
 		}
 
-		name = [element getAttribute:@"name"];
-		if (name != nil) {
-			if (!NSEqualRanges([name rangeOfString:@"post[one]"], EmptyRange)) {
-				// one は出現しない
-				D0(@"post[one] is not implemented in Reblog(Photo).");
-				continue;
-			}
-			else if (!NSEqualRanges([name rangeOfString:@"post[two]"], EmptyRange)) {
-				[fields setObject:[[element innerHTML] stringByUnescapingFromHTML] forKey:@"post[two]"];
-				continue;
-			}
-			else if (!NSEqualRanges([name rangeOfString:@"post[three]"], EmptyRange)) {
-				[fields setObject:[element getAttribute:@"value"] forKey:@"post[three]"];
-				continue;
-			}
-			[self setFormKeyFieldIfExist:element fields:fields];
-		}
-	}
-
-	return fields;
-}
-
-/// "Quote" post type の時の input fields の抽出
-- (NSMutableDictionary *)fieldsForQuote:(NSArray*)elements
-{
-	NSMutableDictionary * fields = [NSMutableDictionary dictionaryWithObjectsAndKeys:@"quote", @"post[type]", nil];
-
-	NSString * name;
-	NSEnumerator * enumerator = [elements objectEnumerator];
-	DOMHTMLElement * element;
-	while ((element = [enumerator nextObject]) != nil) {
-
-		name = [element getAttribute:@"name"];
-		if (name == nil) continue;
-
-		if (!NSEqualRanges([name rangeOfString:@"post[one]"], EmptyRange)) {
-			[fields setObject:[[element innerHTML] stringByUnescapingFromHTML] forKey:@"post[one]"];
-		}
-		else if (!NSEqualRanges([name rangeOfString:@"post[two]"], EmptyRange)) {
-			[fields setObject:[[element innerHTML] stringByUnescapingFromHTML] forKey:@"post[two]"];
-		}
-		else {
-			[self setFormKeyFieldIfExist:element fields:fields];
-		}
-	}
-
-	return fields;
-}
-
-/// "Regular" post type の時の input fields の抽出
-- (NSMutableDictionary *)fieldsForRegular:(NSArray*)elements
-{
-	NSMutableDictionary * fields = [NSMutableDictionary dictionaryWithObjectsAndKeys:@"regular", @"post[type]", nil];
-
-	NSString * name;
-	NSEnumerator * enumerator = [elements objectEnumerator];
-	DOMHTMLElement * element;
-	while ((element = [enumerator nextObject]) != nil) {
-
-		name = [element getAttribute:@"name"];
+		NSString * name = [element getAttribute:@"name"];
 		if (name == nil) continue;
 
-		if (!NSEqualRanges([name rangeOfString:@"post[one]"], EmptyRange)) {
-			[fields setObject:[element getAttribute:@"value"] forKey:@"post[one]"];
-		}
-		else if (!NSEqualRanges([name rangeOfString:@"post[two]"], EmptyRange)) {
-			[fields setObject:[[element innerHTML] stringByUnescapingFromHTML] forKey:@"post[two]"];
-		}
-		else if (!NSEqualRanges([name rangeOfString:@"post[three]"], EmptyRange)) {
-			/* three は出現しない？ */
-			D0(@"post[three] is not implemented in Reblog(Quote).");
-		}
-		else {
-			[self setFormKeyFieldIfExist:element fields:fields];
+		if ([name isEqualToString:@"post[type]"]) {
+			if (type == nil) type = [element getAttribute:@"value"];
 		}
+		else if ([name isEqualToString:@"post[one]"])		slots[ReblogSlotOne] = element;
+		else if ([name isEqualToString:@"post[two]"])		slots[ReblogSlotTwo] = element;
+		else if ([name isEqualToString:@"post[three]"])		slots[ReblogSlotThree] = element;
+		else if ([name isEqualToString:@"form_key"])		slots[ReblogSlotFormKey] = element;
 	}
+	if (type == nil) type = @"not-found";
+	//D(@"type=%@ elements=%@", type, [elements description]);
 
-	return fields;
-}
-
-/// "Conversation" post type の時の input fields の抽出
-- (NSMutableDictionary *)fieldsForConversation:(NSArray*)elements
-{
-	NSMutableDictionary * fields = [NSMutableDictionary dictionaryWithObjectsAndKeys:@"conversation", @"post[type]", nil];
-
-	NSString * name;
-	NSEnumerator* enumerator = [elements objectEnumerator];
-	DOMHTMLElement* element;
-	while ((element = [enumerator nextObject]) != nil) {
-
-		name = [element getAttribute:@"name"];
-		if (name == nil) continue;
-
-		if (!NSEqualRanges([name rangeOfString:@"post[one]"], EmptyRange)) {
-			[fields setObject:[element getAttribute:@"value"] forKey:@"post[one]"];
-		}
-		else if (!NSEqualRanges([name rangeOfString:@"post[two]"], EmptyRange)) {
-			[fields setObject:[[element innerHTML] stringByUnescapingFromHTML] forKey:@"post[two]"];
+	NSMutableDictionary * contents = nil;
+	for (NSUInteger i = 0; i < sizeof(REBLOG_FIELD_MAP) / sizeof(REBLOG_FIELD_MAP[0]); ++i) {
+		if (![type isEqualToString:REBLOG_FIELD_MAP[i].type]) continue;
+
+		contents = [NSMutableDictionary dictionaryWithObjectsAndKeys:REBLOG_FIELD_MAP[i].type, @"post[type]", nil];
+		for (NSUInteger slot = ReblogSlotOne; slot <= ReblogSlotThree; ++slot) {
+			DOMHTMLElement * element = slots[slot];
+			if (element == nil) continue;
+
+			switch (REBLOG_FIELD_MAP[i].rules[slot]) {
+			case ReblogFieldValue:
+				[contents setObject:[element getAttribute:@"value"] forKey:REBLOG_SLOT_NAMES[slot]];
+				break;
+			case ReblogFieldInnerHTML:
+				[contents setObject:[[element innerHTML] stringByUnescapingFromHTML] forKey:REBLOG_SLOT_NAMES[slot]];
+				break;
+			case ReblogFieldSkip:
+				D(@"%@ is not implemented in Reblog(%@).", REBLOG_SLOT_NAMES[slot], type);
+				break;
+			}
 		}
-		else if (!NSEqualRanges([name rangeOfString:@"post[three]"], EmptyRange)) {
-			/* three は出現しない？ */
-			D0(@"post[three] is not implemented in Reblog(Conversation).");
+		if (slots[ReblogSlotFormKey] != nil) {
+			[contents setObject:[slots[ReblogSlotFormKey] getAttribute:@"value"] forKey:@"form_key"];
 		}
-		else {
-			[self setFormKeyFieldIfExist:element fields:fields];
+		if (REBLOG_FIELD_MAP[i].imageSource && slots[ReblogSlotImage] != nil) {
+			[contents setObject:[slots[ReblogSlotImage] getAttribute:@"src"] forKey:@"img-src"];
 		}
+		break;
 	}
 
-	return fields;
-}
-
-/// "Video" post type の時の input fields の抽出
-- (NSMutableDictionary *)fieldsForVideo:(NSArray *)elements
-{
-	NSMutableDictionary * fields = [NSMutableDictionary dictionaryWithObjectsAndKeys:@"video", @"post[type]", nil];
-
-	NSString * name;
-	NSEnumerator * enumerator = [elements objectEnumerator];
-	DOMHTMLElement * element;
-	while ((element = [enumerator nextObject]) != nil) {
-
-		name = [element getAttribute:@"name"];
-		if (name == nil) continue;
-
-		if (!NSEqualRanges([name rangeOfString:@"post[one]"], EmptyRange)) {
-			[fields setObject:[[element innerHTML] stringByUnescapingFromHTML] forKey:@"post[one]"];
-		}
-		else if (!NSEqualRanges([name rangeOfString:@"post[two]"], EmptyRange)) {
-			[fields setObject:[[element innerHTML] stringByUnescapingFromHTML] forKey:@"post[two]"];
-		}
-		else {
-			[self setFormKeyFieldIfExist:element fields:fields];
-		}
+	NSString * message = nil;
+	if (contents == nil) {
+		message = [NSString stringWithFormat:@"Unrecognized Reblog form. type:%@", SafetyDescription(type)];
+		D0(message);
+		// nilもデリゲートに渡す
 	}
-
-	return fields;
-}
-
-/// "Audio" post type の時の input fields の抽出
-- (NSMutableDictionary *)fieldsForAudio:(NSArray*)elements
-{
-	NSMutableDictionary * fields = [NSMutableDictionary dictionaryWithObjectsAndKeys:@"audio", @"post[type]", nil];
-
-	NSString * name;
-	NSEnumerator * enumerator = [elements objectEnumerator];
-	DOMHTMLElement * element;
-	while ((element = [enumerator nextObject]) != nil) {
-
-		name = [element getAttribute:@"name"];
-		if (name == nil) continue;
-
-		if (!NSEqualRanges([name rangeOfString:@"post[one]"], EmptyRange)) {
-			[fields setObject:[[element innerHTML] stringByUnescapingFromHTML] forKey:@"post[one]"];
-		}
-		else if (!NSEqualRanges([name rangeOfString:@"post[two]"], EmptyRange)) {
-			[fields setObject:[[element innerHTML] stringByUnescapingFromHTML] forKey:@"post[two]"];
-		}
-		else {
-			[self setFormKeyFieldIfExist:element fields:fields];
-		}
+	else if ([contents count] < 2) { // type[post] + 1このフィールドは絶対あるはず
+		message = [NSString stringWithFormat:@"Unrecognized Reblog form. too few contents. type:%@", SafetyDescription(type)];
+		D0(message);
 	}
-
-	return fields;
-}
-
-/// elementの要素名がformKeyであれば fields に追加する.
-- (void)setFormKeyFieldIfExist:(DOMHTMLElement *)element fields:(NSMutableDictionary *)fields
-{
-	NSString * name = [element getAttribute:@"name"];
-
-	if (!NSEqualRanges([name rangeOfString:@"form_key"], EmptyRange)) {
-		[fields setObject:[element getAttribute:@"value"] forKey:@"form_key"];
+	else {
+		[contents setObject:type forKey:@"type"];
 	}
+	return contents;
 }
 @end
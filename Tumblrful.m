@@ -9,6 +9,8 @@
 #import "SafariSingleWindow.h"
 #import "GrowlSupport.h"
 #import "UserSettings.h"
+#import "WebViewPool.h"
+#import "PostQueue.h"
 #import "TumblrfulConstants.h"
 #import "DebugLog.h"
 #import <objc/objc-runtime.h>
@@ -123,6 +125,15 @@ static BOOL jr_swizzleClassMethod(Class klass, SEL orgSel, SEL altSel)
 			, @selector(sharedPreferences_SwizzledByTumblrful)
 			);
 	if (!swizzled) D0(@"failed swizzle sharedPreferences");
+
+	// 前回送りきれなかったポストを読み戻して送信を再開する
+	[PostQueue sharedQueue];
+
+	// WebView を使う経路が有効なら、最初の操作で WebKit の初期化を待たないよう起動後に用意しておく
+	UserSettings * settings = [UserSettings sharedInstance];
+	if ([settings boolForKey:@"tumblrExtractWithWebView"] || [settings boolForKey:@"yammerEnabled"]) {
+		[[WebViewPool sharedPool] performSelector:@selector(prewarm) withObject:nil afterDelay:5.0];
+	}
 }
 
 /**
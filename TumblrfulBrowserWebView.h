@@ -6,6 +6,8 @@
  */
 #import <WebKit/WebKit.h> // need before Safari header
 
+@class DelivererIndex;
+
 @interface WebView (TumblrfulBrowserWebView)
 /**
  * @method webView:contextMenuItemsForElement:defaultMenuItems:
@@ -23,6 +25,12 @@
  */
 - (NSArray *)sharedDelivererClasses;
 
+/**
+ * Deliverer の class をホスト名と要素の種類で引く singleton な索引
+ *	@return DelivererIndex object.
+ */
+- (DelivererIndex *)sharedDelivererIndex;
+
 /**
  * コンテキストメニューに独自の要素を追加する。
  *	@param[in] menu オリジナルの NSMenuItem の配列
@@ -11,6 +11,7 @@
 #import "TwitterQuoteDeliverer.h"
 #import "LinkDeliverer.h"
 #import "ReblogDeliverer.h"
+#import "BulkReblogDeliverer.h"
 #import "LDRReblogDeliverer.h"
 #import "GoogleReaderReblogDeliverer.h"
 #import "PhotoDeliverer.h"
@@ -19,7 +20,10 @@
 #import "VimeoVideoDeliverer.h"
 #import "SlideShareVideoDeliverer.h"
 #import "CaptureDeliverer.h"
+#import "DelivererIndex.h"
 #import "TumblrPost.h"
+#import "ReblogFormPrefetcher.h"
+#import "ReblogKeyResolver.h"
 #import "GrowlSupport.h"
 #import "PostAdaptorCollection.h"
 #import "TumblrPostAdaptor.h"
@@ -29,6 +33,7 @@
 #import "GoogleReaderDelivererContext.h"
 #import "LDRDelivererContext.h"
 #import "DelivererRules.h"
+#import "UserSettings.h"
 #import "NSObject+Supersequent.h"
 #import "TumblrfulWebHTMLView.h"
 #import "DebugLog.h"
@@ -102,9 +107,19 @@ static const NSUInteger POST_MASK_ALL = 0x3;
 
 - (NSArray *)sharedDelivererClasses
 {
-	static NSMutableArray* classes = nil;
+	static NSArray * classes = nil;
 
 	if (classes == nil) {
+		classes = [[[self sharedDelivererIndex] allClasses] retain]; // must
+	}
+	return classes;
+}
+
+- (DelivererIndex *)sharedDelivererIndex
+{
+	static DelivererIndex * index = nil;
+
+	if (index == nil) {
 		// setup PostAdaptorCollection
 		[PostAdaptorCollection add:[TumblrPostAdaptor class]];
 		//[PostAdaptorCollection add:[UmesuePostAdaptor class]];
@@ -112,23 +127,24 @@ static const NSUInteger POST_MASK_ALL = 0x3;
 		[PostAdaptorCollection add:[InstapaperPostAdaptor class]];
 		[PostAdaptorCollection add:[YammerPostAdaptor class]];
 
-		classes = [NSMutableArray arrayWithObjects:
-			  [GoogleReaderReblogDeliverer class]
-			, [LDRReblogDeliverer class]
-			, [ReblogDeliverer class]
-			, [FlickrPhotoDeliverer class]
-			, [PhotoDeliverer class]
-			, [QuoteDeliverer class]
-			, [TwitterQuoteDeliverer class]
-			, [VimeoVideoDeliverer class]
-			, [SlideShareVideoDeliverer class]
-			, [VideoDeliverer class]
-			, [LinkDeliverer class]
-			, [CaptureDeliverer class]
-			, nil];
-		[classes retain]; // must
+		// 登録順がメニューの並び順. ホスト名と要素の種類は各クラスの +create:element: が見ているものと合わせる
+		index = [[DelivererIndex alloc] init];
+		[index addClass:[GoogleReaderReblogDeliverer class] hostSuffixes:[NSArray arrayWithObject:@"www.google.com"] kinds:DelivererElementAny];
+		[index addClass:[LDRReblogDeliverer class] hostSuffixes:[NSArray arrayWithObjects:@"reader.livedoor.com", @"fastladder.com", nil] kinds:DelivererElementAny];
+		[index addClass:[ReblogDeliverer class] hostSuffixes:nil kinds:DelivererElementAny];
+		[index addClass:[FlickrPhotoDeliverer class] hostSuffixes:[NSArray arrayWithObject:@"flickr.com"] kinds:DelivererElementImage];
+		[index addClass:[PhotoDeliverer class] hostSuffixes:nil kinds:DelivererElementImage];
+		[index addClass:[QuoteDeliverer class] hostSuffixes:nil kinds:DelivererElementSelection];
+		[index addClass:[TwitterQuoteDeliverer class] hostSuffixes:[NSArray arrayWithObject:@"twitter.com"] kinds:(DelivererElementNode | DelivererElementNoSelection)];
+		[index addClass:[VimeoVideoDeliverer class] hostSuffixes:[NSArray arrayWithObject:@"vimeo.com"] kinds:DelivererElementNode];
+		[index addClass:[SlideShareVideoDeliverer class] hostSuffixes:[NSArray arrayWithObject:@"slideshare.net"] kinds:DelivererElementNode];
+		[index addClass:[VideoDeliverer class] hostSuffixes:[NSArray arrayWithObject:@"youtube.com"] kinds:DelivererElementNode];
+		[index addClass:[LinkDeliverer class] hostSuffixes:nil kinds:DelivererElementAny];
+		[index addClass:[CaptureDeliverer class] hostSuffixes:nil kinds:DelivererElementAny];
+		// ページ全体を対象にするもの. 通常の項目の後に別扱いで作る. Tumblr のページかどうかは +create:element: が見る
+		[index addClass:[BulkReblogDeliverer class] hostSuffixes:nil kinds:DelivererElementAny];
 	}
-	return classes;
+	return index;
 }
 
 - (BOOL)validateAccount
@@ -147,15 +163,42 @@ static const NSUInteger POST_MASK_ALL = 0x3;
 		return menus;
 	}
 
+	D_ELAPSE_BEGIN(buildMenu);
+
+	DOMHTMLDocument * document = (DOMHTMLDocument *)[self mainFrameDocument];
+
+	// ホスト名と要素の種類で候補を絞る. 設定で切れば従来どおり全クラスを試す(索引の有無で時間を比べるため)
+	NSArray * delivererClasses;
+	if ([[UserSettings sharedInstance] boolForKey:@"delivererIndexDisabled"]) {
+		delivererClasses = [self sharedDelivererClasses];
+	}
+	else {
+		delivererClasses = [[self sharedDelivererIndex] candidatesForDocument:document element:clickedElement];
+	}
+
 	NSMutableArray * additionalMenus = [NSMutableArray array];
 	NSMenu * subMenu = [[[NSMenu alloc] initWithTitle:@"Editting Post"] autorelease];
 	BOOL preferredExist = NO;
+	BOOL bulkCandidate = NO;
 	Class delivererClass;
-	NSEnumerator * classEnumerator = [[self sharedDelivererClasses] objectEnumerator];
+	NSEnumerator * classEnumerator = [delivererClasses objectEnumerator];
 	while ((delivererClass = [classEnumerator nextObject]) != nil) {
-		DelivererBase * deliverer = (DelivererBase *)[delivererClass create:(DOMHTMLDocument *)[self mainFrameDocument] element:clickedElement];
+		if (delivererClass == [BulkReblogDeliverer class]) {
+			bulkCandidate = YES;
+			continue;
+		}
+		DelivererBase * deliverer = (DelivererBase *)[delivererClass create:document element:clickedElement];
 		if (deliverer != nil) {
 			deliverer.webView = self;
+			if ([deliverer isKindOfClass:[ReblogDeliverer class]]) {
+				// メニューが出ている間に Reblog フォームを取得しておく(設定で有効なときだけ)
+				ReblogDeliverer * reblog = (ReblogDeliverer *)deliverer;
+				[[ReblogFormPrefetcher sharedInstance] prefetchWithPostID:reblog.postID reblogKey:reblog.reblogKey];
+			}
+			if ([deliverer isKindOfClass:[AggregatorReblogDeliverer class]]) {
+				// フィードリーダーに見えている他の Tumblr ポストの reblog-key もまとめて引いておく
+				[[ReblogKeyResolver sharedInstance] resolveDocument:document];
+			}
 			NSMenuItem * menuItem;
 			NSArray * menuItems = [deliverer createMenuItems];	// autoreleased
 			NSEnumerator * menuEnumerator = [menuItems objectEnumerator];
@@ -191,6 +234,13 @@ static const NSUInteger POST_MASK_ALL = 0x3;
 		[menuItem setSubmenu:subMenu];
 		[menus insertObject:menuItem atIndex:i++];
 
+		// Reblog できるポストが複数あるページなら、まとめて Reblog するメニューを作る
+		BulkReblogDeliverer * bulk = bulkCandidate ? (BulkReblogDeliverer *)[BulkReblogDeliverer create:document element:clickedElement] : nil;
+		if (bulk != nil) {
+			bulk.webView = self;
+			[menus insertObject:[bulk createMenuItem] atIndex:i++];
+		}
+
 		// セパレータを追加する
 		[menus insertObject:[NSMenuItem separatorItem] atIndex:i];
 	}
@@ -198,6 +248,7 @@ static const NSUInteger POST_MASK_ALL = 0x3;
 		[GrowlSupport notifyWithTitle:@"Tumblrful" description:@"Error - Could not detect type of post"];
 	}
 
+	D_ELAPSE_END(buildMenu);
 	return menus;
 }
 
@@ -224,7 +275,9 @@ static const NSUInteger POST_MASK_ALL = 0x3;
 			[elements setObject:[(DOMHTMLImageElement *)target src] forKey:WebElementImageURLKey];
 		}
 
-		for (Class delivererClass in [[self sharedDelivererClasses] objectEnumerator]) {
+		for (Class delivererClass in [[self sharedDelivererIndex] candidatesForDocument:document element:elements]) {
+			if (delivererClass == [BulkReblogDeliverer class]) continue;	// キー入力ではページ全体の Reblog はしない
+
 			id<Deliverer> maybeDeliver = [delivererClass create:document element:elements];
 			if (maybeDeliver == nil) {
 				continue;
@@ -236,6 +289,11 @@ static const NSUInteger POST_MASK_ALL = 0x3;
 			if ([deliverer respondsToSelector:sel] && ([deliverer isKindOfClass:photoClass] || [deliverer isKindOfClass:reblogClass])) {
 				NSBeep();
 
+				if ([deliverer isKindOfClass:[AggregatorReblogDeliverer class]]) {
+					// 次のエントリからは read API を待たずに済むように、見えているポストの reblog-key をまとめて引いておく
+					[[ReblogKeyResolver sharedInstance] resolveDocument:document];
+				}
+
 				// セレクタに渡す引数を作成して実行する
 				NSArray * param = [NSArray arrayWithObjects:self, [NSNumber numberWithUnsignedInteger:endpoint], nil];
 				[deliverer performSelectorOnMainThread:sel withObject:param waitUntilDone:YES];
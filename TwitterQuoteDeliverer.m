@@ -23,7 +23,7 @@ static NSString * TWITTER_HOSTNAME = @"twitter.com";
 	D(@"selected:%@", SafetyDescription(selected));
 	if (selected != nil && CFBooleanGetValue((CFBooleanRef)selected)) return nil;
 
-	NSURL * u = [NSURL URLWithString:[[document URL] stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+	NSURL * u = [DelivererBase URLOfDocument:document];
 	if ([[u host] hasSuffix:TWITTER_HOSTNAME] == NO) return nil;
 
 	NSRange range = [[u path] rangeOfString:@"/status"];
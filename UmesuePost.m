@@ -7,6 +7,7 @@
 // /System/Library/Frameworks/Foundation.framework/Headers/NSXMLDocument.h
 // /System/Library/Frameworks/Foundation.framework/Headers/NSXMLNode.h
 #import "UmesuePost.h"
+#import "HTTPSession.h"
 #import "UserSettings.h"
 #import "DebugLog.h"
 #import "NSDataBase64.h"
@@ -130,12 +131,11 @@
 
 	V(@"UmesuePost.post: request: %@", [request description]);
 
-	NSURLConnection* connection =
-		[NSURLConnection connectionWithRequest:request delegate:self];
-	[connection retain];
+	/* 同じホストへの接続を使い回す. 接続は HTTPSession が終わるまで保持する */
+	id task = [[HTTPSession sharedSession] startRequest:request delegate:self];
 
-	V(@"UmesuePost.post connection: %@", SafetyDescription(connection));
-	if (connection == nil) {
+	V(@"UmesuePost.post task: %@", SafetyDescription(task));
+	if (task == nil) {
 		[self callback:@selector(failedWithError:) withObject:nil];
 	}
 }
@@ -199,10 +199,9 @@
  */
 - (void) connectionDidFinishLoading:(NSURLConnection*)connection
 {
+#pragma unused (connection)
 	V(@"UmesuePost.connectionDidFinishLoading: succeeded to load %d bytes", [responseData_ length]);
 
-	[connection release];
-
 	if (callback_ != nil && responseData_ != nil) {
 		NSString* rc = nil;
 		NSXMLNode* node = nil;
@@ -231,10 +230,9 @@
 - (void) connection:(NSURLConnection*)connection
 	 didFailWithError:(NSError*)error
 {
+#pragma unused (connection)
 	V(@"UmesuePost.didFailWithError: in, NSError:%@", [error description]);
 
-	[connection release];
-
 	[self callback:@selector(failedWithError:) withObject:error];
 }
 
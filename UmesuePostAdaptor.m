@@ -6,6 +6,7 @@
  */
 #import "UmesuePostAdaptor.h"
 #import "UmesuePost.h"
+#import "PostQueue.h"
 #import "DebugLog.h"
 
 #pragma mark -
@@ -111,13 +112,11 @@
 - (void)postWithType:(NSString *)type withParams:(NSDictionary *)params
 {
 	@try {
-		UmesuePost * umesue = [[UmesuePost alloc] initWithCallback:callback_];
-
-		NSMutableDictionary * requestParams = [umesue createMinimumRequestParams];
-		[requestParams setObject:type forKey:@"type"];
+		NSMutableDictionary * requestParams = [NSMutableDictionary dictionaryWithObject:type forKey:@"type"];
 		[requestParams addEntriesFromDictionary:params];
 
-		[umesue postWith:requestParams];
+		// 送信待ち行列に入れる. 送信は PostQueue が行う
+		[[PostQueue sharedQueue] enqueuePostClass:[UmesuePost class] params:requestParams options:nil callback:callback_];
 	}
 	@catch (NSException * e) {
 		D0([e description]);
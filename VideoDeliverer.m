@@ -33,7 +33,7 @@ static NSString * TYPE = @"Video";
 	D(@"DOMNode:%@", [node description]);
 
 	// check URL's host
-	NSURL * url = [NSURL URLWithString:[[document URL] stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+	NSURL * url = [DelivererBase URLOfDocument:document];
 	if ([[url host] hasSuffix:@"youtube.com"] == NO) {
 		return nil;
 	}
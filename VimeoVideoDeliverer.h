@@ -6,5 +6,19 @@
  */
 #import "VideoDeliverer.h"
 
+/**
+ * Vimeo の動画を、vimeo.videos.getInfo から作った embed と caption でポストする
+ *	getInfo は非同期に引き、終わったら videoInfoDidFinish: でポストする. main thread は止めない.
+ *	署名付きの getInfo URL は videoID ごとに覚えておき、同じ動画では署名を作り直さない.
+ *	getInfo の応答は MetadataCache に覚えておく.
+ */
 @interface VimeoVideoDeliverer : VideoDeliverer
+{
+	NSString * videoID_;
+	id task_;						///< HTTPSession のタスク
+	NSURLResponse * response_;
+	NSMutableData * responseData_;
+	NSDate * startDate_;
+	BOOL lookingUp_;
+}
 @end
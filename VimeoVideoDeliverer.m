@@ -6,11 +6,15 @@
  */
 #import "VimeoVideoDeliverer.h"
 #import "DelivererRules.h"
+#import "HTTPSession.h"
+#import "MetadataCache.h"
+#import "XMLPathScanner.h"
 #import "DebugLog.h"
 #import <WebKit/DOMHTMLEmbedElement.h>
 #import <CommonCrypto/CommonDigest.h>
 
 #define TIMEOUT	(30)
+#define SIGNED_URL_CACHE_LIMIT	(64)
 
 // for Vimeo API
 #define API_KEY		(@"b83e12234274c5e3c307a83aa84a8176")
@@ -18,12 +22,26 @@
 
 static NSString * VIMEO_HOSTNAME = @"vimeo.com";
 
+/// MetadataCache でのサービス名
+static NSString * CACHE_SERVICE = @"vimeo";
+
+/// getInfo の応答から拾う値
+static NSString * PATH_WIDTH = @"/rsp/video/width";
+static NSString * PATH_HEIGHT = @"/rsp/video/height";
+static NSString * PATH_TITLE = @"/rsp/video/title";
+static NSString * PATH_PROFILE_URL = @"/rsp/video/owner@profileurl";
+static NSString * PATH_REAL_NAME = @"/rsp/video/owner@realname";
+
 @interface VimeoVideoDeliverer ()
 - (NSString *)vimeoVideoIDWithURL:(NSString *)URL;
-- (NSString *)vimeoSignatureWithParams:(NSDictionary *)params;
-- (NSXMLDocument *)getVideoInfoXMLWithVideoID:(NSString *)videoID;
-- (NSString *)captionWithXML:(NSXMLDocument *)document withVideoID:(NSString *)videoID;
-- (NSString *)embedTagWithXML:(NSXMLDocument *)document withVideoID:(NSString *)videoID;
++ (NSString *)vimeoSignatureWithParams:(NSDictionary *)params;
++ (NSURL *)signedInfoURLWithVideoID:(NSString *)videoID;
+- (void)startVideoInfoWithVideoID:(NSString *)videoID;
+- (void)parseInfoData:(NSData *)data;
+- (void)didParseInfoValues:(id)result;
+- (void)videoInfoDidFinish:(NSDictionary *)contents;
+- (NSString *)captionWithValues:(NSDictionary *)values withVideoID:(NSString *)videoID;
+- (NSString *)embedTagWithValues:(NSDictionary *)values withVideoID:(NSString *)videoID;
 - (void)failedWithVideoID:(NSString *)videoID message:(NSString *)message;
 - (void)failedWithVideoID:(NSString *)videoID error:(NSError *)error;
 - (void)failedWithVideoID:(NSString *)videoID exception:(NSException *)exception;
@@ -36,7 +54,7 @@ static NSString * VIMEO_HOSTNAME = @"vimeo.com";
 	VimeoVideoDeliverer * deliverer = nil;
 	if ([clickedElement objectForKey:WebElementDOMNodeKey] != nil) {
 		// check URL's host
-		NSURL* url = [NSURL URLWithString:[[document URL] stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+		NSURL* url = [DelivererBase URLOfDocument:document];
 		if ([[url host] hasSuffix:VIMEO_HOSTNAME]) {
 			NSInteger no = [[[url path] substringFromIndex:1] integerValue];
 			if (no != 0) {
@@ -55,30 +73,45 @@ static NSString * VIMEO_HOSTNAME = @"vimeo.com";
 	return [NSString stringWithFormat:@"%@ - Vimeo", [VimeoVideoDeliverer name]];
 }
 
+- (void)dealloc
+{
+	[videoID_ release], videoID_ = nil;
+	[task_ release], task_ = nil;
+	[response_ release], response_ = nil;
+	[responseData_ release], responseData_ = nil;
+	[startDate_ release], startDate_ = nil;
+
+	[super dealloc];
+}
+
 // 2008-07-06: embed タグを javascript で生成するようになった事により XPath でDOMが引けなくなった。打つ手なし...
-- (NSDictionary *)videoContents
+- (void)action:(id)sender
 {
-	DOMNode* clickedNode = [clickedElement_ objectForKey:WebElementDOMNodeKey];
-	if (clickedNode == nil) {
-		D(@"clickedNode not found: %@", clickedElement_);
-		return nil;
-	}
+#pragma unused (sender)
+	@try {
+		if (lookingUp_) {
+			D(@"already looking up: %@", videoID_);
+			return;
+		}
 
-	NSString * caption = nil;
-	NSString * embed = nil;
+		DOMNode * clickedNode = [clickedElement_ objectForKey:WebElementDOMNodeKey];
+		if (clickedNode == nil) {
+			D(@"clickedNode not found: %@", clickedElement_);
+			[super postVideo:context_.documentURL caption:nil];
+			return;
+		}
 
-	// videoID をURLから得る http://www.vimeo.com/1237052?pg=embed&sec=1237052
-	NSString * videoID = [self vimeoVideoIDWithURL:context_.documentURL];
-	D(@"videoID=%@", videoID);
+		// videoID をURLから得る http://www.vimeo.com/1237052?pg=embed&sec=1237052
+		NSString * videoID = [self vimeoVideoIDWithURL:context_.documentURL];
+		D(@"videoID=%@", videoID);
 
-	// Vimeo API 経由で Video 情報を XML 形式で得る
-	NSXMLDocument * xmlDoc = [self getVideoInfoXMLWithVideoID:videoID];
-	if (xmlDoc != nil) {
-		caption = [self captionWithXML:xmlDoc withVideoID:videoID];
-		embed = [self embedTagWithXML:xmlDoc withVideoID:videoID];
+		// Vimeo API 経由で Video 情報を得る. ポストは videoInfoDidFinish: で行う
+		[self startVideoInfoWithVideoID:videoID];
+	}
+	@catch (NSException * e) {
+		D0([e description]);
+		[self failedWithException:e];
 	}
-
-	return [NSDictionary dictionaryWithObjectsAndKeys:embed, @"source", caption, @"caption", nil];
 }
 
 /**
@@ -105,7 +138,7 @@ static NSString * VIMEO_HOSTNAME = @"vimeo.com";
  *	@param API パラメータの連想配列.
  *	@return signature
  */
-- (NSString *)vimeoSignatureWithParams:(NSDictionary*)params
++ (NSString *)vimeoSignatureWithParams:(NSDictionary*)params
 {
 	NSMutableString * secret = [[[NSMutableString alloc] initWithString:API_SECRET] autorelease];
 
@@ -134,8 +167,25 @@ static NSString * VIMEO_HOSTNAME = @"vimeo.com";
 	return sig;
 }
 
-- (NSXMLDocument *)getVideoInfoXMLWithVideoID:(NSString *)videoID
+/**
+ * getInfo 用の署名付き URL を得る
+ *	署名は videoID だけで決まるので、一度作ったものは使い回す.
+ *	@param[in] videoID	Vimeo の video ID
+ *	@return URL
+ */
++ (NSURL *)signedInfoURLWithVideoID:(NSString *)videoID
 {
+	static NSMutableDictionary * signedURLs = nil;
+	if (signedURLs == nil) {
+		signedURLs = [[NSMutableDictionary alloc] init];
+	}
+
+	NSURL * url = [signedURLs objectForKey:videoID];
+	if (url != nil) {
+		D(@"reuse signed URL: %@", videoID);
+		return url;
+	}
+
 	NSMutableDictionary * params = [NSMutableDictionary dictionaryWithObjectsAndKeys:API_KEY, @"api_key", @"vimeo.videos.getInfo", @"method", videoID, @"video_id", nil];
 	[params setObject:[self vimeoSignatureWithParams:params] forKey:@"api_sig"];
 
@@ -149,51 +199,197 @@ static NSString * VIMEO_HOSTNAME = @"vimeo.com";
 	D(@"Vimeo API URL=%@", urlAsString);
 	// http://www.vimeo.com/api/rest?api_key=b83e12234274c5e3c307a83aa84a8176&method=vimeo.videos.getInfo&video_id=1237052&api_sig=640fd4ebfbbe1891c3c281fc1531bf3f
 
-	NSXMLDocument * xmlDoc = nil;
+	url = [NSURL URLWithString:urlAsString];
+	if (url != nil) {
+		if ([signedURLs count] >= SIGNED_URL_CACHE_LIMIT) {
+			[signedURLs removeAllObjects];
+		}
+		[signedURLs setObject:url forKey:videoID];
+	}
+	return url;
+}
 
-	@try {
-		// GET via HTTP
-		NSURLRequest * request = [NSURLRequest requestWithURL:[NSURL URLWithString:urlAsString] cachePolicy:NSURLRequestUseProtocolCachePolicy timeoutInterval:TIMEOUT];
+/**
+ * getInfo を非同期に引き始める
+ *	@param[in] videoID	Vimeo の video ID
+ */
+- (void)startVideoInfoWithVideoID:(NSString *)videoID
+{
+	[self retain];	// videoInfoDidFinish: まで生かしておく
+	lookingUp_ = YES;
+	[videoID_ release], videoID_ = [videoID retain];
+	[startDate_ release], startDate_ = [[NSDate alloc] init];
+	[responseData_ release], responseData_ = [[NSMutableData alloc] init];
+
+	// 前に引いたものが期限内なら通信しない
+	MetadataCache * cache = [MetadataCache sharedCache];
+	NSData * cached = [cache dataForService:CACHE_SERVICE identifier:videoID];
+	if (cached != nil) {
+		[NSThread detachNewThreadSelector:@selector(parseInfoData:) toTarget:self withObject:cached];
+		return;
+	}
+
+	NSURL * url = (videoID != nil) ? [VimeoVideoDeliverer signedInfoURLWithVideoID:videoID] : nil;
+	if (url != nil) {
+		NSURLRequest * request = [cache requestWithURL:url timeoutInterval:TIMEOUT service:CACHE_SERVICE identifier:videoID];
+		task_ = [[[HTTPSession sharedSession] startRequest:request delegate:self] retain];
+	}
+	if (task_ == nil) {
+		[self failedWithVideoID:videoID message:@"Could not create getInfo request."];
+		[self videoInfoDidFinish:nil];
+	}
+}
+
+#pragma mark -
+#pragma mark NSURLConnection delegate
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+#pragma unused (connection)
+	[response_ release], response_ = [response retain];
+	[responseData_ setLength:0];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+#pragma unused (connection)
+	[responseData_ appendData:data];
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection
+{
+#pragma unused (connection)
+	[task_ release], task_ = nil;
+
+	// 304 ならば覚えていたものが返る
+	NSData * data = [[MetadataCache sharedCache] dataWithResponse:response_ data:responseData_ service:CACHE_SERVICE identifier:videoID_];
+	D0([[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] autorelease]);
+	if ([data length] < 1) {
+		[self failedWithVideoID:videoID_ message:@"Empty response from getInfo."];
+		[self videoInfoDidFinish:nil];
+		return;
+	}
 
-		NSURLResponse * response = nil;
+	// XMLPathScanner で読む. キャッシュから読む時と同じく main thread の外で行い、結果は main thread に戻す
+	[NSThread detachNewThreadSelector:@selector(parseInfoData:) toTarget:self withObject:[[data copy] autorelease]];
+}
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+#pragma unused (connection)
+	[task_ release], task_ = nil;
+
+	[self failedWithVideoID:videoID_ error:error];
+	[self videoInfoDidFinish:nil];
+}
+
+#pragma mark -
+
+/**
+ * getInfo の応答から embed と caption に使う値を拾う(別スレッドで動く)
+ *	結果は値の辞書, NSError または NSException のいずれかとして main thread に渡す
+ *	@param[in] data	応答の本体
+ */
+- (void)parseInfoData:(NSData *)data
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+
+	id result = nil;
+	@try {
+		D_ELAPSE_BEGIN(vimeoGetInfoScan);
 		NSError * error = nil;
-		NSData * xmlData = [NSURLConnection sendSynchronousRequest:request returningResponse:&response error:&error];
-		D0([[[NSString alloc] initWithData:xmlData encoding:NSUTF8StringEncoding] autorelease]);
+		NSArray * paths = [NSArray arrayWithObjects:PATH_WIDTH, PATH_HEIGHT, PATH_TITLE, PATH_PROFILE_URL, PATH_REAL_NAME, nil];
+		NSDictionary * values = [XMLPathScanner valuesForPaths:paths inData:data error:&error];
+		result = (values != nil) ? (id)values : (id)error;
+		D_ELAPSE_END(vimeoGetInfoScan);
+	}
+	@catch (NSException * e) {
+		result = e;
+	}
+	[self performSelectorOnMainThread:@selector(didParseInfoValues:) withObject:result waitUntilDone:NO];
+
+	[pool release];
+}
+
+/**
+ * 解析が終わった(main thread). embed と caption を作る
+ *	@param[in] result	parseInfoData: の結果
+ */
+- (void)didParseInfoValues:(id)result
+{
+	NSDictionary * contents = nil;
 
-		error = nil;
-		xmlDoc = [[NSXMLDocument alloc] initWithData:xmlData options:NSXMLDocumentTidyXML error:&error];
-		if (xmlDoc == nil) {
-			[self failedWithVideoID:videoID error:error];
+	@try {
+		if ([result isKindOfClass:[NSDictionary class]]) {
+			NSDictionary * values = (NSDictionary *)result;
+			NSString * embed = [self embedTagWithValues:values withVideoID:videoID_];
+			if (embed != nil) {
+				NSString * caption = [self captionWithValues:values withVideoID:videoID_];
+				contents = [NSDictionary dictionaryWithObjectsAndKeys:embed, @"source", caption, @"caption", nil];
+			}
+			else {
+				// エラーの応答(stat="fail" など)は覚えておかない
+				[[MetadataCache sharedCache] removeDataForService:CACHE_SERVICE identifier:videoID_];
+			}
+		}
+		else if ([result isKindOfClass:[NSException class]]) {
+			[self failedWithVideoID:videoID_ exception:(NSException *)result];
+		}
+		else {
+			[self failedWithVideoID:videoID_ error:(NSError *)result];
 		}
 	}
 	@catch (NSException * e) {
 		D0([e description]);
-		[self failedWithVideoID:videoID exception:e];
-		xmlDoc = nil;
+		[self failedWithVideoID:videoID_ exception:e];
+		contents = nil;
 	}
-	return xmlDoc;
+	[self videoInfoDidFinish:contents];
 }
 
-- (NSString *)embedTagWithXML:(NSXMLDocument *)xmlDoc withVideoID:(NSString *)videoID
+/**
+ * getInfo が終わったのでポストする
+ *	@param[in] contents	@"source"(embed) と @"caption" を持つ辞書. nil ならばページの URL をポストする
+ */
+- (void)videoInfoDidFinish:(NSDictionary *)contents
 {
-	NSString * width = @"500";
-	NSString * height = @"500";
+	if (!lookingUp_) {
+		return;
+	}
+	lookingUp_ = NO;
 
-	@try {
-		NSError * error = nil;
-		NSArray * nodes = [xmlDoc nodesForXPath:@"/rsp/video/width" error:&error];
-		D(@"nodes=%@", [nodes description]);
-		width = [[nodes objectAtIndex:0] objectValue];
+	if (task_ != nil) {
+		[[HTTPSession sharedSession] cancelTask:task_];
+		[task_ release], task_ = nil;
+	}
+	Log(@"Vimeo getInfo %@ in %.3fs - VideoID:%@", (contents != nil ? @"done" : @"failed"), -[startDate_ timeIntervalSinceNow], videoID_);
 
-		nodes = [xmlDoc nodesForXPath:@"/rsp/video/height" error:&error];
-		D(@"nodes=%@", [nodes description]);
-		height = [[nodes objectAtIndex:0] objectValue];
+	@try {
+		NSString * url = context_.documentURL;
+		NSString * caption = nil;
+		if (contents != nil) {
+			url = [contents objectForKey:@"source"];
+			caption = [contents objectForKey:@"caption"];
+		}
+		[super postVideo:url caption:caption];
 	}
 	@catch (NSException * e) {
 		D0([e description]);
-		[self failedWithVideoID:videoID exception:e];
-		return nil;
+		[self failedWithException:e];
 	}
+
+	[videoID_ release], videoID_ = nil;
+	[response_ release], response_ = nil;
+	[responseData_ release], responseData_ = nil;
+	[startDate_ release], startDate_ = nil;
+	[self autorelease];	// startVideoInfoWithVideoID: の retain と対
+}
+
+- (NSString *)embedTagWithValues:(NSDictionary *)values withVideoID:(NSString *)videoID
+{
+	NSString * width = [values objectForKey:PATH_WIDTH];
+	NSString * height = [values objectForKey:PATH_HEIGHT];
+	D(@"width=%@, height=%@", width, height);
 	if (height == nil || width == nil) {
 		[self failedWithVideoID:videoID message:@"Could not get width and height"];
 		return nil;
@@ -213,18 +409,16 @@ static NSString * VIMEO_HOSTNAME = @"vimeo.com";
 	return embed;
 }
 
-- (NSString *)captionWithXML:(NSXMLDocument *)xmlDoc withVideoID:(NSString *)videoID
+- (NSString *)captionWithValues:(NSDictionary *)values withVideoID:(NSString *)videoID
 {
-	NSError * error = nil;
-	NSArray * nodes = nil;
-	NSXMLElement * node = nil;
-
-	nodes = [xmlDoc nodesForXPath:@"rsp/video/title" error:&error];
-	NSString * videoAnchor = [NSString stringWithFormat:@"<a href=\"http://www.vimeo.com/%@\">%@</a>", videoID, [[nodes objectAtIndex:0] objectValue]];
+	NSString * title = [values objectForKey:PATH_TITLE];
+	if (title == nil) {
+		[self failedWithVideoID:videoID message:@"Could not get title"];
+		return nil;
+	}
+	NSString * videoAnchor = [NSString stringWithFormat:@"<a href=\"http://www.vimeo.com/%@\">%@</a>", videoID, title];
 
-	nodes = [xmlDoc nodesForXPath:@"rsp/video/owner" error:&error];
-	node = [nodes objectAtIndex:0];
-	NSString * userAnchor = [NSString stringWithFormat:@"<a href=\"%@\">%@</a>", [[node attributeForName:@"profileurl"] stringValue], [[node attributeForName:@"realname"] stringValue]];
+	NSString * userAnchor = [NSString stringWithFormat:@"<a href=\"%@\">%@</a>", [values objectForKey:PATH_PROFILE_URL], [values objectForKey:PATH_REAL_NAME]];
 
 	NSString * caption = [NSString stringWithFormat:@"%@ (via %@)", videoAnchor, userAnchor];
 	D(@"caption=%@", caption);
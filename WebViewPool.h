@@ -0,0 +1,55 @@
+/**
+ * @file WebViewPool.h
+ * @brief WebViewPool class declaration
+ */
+#import <Foundation/Foundation.h>
+
+@class WebView;
+@class WebPreferences;
+
+/**
+ * 画面に出さない WebView の使い回し
+ *	WebView の生成と WebKit の初期化を操作のたびに払わないよう、初期化済みのものを数個持っておく.
+ *	画像とプラグインは読まない. JavaScript は借りる側が必要なときだけ有効にする.
+ *	返された WebView はデリゲートと読み込みを片付けてから空きに戻す. 空きが capacity を超える分は捨てる.
+ */
+@interface WebViewPool : NSObject
+{
+	NSMutableArray * idle_;
+	NSUInteger capacity_;
+	WebPreferences * staticPreferences_;
+	WebPreferences * scriptingPreferences_;
+	NSUInteger reused_;
+	NSUInteger created_;
+}
+
+/// 空きとして持っておく最大数. 初期値は UserSettings の "webViewPoolCapacity"(無ければ 2). 0 なら使い回さない
+@property (nonatomic, assign) NSUInteger capacity;
+
+/// 使い回した数
+@property (nonatomic, readonly) NSUInteger reused;
+
+/// 新しく作った数
+@property (nonatomic, readonly) NSUInteger created;
+
++ (WebViewPool *)sharedPool;
+
+/**
+ * 空きが capacity 個になるまで作っておく
+ */
+- (void)prewarm;
+
+/**
+ * WebView を借りる. 空きが無ければ作る
+ *	@param[in] javaScriptEnabled	JavaScript を有効にするか
+ *	@param[out] reused	使い回したものなら YES(NULL 可)
+ *	@return WebView autoreleased. 使い終わったら checkinWebView: で返す
+ */
+- (WebView *)checkoutWebViewWithJavaScriptEnabled:(BOOL)javaScriptEnabled reused:(BOOL *)reused;
+
+/**
+ * WebView を返す
+ *	@param[in] webView	checkoutWebViewWithJavaScriptEnabled:reused: で借りたもの. nil なら何もしない
+ */
+- (void)checkinWebView:(WebView *)webView;
+@end
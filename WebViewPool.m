@@ -0,0 +1,129 @@
+/**
+ * @file WebViewPool.m
+ * @brief WebViewPool class implementation
+ */
+#import "WebViewPool.h"
+#import "UserSettings.h"
+#import "DebugLog.h"
+#import <WebKit/WebKit.h>
+
+static NSUInteger DEFAULT_CAPACITY = 2;
+
+@interface WebViewPool ()
++ (WebPreferences *)preferencesWithIdentifier:(NSString *)identifier javaScriptEnabled:(BOOL)javaScriptEnabled;
+- (WebView *)createWebView;
+@end
+
+@implementation WebViewPool
+
+@synthesize capacity = capacity_;
+@synthesize reused = reused_;
+@synthesize created = created_;
+
++ (WebViewPool *)sharedPool
+{
+	static WebViewPool * instance = nil;
+	if (instance == nil) {
+		instance = [[WebViewPool alloc] init];
+	}
+	return instance;
+}
+
++ (WebPreferences *)preferencesWithIdentifier:(NSString *)identifier javaScriptEnabled:(BOOL)javaScriptEnabled
+{
+	WebPreferences * preferences = [[[WebPreferences alloc] initWithIdentifier:identifier] autorelease];
+	[preferences setAutosaves:NO];
+	[preferences setJavaScriptEnabled:javaScriptEnabled];
+	[preferences setJavaScriptCanOpenWindowsAutomatically:NO];
+	[preferences setLoadsImagesAutomatically:NO];
+	[preferences setPlugInsEnabled:NO];
+	[preferences setJavaEnabled:NO];
+	[preferences setUsesPageCache:NO];
+	return preferences;
+}
+
+- (id)init
+{
+	if ((self = [super init]) != nil) {
+		idle_ = [[NSMutableArray alloc] init];
+
+		NSString * capacity = [[UserSettings sharedInstance] stringForKey:@"webViewPoolCapacity"];
+		capacity_ = (capacity != nil && [capacity length] > 0) ? (NSUInteger)MAX([capacity integerValue], 0) : DEFAULT_CAPACITY;
+
+		staticPreferences_ = [[WebViewPool preferencesWithIdentifier:@"TumblrfulPooledWebView" javaScriptEnabled:NO] retain];
+		scriptingPreferences_ = [[WebViewPool preferencesWithIdentifier:@"TumblrfulPooledScriptingWebView" javaScriptEnabled:YES] retain];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[idle_ release], idle_ = nil;
+	[staticPreferences_ release], staticPreferences_ = nil;
+	[scriptingPreferences_ release], scriptingPreferences_ = nil;
+	[super dealloc];
+}
+
+- (void)prewarm
+{
+	D_ELAPSE_BEGIN(prewarm);
+	while ([idle_ count] < capacity_) {
+		WebView * webView = [self createWebView];
+		// 空のページを1度読ませて WebKit 側の初期化を済ませておく
+		[[webView mainFrame] loadHTMLString:@"" baseURL:nil];
+		[idle_ addObject:webView];
+	}
+	D_ELAPSE_END(prewarm);
+}
+
+- (WebView *)checkoutWebViewWithJavaScriptEnabled:(BOOL)javaScriptEnabled reused:(BOOL *)reused
+{
+	WebView * webView = nil;
+	BOOL const fromPool = [idle_ count] > 0;
+	if (fromPool) {
+		webView = [[[idle_ lastObject] retain] autorelease];
+		[idle_ removeLastObject];
+		++reused_;
+	}
+	else {
+		webView = [self createWebView];
+	}
+	if (reused != NULL) *reused = fromPool;
+
+	[webView setPreferences:(javaScriptEnabled ? scriptingPreferences_ : staticPreferences_)];
+	D(@"reused=%u created=%u idle=%u", reused_, created_, [idle_ count]);
+	return webView;
+}
+
+- (void)checkinWebView:(WebView *)webView
+{
+	if (webView == nil) return;
+
+	// 前の利用者に何も届かないよう、デリゲートを外してから読み込みを止める
+	[webView setFrameLoadDelegate:nil];
+	[webView setResourceLoadDelegate:nil];
+	[webView setPolicyDelegate:nil];
+	[webView setUIDelegate:nil];
+	[webView stopLoading:nil];
+
+	if ([idle_ count] >= capacity_ || [idle_ containsObject:webView]) return;
+
+	[[webView mainFrame] loadHTMLString:@"" baseURL:nil];
+	[idle_ addObject:webView];
+}
+
+#pragma mark -
+#pragma mark Private Methods
+
+- (WebView *)createWebView
+{
+	WebView * webView = [[[WebView alloc] initWithFrame:NSZeroRect frameName:nil groupName:nil] autorelease];
+	[webView setHidden:YES];
+	[webView setDrawsBackground:NO];
+	[webView setShouldUpdateWhileOffscreen:NO];
+	[webView setMaintainsBackForwardList:NO];
+	[webView setPreferences:staticPreferences_];
+	++created_;
+	return webView;
+}
+@end
@@ -0,0 +1,51 @@
+/**
+ * @file XMLPathScanner.h
+ * @brief XMLPathScanner class declaration
+ */
+#import <Foundation/Foundation.h>
+
+/**
+ * XML を先頭から読みながら、パスで指定した値だけを拾う
+ *	API の応答から2, 3個の値を読むためだけに NSXMLDocument(と Tidy)で木を作るのをやめるためのもの.
+ *	NSXMLParser のイベントを受けて、指定したすべての値が見つかった時点で読むのをやめる.
+ *
+ *	パスの書き方:
+ *	- @"/rsp/video/width"	ルートからの要素. 値は要素内のテキスト(子孫のテキストを含む)
+ *	- @"//photo/title"		どの深さでもよい. 末尾がこの並びになる要素
+ *	- @"/rsp/video/owner@realname"	要素の属性
+ *	- @"@reblog-key"		この属性を持つ最初の要素の属性
+ *	同じパスに当てはまるものが複数あれば最初のものを使う.
+ *	要素内のテキストを拾っている間は、その子孫に当てはまる別のパスは拾わない.
+ */
+@interface XMLPathScanner : NSObject
+{
+	NSMutableArray * pending_;		///< まだ見つかっていないパス
+	NSMutableDictionary * values_;
+	NSMutableString * path_;		///< 今いる要素のパス
+	NSMutableArray * pathLengths_;	///< 親の要素に戻る時の path_ の長さ
+	NSMutableArray * capturing_;	///< テキストを拾っているパス
+	NSUInteger captureDepth_;
+	NSMutableString * text_;
+	id collect_;					///< 属性を集める要素のパス
+	NSMutableArray * collected_;
+	BOOL finished_;
+}
+
+/**
+ * XML から値を拾う
+ *	@param[in] paths	パスの配列
+ *	@param[in] data	XML
+ *	@param[out] error	XML として読めなかった時のエラー(NULL 可)
+ *	@return パスをキー、拾った文字列を値とする辞書. 見つからなかったパスは含まない. 読めなければ nil
+ */
++ (NSDictionary *)valuesForPaths:(NSArray *)paths inData:(NSData *)data error:(NSError **)error;
+
+/**
+ * XML から、パスに当てはまるすべての要素の属性を集める. 最後まで読む
+ *	@param[in] path	要素のパス(@ は付けない)
+ *	@param[in] data	XML
+ *	@param[out] error	XML として読めなかった時のエラー(NULL 可)
+ *	@return 要素ごとの属性の辞書の配列(文書順). 読めなければ nil
+ */
++ (NSArray *)attributesForPath:(NSString *)path inData:(NSData *)data error:(NSError **)error;
+@end
@@ -0,0 +1,239 @@
+/**
+ * @file XMLPathScanner.m
+ * @brief XMLPathScanner class implementation
+ */
+#import "XMLPathScanner.h"
+#import "DebugLog.h"
+
+#pragma mark -
+/**
+ * 1つのパスを解釈したもの
+ */
+@interface XMLPathSelector : NSObject
+{
+	NSString * source_;
+	NSString * elementPath_;	///< 空ならどの要素でもよい
+	NSString * attribute_;		///< nil なら要素内のテキスト
+	BOOL descendant_;
+}
+@property (nonatomic, readonly) NSString * source;
+@property (nonatomic, readonly) NSString * attribute;
+- (id)initWithString:(NSString *)source;
+- (BOOL)matchesPath:(NSString *)path;
+@end
+
+@implementation XMLPathSelector
+
+@synthesize source = source_;
+@synthesize attribute = attribute_;
+
+- (id)initWithString:(NSString *)source
+{
+	if ((self = [super init]) != nil) {
+		source_ = [source copy];
+
+		NSString * element = source;
+		NSRange range = [source rangeOfString:@"@" options:NSBackwardsSearch];
+		if (range.location != NSNotFound) {
+			element = [source substringToIndex:range.location];
+			attribute_ = [[source substringFromIndex:(range.location + 1)] copy];
+		}
+
+		if ([element hasPrefix:@"//"]) {
+			descendant_ = YES;
+			element = [element substringFromIndex:1];
+		}
+		else if ([element length] > 0 && ![element hasPrefix:@"/"]) {
+			element = [@"/" stringByAppendingString:element];
+		}
+		elementPath_ = [element copy];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[source_ release], source_ = nil;
+	[elementPath_ release], elementPath_ = nil;
+	[attribute_ release], attribute_ = nil;
+
+	[super dealloc];
+}
+
+- (BOOL)matchesPath:(NSString *)path
+{
+	if ([elementPath_ length] == 0) {
+		return YES;
+	}
+	// elementPath_ は '/' で始まるので、末尾の比較で要素名の途中に当たることはない
+	return descendant_ ? [path hasSuffix:elementPath_] : [path isEqualToString:elementPath_];
+}
+@end
+
+#pragma mark -
+@interface XMLPathScanner () <NSXMLParserDelegate>
+- (id)initWithPaths:(NSArray *)paths;
+- (BOOL)parseData:(NSData *)data error:(NSError **)error;
+- (void)finishIfDone:(NSXMLParser *)parser;
+@end
+
+@implementation XMLPathScanner
+
++ (NSDictionary *)valuesForPaths:(NSArray *)paths inData:(NSData *)data error:(NSError **)error
+{
+	XMLPathScanner * scanner = [[[XMLPathScanner alloc] initWithPaths:paths] autorelease];
+	if ([paths count] > 0 && ![scanner parseData:data error:error]) {
+		return nil;
+	}
+	return [[scanner->values_ copy] autorelease];
+}
+
++ (NSArray *)attributesForPath:(NSString *)path inData:(NSData *)data error:(NSError **)error
+{
+	XMLPathScanner * scanner = [[[XMLPathScanner alloc] initWithPaths:nil] autorelease];
+	scanner->collect_ = [[XMLPathSelector alloc] initWithString:path];
+	scanner->collected_ = [[NSMutableArray alloc] init];
+	if (![scanner parseData:data error:error]) {
+		return nil;
+	}
+	return [[scanner->collected_ copy] autorelease];
+}
+
+- (id)initWithPaths:(NSArray *)paths
+{
+	if ((self = [super init]) != nil) {
+		pending_ = [[NSMutableArray alloc] initWithCapacity:[paths count]];
+		for (NSString * path in paths) {
+			XMLPathSelector * selector = [[XMLPathSelector alloc] initWithString:path];
+			[pending_ addObject:selector];
+			[selector release];
+		}
+		values_ = [[NSMutableDictionary alloc] initWithCapacity:[paths count]];
+		path_ = [[NSMutableString alloc] init];
+		pathLengths_ = [[NSMutableArray alloc] init];
+		capturing_ = [[NSMutableArray alloc] init];
+		text_ = [[NSMutableString alloc] init];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[pending_ release], pending_ = nil;
+	[values_ release], values_ = nil;
+	[path_ release], path_ = nil;
+	[pathLengths_ release], pathLengths_ = nil;
+	[capturing_ release], capturing_ = nil;
+	[text_ release], text_ = nil;
+	[collect_ release], collect_ = nil;
+	[collected_ release], collected_ = nil;
+
+	[super dealloc];
+}
+
+- (BOOL)parseData:(NSData *)data error:(NSError **)error
+{
+	NSXMLParser * parser = [[[NSXMLParser alloc] initWithData:data] autorelease];
+	[parser setDelegate:self];
+	[parser setShouldResolveExternalEntities:NO];
+
+	// 全部見つかって止めた時も parse は NO を返す
+	if (![parser parse] && !finished_) {
+		D(@"parse error: %@", [[parser parserError] description]);
+		if (error != NULL) *error = [parser parserError];
+		return NO;
+	}
+	return YES;
+}
+
+- (void)finishIfDone:(NSXMLParser *)parser
+{
+	if (collect_ == nil && [pending_ count] == 0 && [capturing_ count] == 0) {
+		finished_ = YES;
+		[parser abortParsing];
+	}
+}
+
+#pragma mark -
+#pragma mark NSXMLParserDelegate
+
+- (void)parser:(NSXMLParser *)parser didStartElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI qualifiedName:(NSString *)qName attributes:(NSDictionary *)attributeDict
+{
+#pragma unused (namespaceURI, qName)
+	if (finished_) return;
+
+	[pathLengths_ addObject:[NSNumber numberWithUnsignedInteger:[path_ length]]];
+	[path_ appendString:@"/"];
+	[path_ appendString:elementName];
+
+	if (collect_ != nil && [collect_ matchesPath:path_]) {
+		[collected_ addObject:attributeDict];
+	}
+
+	if ([capturing_ count] > 0) {
+		++captureDepth_;
+		return;
+	}
+
+	NSUInteger i = [pending_ count];
+	while (i-- > 0) {
+		XMLPathSelector * selector = [pending_ objectAtIndex:i];
+		if (![selector matchesPath:path_]) continue;
+
+		if (selector.attribute != nil) {
+			NSString * value = [attributeDict objectForKey:selector.attribute];
+			if (value == nil) continue;
+			[values_ setObject:value forKey:selector.source];
+		}
+		else {
+			[capturing_ addObject:selector];
+		}
+		[pending_ removeObjectAtIndex:i];
+	}
+
+	if ([capturing_ count] > 0) {
+		captureDepth_ = 1;
+		[text_ setString:@""];
+	}
+	[self finishIfDone:parser];
+}
+
+- (void)parser:(NSXMLParser *)parser didEndElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI qualifiedName:(NSString *)qName
+{
+#pragma unused (elementName, namespaceURI, qName)
+	if (finished_) return;
+
+	if ([capturing_ count] > 0 && --captureDepth_ == 0) {
+		NSString * text = [[text_ copy] autorelease];
+		for (XMLPathSelector * selector in capturing_) {
+			[values_ setObject:text forKey:selector.source];
+		}
+		[capturing_ removeAllObjects];
+	}
+
+	[path_ deleteCharactersInRange:NSMakeRange([[pathLengths_ lastObject] unsignedIntegerValue], [path_ length] - [[pathLengths_ lastObject] unsignedIntegerValue])];
+	[pathLengths_ removeLastObject];
+
+	[self finishIfDone:parser];
+}
+
+- (void)parser:(NSXMLParser *)parser foundCharacters:(NSString *)string
+{
+#pragma unused (parser)
+	if ([capturing_ count] > 0) {
+		[text_ appendString:string];
+	}
+}
+
+- (void)parser:(NSXMLParser *)parser foundCDATA:(NSData *)CDATABlock
+{
+#pragma unused (parser)
+	if ([capturing_ count] > 0) {
+		NSString * string = [[NSString alloc] initWithData:CDATABlock encoding:NSUTF8StringEncoding];
+		if (string != nil) {
+			[text_ appendString:string];
+			[string release];
+		}
+	}
+}
+@end
@@ -7,10 +7,28 @@
 @interface YammerPost : NSObject<Post>
 {
 	NSObject<PostCallback> * callback_;
-	WebView * webView_;
+	WebView * webView_;	///< WebViewPool から借りたもの
 	BOOL releasable_;
+	BOOL pooled_;
+	NSDate * startDate_;
+	NSMutableData * responseData_;	///< for HTTP
+	NSInteger statusCode_;			///< for HTTP
 }
 
 + (BOOL)enabled;
 
+/**
+ * Yammer API の OAuth アクセストークン
+ *	UserSettings の "yammerAccessToken". 設定されていれば WebView を使わず HTTP リクエスト1つでポストする
+ *	@return アクセストークン. 未設定なら nil
+ */
++ (NSString *)accessToken;
+
+/**
+ * HTTP でポストする先
+ *	UserSettings の "yammerAPIEndpoint"(手元の代用サーバで試す時用). 未設定なら Yammer の messages API
+ *	@return URL文字列
+ */
++ (NSString *)endpoint;
+
 @end
@@ -2,16 +2,23 @@
  * @file YammerPost.m
  */
 #import "YammerPost.h"
+#import "HTTPSession.h"
 #import "NSString+Tumblrful.h"
 #import "UserSettings.h"
 #import "TumblrfulConstants.h"
+#import "WebViewPool.h"
+#import "FormEncoder.h"
 #import "DebugLog.h"
 
 #define TIMEOUT (30.0)
 
 static NSString * ENDPOINT_FORMAT = @"https://www.yammer.com/%@/messages/new";
 
+static NSString * API_ENDPOINT = @"https://www.yammer.com/api/v1/messages.json";
+
 @interface YammerPost ()
+- (void)postWithHTTP:(NSDictionary *)params;
+- (void)postWithWebView:(NSDictionary *)params;
 - (void)callbackOnMainThread:(SEL)selector withObject:(id)obj;
 @end
 
@@ -25,6 +32,18 @@ static NSString * ENDPOINT_FORMAT = @"https://www.yammer.com/%@/messages/new";
 	return [[UserSettings sharedInstance] boolForKey:@"yammerEnabled"];
 }
 
++ (NSString *)accessToken
+{
+	NSString * token = [[UserSettings sharedInstance] stringForKey:@"yammerAccessToken"];
+	return [token length] > 0 ? token : nil;
+}
+
++ (NSString *)endpoint
+{
+	NSString * endpoint = [[UserSettings sharedInstance] stringForKey:@"yammerAPIEndpoint"];
+	return [endpoint length] > 0 ? endpoint : API_ENDPOINT;
+}
+
 #pragma mark -
 #pragma mark Override Methods
 
@@ -49,7 +68,10 @@ static NSString * ENDPOINT_FORMAT = @"https://www.yammer.com/%@/messages/new";
 - (void)dealloc
 {
 	[callback_ release], callback_ = nil;
+	[[WebViewPool sharedPool] checkinWebView:webView_];
 	[webView_ release], webView_ = nil;
+	[startDate_ release], startDate_ = nil;
+	[responseData_ release], responseData_ = nil;
 	[super dealloc];
 }
 
@@ -64,6 +86,50 @@ static NSString * ENDPOINT_FORMAT = @"https://www.yammer.com/%@/messages/new";
 }
 
 - (void)postWith:(NSDictionary *)params
+{
+	if ([YammerPost accessToken] != nil) {
+		[self postWithHTTP:params];
+	}
+	else {
+		[self postWithWebView:params];
+	}
+}
+
+#pragma mark -
+#pragma mark Private Methods
+
+/// messages API に1回 POST する. 結果は NSURLConnection のデリゲートで受ける
+- (void)postWithHTTP:(NSDictionary *)params
+{
+	@try {
+		NSString * url = [YammerPost endpoint];
+		D0(url);
+
+		NSDictionary * fields = [NSDictionary dictionaryWithObjectsAndKeys:[params objectForKey:@"body"], @"body", nil];
+		NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:url] cachePolicy:NSURLRequestReloadIgnoringCacheData timeoutInterval:TIMEOUT];
+		[request setHTTPMethod:@"POST"];
+		[request setValue:@"application/x-www-form-urlencoded" forHTTPHeaderField:@"Content-Type"];
+		[request setValue:[NSString stringWithFormat:@"Bearer %@", [YammerPost accessToken]] forHTTPHeaderField:@"Authorization"];
+		[request setHTTPBody:[FormEncoder dataWithParams:fields]];
+
+		[startDate_ release];
+		startDate_ = [[NSDate alloc] init];
+		id task = [[HTTPSession sharedSession] startRequest:request delegate:self];	// 同じホストへの接続を使い回す
+		if (task == nil) {
+			NSError * error = [NSError errorWithDomain:TUMBLRFUL_ERROR_DOMAIN code:-1 userInfo:nil];
+			[self callbackOnMainThread:@selector(failedWithError:) withObject:error];
+			[self autorelease];
+		}
+	}
+	@catch (NSException * e) {
+		D0([e description]);
+		[self callbackOnMainThread:@selector(failedWithException:) withObject:e];
+		[self autorelease];
+	}
+}
+
+/// Yammer の画面を WebView に読み込み、ボタンを押してポストする
+- (void)postWithWebView:(NSDictionary *)params
 {
 	releasable_ = NO;
 
@@ -80,8 +146,10 @@ static NSString * ENDPOINT_FORMAT = @"https://www.yammer.com/%@/messages/new";
 		NSURL * u = [NSURL URLWithString:[NSString stringWithFormat:@"%@?status=%@", url, status]];
 		NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:u cachePolicy:NSURLRequestReloadIgnoringCacheData timeoutInterval:TIMEOUT];
 
-		webView_ = [[WebView alloc] initWithFrame:NSZeroRect frameName:nil groupName:nil];
-		[webView_ setHidden:YES];
+		// フォームの送信は Yammer のスクリプトが行うので JavaScript を有効にして借りる
+		[startDate_ release];
+		startDate_ = [[NSDate alloc] init];
+		webView_ = [[[WebViewPool sharedPool] checkoutWebViewWithJavaScriptEnabled:YES reused:&pooled_] retain];
 		[webView_ setFrameLoadDelegate:self];
 		[webView_ setResourceLoadDelegate:self];
 		[[webView_ mainFrame] loadRequest:request];
@@ -99,6 +167,51 @@ static NSString * ENDPOINT_FORMAT = @"https://www.yammer.com/%@/messages/new";
 	}
 }
 
+#pragma mark -
+#pragma mark NSURLConnection Delegate Methods
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+#pragma unused (connection)
+	statusCode_ = [response isKindOfClass:[NSHTTPURLResponse class]] ? [(NSHTTPURLResponse *)response statusCode] : 0;
+	D(@"statusCode=%d", statusCode_);
+
+	[responseData_ release];
+	responseData_ = [[NSMutableData alloc] init];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+#pragma unused (connection)
+	[responseData_ appendData:data];
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection
+{
+#pragma unused (connection)
+	Log(@"yammer posted: %.3f sec (HTTP %d)", -[startDate_ timeIntervalSinceNow], statusCode_);
+
+	NSString * text = [[[NSString alloc] initWithData:responseData_ encoding:NSUTF8StringEncoding] autorelease];
+	if (statusCode_ == 201 || statusCode_ == 200) {
+		[self callbackOnMainThread:@selector(successed:) withObject:text];
+	}
+	else {
+		D0(text);
+		NSString * message = [NSHTTPURLResponse localizedStringForStatusCode:statusCode_];
+		NSError * error = [NSError errorWithDomain:TUMBLRFUL_ERROR_DOMAIN code:statusCode_ userInfo:[NSDictionary dictionaryWithObject:Stringnize(message) forKey:NSLocalizedDescriptionKey]];
+		[self callbackOnMainThread:@selector(failedWithError:) withObject:error];
+	}
+	[self autorelease];
+}
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+#pragma unused (connection)
+	D0([error description]);
+	[self callbackOnMainThread:@selector(failedWithError:) withObject:error];
+	[self autorelease];
+}
+
 #pragma mark -
 #pragma mark WebFrameLoadDelegate Methods
 
@@ -148,6 +261,7 @@ static NSString * ENDPOINT_FORMAT = @"https://www.yammer.com/%@/messages/new";
 #pragma unused (sender, frame)
 	D_METHOD;
 	if ([sender mainFrame] != frame) return;
+	Log(@"yammer form loaded: %.3f sec (%@)", -[startDate_ timeIntervalSinceNow], pooled_ ? @"WebView pooled" : @"WebView new");
 
 	DOMHTMLDocument * htmlDoc = (DOMHTMLDocument *)[frame DOMDocument];
 	if (![htmlDoc isKindOfClass:[DOMHTMLDocument class]]) return;